@@ -0,0 +1,4 @@
+// Parsing lots of small JSON messages, like the ones that come from MQTT
+var msg = JSON.stringify({topic:"home/sensors/lounge", time:1522584001, temp:21.5, humidity:40,
+                          ok:true, tags:["a","b","c"], pos:{x:-1.25, y:3, z:null}});
+for (i=0;i<500;i++) JSON.parse(msg);
@@ -0,0 +1,12 @@
+// Typical RegEx uses, plus one that takes exponential time with a backtracking matcher
+var log = "2018-04-01 12:00:01 INFO temp=21.5 humidity=40\n";
+for (i=0;i<200;i++) {
+  /(\d+)-(\d+)-(\d+)/.exec(log);
+  /temp=([\d.]+)/.exec(log);
+  log.replace(/\s+/g, " ");
+  log.split(/[ =]/);
+  /^\w+@\w+\.com$/.test("someone@example.com");
+}
+var a = "";
+for (i=0;i<30;i++) a += "a";
+/a*a*a*a*a*b/.test(a);
@@ -0,0 +1,62 @@
+
+// Automatically generated header file for LINUX
+// Generated by scripts/build_platform_config.py
+
+#ifndef _PLATFORM_CONFIG_H
+#define _PLATFORM_CONFIG_H
+
+
+#define PC_BOARD_ID "LINUX"
+#define PC_BOARD_CHIP "LINUX"
+#define PC_BOARD_CHIP_FAMILY "LINUX"
+
+#define LINKER_END_VAR _end
+#define LINKER_ETEXT_VAR _etext
+
+
+// SYSTICK is the counter that counts up and that we use as the real-time clock
+// The smaller this is, the longer we spend in interrupts, but also the more we can sleep!
+#define SYSTICK_RANGE 0x1000000 // the Maximum (it is a 24 bit counter) - on Olimexino this is about 0.6 sec
+#define SYSTICKS_BEFORE_USB_DISCONNECT 2
+
+#define DEFAULT_BUSY_PIN_INDICATOR (Pin)-1 // no indicator
+#define DEFAULT_SLEEP_PIN_INDICATOR (Pin)-1 // no indicator
+
+// When to send the message that the IO buffer is getting full
+#define IOBUFFER_XOFF ((TXBUFFERMASK)*6/8)
+// When to send the message that we can start receiving again
+#define IOBUFFER_XON ((TXBUFFERMASK)*3/8)
+
+
+
+#define RAM_TOTAL (0*1024)
+#define FLASH_TOTAL (256*1024)
+
+#define RESIZABLE_JSVARS // Allocate variables in blocks using malloc - slow, and linux-only
+#define FLASH_START                     0x10000000
+#define FLASH_PAGE_SIZE                 1024
+#define FLASH_SAVED_CODE_START            (FLASH_START + FLASH_TOTAL - FLASH_SAVED_CODE_LENGTH)
+#define FLASH_SAVED_CODE_LENGTH           8192
+
+#define CLOCK_SPEED_MHZ                      -1
+#define USART_COUNT                          6
+#define SPI_COUNT                            3
+#define I2C_COUNT                            3
+#define ADC_COUNT                            0
+#define DAC_COUNT                            0
+#define EXTI_COUNT                           16
+
+#define DEFAULT_CONSOLE_DEVICE              EV_USBSERIAL
+
+#define IOBUFFERMASK 255 // (max 255) amount of items in event buffer - events take 5 bytes each
+#define TXBUFFERMASK 255 // (max 255) amount of items in the transmit buffer - 2 bytes each
+#define UTILTIMERTASK_TASKS (16) // Must be power of 2 - and max 256
+
+
+// definition to avoid compilation when Pin/platform config is not defined
+#define IS_PIN_USED_INTERNALLY(PIN) ((false))
+#define IS_PIN_A_LED(PIN) ((false))
+#define IS_PIN_A_BUTTON(PIN) ((false))
+
+#endif // _PLATFORM_CONFIG_H
+
@@ -306,7 +306,7 @@ codeOut('');
 codeOut("""
 // Binary search coded to allow for JswSyms to be in flash on the esp8266 where they require
 // word accesses
-JsVar *jswBinarySearch(const JswSymList *symbolsPtr, JsVar *parent, const char *name) {
+static const JswSymPtr *jswBinarySearchSymbols(const JswSymList *symbolsPtr, const char *name) {
   uint8_t symbolCount = READ_FLASH_UINT8(&symbolsPtr->symbolCount);
   int searchMin = 0;
   int searchMax = symbolCount - 1;
@@ -316,10 +316,7 @@ JsVar *jswBinarySearch(const JswSymList *symbolsPtr, JsVar *parent, const char *
     unsigned short strOffset = READ_FLASH_UINT16(&sym->strOffset);
     int cmp = FLASH_STRCMP(name, &symbolsPtr->symbolChars[strOffset]);
     if (cmp==0) {
-      unsigned short functionSpec = READ_FLASH_UINT16(&sym->functionSpec);
-      if ((functionSpec & JSWAT_EXECUTE_IMMEDIATELY_MASK) == JSWAT_EXECUTE_IMMEDIATELY)
-        return jsnCallFunction(sym->functionPtr, functionSpec, parent, 0, 0);
-      return jsvNewNativeFunction(sym->functionPtr, functionSpec);
+      return sym;
     } else {
       if (cmp<0) {
         // searchMin is the same
@@ -333,6 +330,15 @@ JsVar *jswBinarySearch(const JswSymList *symbolsPtr, JsVar *parent, const char *
   return 0;
 }
 
+JsVar *jswBinarySearch(const JswSymList *symbolsPtr, JsVar *parent, const char *name) {
+  const JswSymPtr *sym = jswBinarySearchSymbols(symbolsPtr, name);
+  if (!sym) return 0;
+  unsigned short functionSpec = READ_FLASH_UINT16(&sym->functionSpec);
+  if ((functionSpec & JSWAT_EXECUTE_IMMEDIATELY_MASK) == JSWAT_EXECUTE_IMMEDIATELY)
+    return jsnCallFunction(sym->functionPtr, functionSpec, parent, 0, 0);
+  return jsvNewNativeFunction(sym->functionPtr, functionSpec);
+}
+
 """);
 
 codeOut('// -----------------------------------------------------------------------------------------');
@@ -517,19 +523,108 @@ codeOut('}')
 codeOut('')
 codeOut('')
 
-builtinChecks = []
+builtinObjects = []
 for jsondata in jsondatas:
   if "class" in jsondata:
-    check = 'strcmp(name, "'+jsondata["class"]+'")==0';
     if not jsondata["class"] in libraries:
-      if not check in builtinChecks:
-        builtinChecks.append(check)
-
+      if not jsondata["class"] in builtinObjects:
+        builtinObjects.append(jsondata["class"])
+builtinObjects.sort()
+
+# Output a tree of ifs that does a binary search of the sorted names
+def codeOutBuiltInObjectSearch(indent, names):
+  if not names:
+    codeOut(indent+"return false;")
+    return
+  mid = len(names)//2
+  codeOut(indent+'cmp = strcmp(name, "'+names[mid]+'");')
+  codeOut(indent+'if (cmp<0) {')
+  codeOutBuiltInObjectSearch(indent+"  ", names[:mid])
+  codeOut(indent+'} else if (cmp>0) {')
+  codeOutBuiltInObjectSearch(indent+"  ", names[mid+1:])
+  codeOut(indent+'} else return true;')
 
 codeOut('bool jswIsBuiltInObject(const char *name) {')
-codeOut('  return\n'+" ||\n    ".join(builtinChecks)+';')
+codeOut('  int cmp;')
+codeOutBuiltInObjectSearch("  ", builtinObjects)
+codeOut('}')
+
+codeOut('')
+codeOut('')
+
+# Benchmark for all the lookups above - Linux only as it uses a bit of space
+codeOut('#if defined(LINUX) && !defined(SAVE_ON_FLASH)')
+codeOut('static const char *jswSymbolTableNames[] = {')
+for b in builtins:
+  codeOut('  "'+builtins[b]["name"]+'",')
+codeOut('};')
+codeOut('static const char *jswBuiltInObjectNames[] = {')
+for name in builtinObjects:
+  codeOut('  "'+name+'",')
+codeOut('};')
+codeOut('')
+codeOut('/// The old way of checking for a built-in object, so we can compare against it')
+codeOut('static bool jswIsBuiltInObjectLinear(const char *name) {')
+codeOut('  return\n    '+" ||\n    ".join(['strcmp(name, "'+name+'")==0' for name in builtinObjects])+';')
 codeOut('}')
+codeOut("""
+/// Return the average time in nanoseconds for one lookup
+static int jswBenchmarkTime(JsSysTime time, int lookups) {
+  return (int)(jshGetMillisecondsFromTime(time)*1000000/lookups);
+}
 
+bool jswBenchmarkSymbolLookups() {
+  const int repeats = 1000;
+  int totalSymbols = 0;
+  JsSysTime totalTime = 0;
+  for (unsigned int t=0;t<sizeof(jswSymbolTables)/sizeof(JswSymList);t++) {
+    const JswSymList *l = &jswSymbolTables[t];
+    if (!l->symbolCount) continue;
+    JsSysTime time = 0;
+    for (int i=0;i<l->symbolCount;i++) {
+      const char *name = &l->symbolChars[l->symbols[i].strOffset];
+      const JswSymPtr *sym = 0;
+      JsSysTime startTime = jshGetSystemTime();
+      for (int r=0;r<repeats;r++)
+        sym = jswBinarySearchSymbols(l, name);
+      time += jshGetSystemTime() - startTime;
+      // names can appear more than once (different implementations), so compare names not pointers
+      if (!sym || strcmp(&l->symbolChars[sym->strOffset], name)) {
+        jsiConsolePrintf("Lookup of %s.%s failed\\n", jswSymbolTableNames[t], name);
+        return false;
+      }
+    }
+    jsiConsolePrintf("%s: %d symbols, %dns\\n", jswSymbolTableNames[t], l->symbolCount,
+        jswBenchmarkTime(time, repeats*l->symbolCount));
+    totalSymbols += l->symbolCount;
+    totalTime += time;
+  }
+  jsiConsolePrintf("All symbols: %d symbols, %dns\\n", totalSymbols, jswBenchmarkTime(totalTime, repeats*totalSymbols));
+
+  int objectCount = (int)(sizeof(jswBuiltInObjectNames)/sizeof(const char*));
+  JsSysTime treeTime = 0, linearTime = 0;
+  for (int i=0;i<objectCount;i++) {
+    const char *name = jswBuiltInObjectNames[i];
+    bool found = true;
+    JsSysTime startTime = jshGetSystemTime();
+    for (int r=0;r<repeats;r++)
+      found &= jswIsBuiltInObject(name);
+    JsSysTime midTime = jshGetSystemTime();
+    for (int r=0;r<repeats;r++)
+      found &= jswIsBuiltInObjectLinear(name);
+    treeTime += midTime - startTime;
+    linearTime += jshGetSystemTime() - midTime;
+    if (!found || jswIsBuiltInObject("NotABuiltIn")) {
+      jsiConsolePrintf("Built-in object check of %s failed\\n", name);
+      return false;
+    }
+  }
+  jsiConsolePrintf("Built-in objects: %d names, %dns (was %dns)\\n", objectCount,
+      jswBenchmarkTime(treeTime, repeats*objectCount), jswBenchmarkTime(linearTime, repeats*objectCount));
+  return true;
+}
+#endif
+""")
 codeOut('')
 codeOut('')
 
@@ -22,9 +22,11 @@ typedef enum {
   JSF_PRETOKENISE         = 1<<1, ///< When adding functions, pre-minify them and tokenise reserved words
   JSF_UNSAFE_FLASH        = 1<<2, ///< Some platforms stop writes/erases to interpreter memory to stop you bricking the device accidentally - this removes that protection
   JSF_UNSYNC_FILES        = 1<<3, ///< When accessing files, *don't* flush all data to the SD card after each command. Faster, but risky if power is lost
+  JSF_TOKENISE_ON_CALL    = 1<<4, ///< When a function is first called, cache a tokenised copy of its code and execute from that
+  JSF_TAIL_CALLS          = 1<<5, ///< When a function ends with 'return f(...)', call 'f' after it has returned rather than from inside it
 } PACKED_FLAGS JsFlags;
 
-#define JSFLAG_NAMES "deepSleep\0pretokenise\0unsafeFlash\0unsyncFiles\0"
+#define JSFLAG_NAMES "deepSleep\0pretokenise\0unsafeFlash\0unsyncFiles\0tokeniseOnCall\0tailCalls\0"
 // NOTE: \0 also added by compiler - two \0's are required!
 
 extern volatile JsFlags jsFlags;
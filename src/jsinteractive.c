@@ -2169,13 +2169,36 @@ void jsiIdle() {
     jsiSetBusy(BUSY_INTERACTIVE, false);
   }
 
+#ifdef JSV_GC_GREY_STACK_SIZE
+  /* If E.setGCBudget has been used, collect garbage a few variables at
+   * a time each time around the loop, once memory use has grown enough */
+  if (jsvGetGarbageCollectBudget()) {
+    if (jsvGarbageCollectInProgress() ||
+        (loopsIdling==1 && jsvGarbageCollectWanted())) {
+      jsiSetBusy(BUSY_INTERACTIVE, true);
+      jsvGarbageCollectIncremental();
+      loopsIdling = 0;
+      jsiSetBusy(BUSY_INTERACTIVE, false);
+    }
+  } else
+#endif
   /* if we've been around this loop, there is nothing to do, and
    * we have a spare 10ms then let's do some Garbage Collection
    * if we think we need to */
   if (loopsIdling==1 &&
       minTimeUntilNext > jshGetTimeFromMilliseconds(10) &&
-      !jsvMoreFreeVariablesThan(JS_VARS_BEFORE_IDLE_GC)) {
+      (!jsvMoreFreeVariablesThan(JS_VARS_BEFORE_IDLE_GC)
+#if defined(RESIZABLE_JSVARS) && !defined(SAVE_ON_FLASH)
+       || jsvShrinkMemoryWanted()
+#endif
+      )) {
     jsiSetBusy(BUSY_INTERACTIVE, true);
+#if defined(RESIZABLE_JSVARS) && !defined(SAVE_ON_FLASH)
+    /* If memory has grown, move variables towards the start (this collects
+     * garbage too) so that blocks at the end can be given back */
+    if (jsvShrinkMemoryWanted()) jsvDefragment();
+    else
+#endif
     jsvGarbageCollect();
     loopsIdling = 0;
     jsiSetBusy(BUSY_INTERACTIVE, false);
@@ -14,6 +14,10 @@
 #include "jslex.h"
 
 JsLex *lex;
+#ifndef SAVE_ON_FLASH
+/// The lexer that was initialised most recently and hasn't been killed (see JsLex.prevActive)
+static JsLex *jslActive = 0;
+#endif
 
 JsLex *jslSetLex(JsLex *l) {
   JsLex *old = lex;
@@ -332,8 +336,8 @@ static void jslLexRegex() {
   jsvStringIteratorFree(&it);
 }
 
-void jslGetNextToken() {
-  jslGetNextToken_start:
+static void jslLexToken() {
+  jslLexToken_start:
   // Skip whitespace
   while (isWhitespace(lex->currCh))
     jslGetNextCh();
@@ -343,7 +347,7 @@ void jslGetNextToken() {
     if (jslNextCh()=='/') {
       while (lex->currCh && lex->currCh!='\n') jslGetNextCh();
       jslGetNextCh();
-      goto jslGetNextToken_start;
+      goto jslLexToken_start;
     }
     // block comments
     if (jslNextCh()=='*') {
@@ -358,7 +362,7 @@ void jslGetNextToken() {
       }
       jslGetNextCh();
       jslGetNextCh();
-      goto jslGetNextToken_start;
+      goto jslLexToken_start;
     }
   }
   int lastToken = lex->tk;
@@ -640,6 +644,107 @@ void jslGetNextToken() {
   }
 }
 
+#ifdef JSL_TOKEN_CACHE_SIZE
+/// Caches used by loops that are currently executing (only the outermost loop in each lexer has one)
+static JslTokenCache jslTokenCaches[JSL_TOKEN_CACHES];
+/// How many of jslTokenCaches are in use
+static unsigned int jslTokenCachesUsed = 0;
+
+/// Find the cached token lexed from position 'from', or return -1
+static int jslTokenCacheFind(JslTokenCache *cache, size_t from) {
+  // most of the time we want the token after the last one we used
+  if (cache->lastIdx+1 < cache->count && cache->tokens[cache->lastIdx+1].from == from)
+    return (int)cache->lastIdx+1;
+  int lo = 0, hi = (int)cache->count-1;
+  while (lo<=hi) {
+    int mid = (lo+hi) >> 1;
+    if (cache->tokens[mid].from < from) lo = mid+1;
+    else if (cache->tokens[mid].from > from) hi = mid-1;
+    else return mid;
+  }
+  return -1;
+}
+
+/// Set the lexer's state up from a cached token
+static void jslTokenCacheReplay(JslTokenCache *cache, int idx) {
+  JslCachedToken *t = &cache->tokens[idx];
+  cache->lastIdx = (unsigned int)idx;
+  if (lex->tokenValue) {
+    jsvUnLock(lex->tokenValue);
+    lex->tokenValue = 0;
+  }
+  lex->tokenLastStart = jsvStringIteratorGetIndex(&lex->tokenStart.it) - 1;
+  lex->tk = t->tk;
+  lex->tokenStart.it = t->tokenStart;
+  lex->tokenStart.currCh = t->tokenStartCh;
+  lex->it = t->it;
+  lex->currCh = t->currCh;
+  lex->tokenl = t->tokenl;
+  memcpy(lex->token, &cache->text[t->textIdx], t->tokenl);
+}
+
+/// Remember the token we just lexed from position 'from', if there's space
+static void jslTokenCacheAdd(JslTokenCache *cache, size_t from) {
+  // Strings/regexes are handed to the parser as JsVars that may get modified, so we can't reuse them
+  if (lex->tk==LEX_EOF ||
+      (lex->tk>=LEX_STR && lex->tk<=LEX_UNFINISHED_COMMENT) ||
+      cache->count>=JSL_TOKEN_CACHE_SIZE ||
+      cache->textLen+lex->tokenl > JSL_TOKEN_CACHE_TEXT_SIZE)
+    return;
+  // Keep tokens sorted by position so we can binary search
+  unsigned int idx = cache->count;
+  while (idx>0 && cache->tokens[idx-1].from > from) idx--;
+  memmove(&cache->tokens[idx+1], &cache->tokens[idx], (cache->count-idx)*sizeof(JslCachedToken));
+  cache->count++;
+  if (idx<=cache->lastIdx) cache->lastIdx++;
+  JslCachedToken *t = &cache->tokens[idx];
+  t->from = from;
+  t->tk = lex->tk;
+  t->tokenStart = lex->tokenStart.it;
+  t->tokenStartCh = lex->tokenStart.currCh;
+  t->it = lex->it;
+  t->currCh = lex->currCh;
+  t->tokenl = lex->tokenl;
+  t->textIdx = cache->textLen;
+  memcpy(&cache->text[cache->textLen], lex->token, lex->tokenl);
+  cache->textLen = (uint16_t)(cache->textLen + lex->tokenl);
+}
+
+bool jslTokenCacheStart() {
+  if (lex->tokenCache || jslTokenCachesUsed>=JSL_TOKEN_CACHES) return false;
+  JslTokenCache *cache = &jslTokenCaches[jslTokenCachesUsed++];
+  cache->count = 0;
+  cache->lastIdx = 0;
+  cache->textLen = 0;
+  lex->tokenCache = cache;
+  return true;
+}
+
+void jslTokenCacheEnd() {
+  assert(lex->tokenCache == &jslTokenCaches[jslTokenCachesUsed-1]);
+  lex->tokenCache = 0;
+  jslTokenCachesUsed--;
+}
+#endif
+
+void jslGetNextToken() {
+#ifdef JSL_TOKEN_CACHE_SIZE
+  JslTokenCache *cache = lex->tokenCache;
+  if (cache) {
+    size_t from = jsvStringIteratorGetIndex(&lex->it);
+    int idx = jslTokenCacheFind(cache, from);
+    if (idx>=0) {
+      jslTokenCacheReplay(cache, idx);
+    } else {
+      jslLexToken();
+      jslTokenCacheAdd(cache, from);
+    }
+    return;
+  }
+#endif
+  jslLexToken();
+}
+
 static ALWAYS_INLINE void jslPreload() {
   // set up..
   jslGetNextCh();
@@ -656,6 +761,14 @@ void jslInit(JsVar *var) {
   lex->tokenl = 0;
   lex->tokenValue = 0;
   lex->lineNumberOffset = 0;
+#ifdef JSL_TOKEN_CACHE_SIZE
+  lex->tokenCache = 0;
+#endif
+#ifndef SAVE_ON_FLASH
+  lex->blockIndex = 0;
+  lex->prevActive = jslActive;
+  jslActive = lex;
+#endif
   // set up iterator
   jsvStringIteratorNew(&lex->it, lex->sourceVar, 0);
   jsvUnLock(lex->it.var); // see jslGetNextCh
@@ -673,7 +786,21 @@ void jslKill() {
   jsvUnLock(lex->sourceVar);
   lex->tokenStart.it.var = 0;
   lex->tokenStart.currCh = 0;
+#ifndef SAVE_ON_FLASH
+  assert(jslActive == lex);
+  jslActive = lex->prevActive;
+#endif
+}
+
+#ifndef SAVE_ON_FLASH
+void jslForEachActiveSource(void (*callback)(JsVar *sourceVar)) {
+  JsLex *l = jslActive;
+  while (l) {
+    callback(l->sourceVar);
+    l = l->prevActive;
+  }
 }
+#endif
 
 void jslSeekTo(size_t seekToChar) {
   if (lex->it.var) jsvLockAgain(lex->it.var); // see jslGetNextCh
@@ -740,7 +867,7 @@ void jslTokenAsString(int token, char *str, size_t len) {
   case LEX_UNFINISHED_REGEX : strcpy(str, "UNFINISHED REGEX"); return;
   case LEX_UNFINISHED_COMMENT : strcpy(str, "UNFINISHED COMMENT"); return;
   }
-  if (token>=_LEX_OPERATOR_START && token<_LEX_R_LIST_END) {
+  if (token>=_LEX_OPERATOR_START && token<=_LEX_R_LIST_END) {
     const char tokenNames[] =
         /* LEX_EQUAL      :   */ "==\0"
         /* LEX_TYPEEQUAL  :   */ "===\0"
@@ -774,7 +901,7 @@ void jslTokenAsString(int token, char *str, size_t len) {
         /*LEX_R_DO :       */ "do\0"
         /*LEX_R_WHILE :    */ "while\0"
         /*LEX_R_FOR :      */ "for\0"
-        /*LEX_R_BREAK :    */ "return\0"
+        /*LEX_R_BREAK :    */ "break\0"
         /*LEX_R_CONTINUE   */ "continue\0"
         /*LEX_R_FUNCTION   */ "function\0"
         /*LEX_R_RETURN     */ "return\0"
@@ -804,6 +931,7 @@ void jslTokenAsString(int token, char *str, size_t len) {
         /*LEX_R_EXTENDS :  */ "extends\0"
         /*LEX_R_SUPER :  */   "super\0"
         /*LEX_R_STATIC :   */ "static\0"
+        /*LEX_R_OF :       */ "of\0"
         ;
     unsigned int p = 0;
     int n = token-_LEX_OPERATOR_START;
@@ -831,6 +959,11 @@ void jslGetTokenString(char *str, size_t len) {
 
 char *jslGetTokenValueAsString() {
   assert(lex->tokenl < JSLEX_MAX_TOKEN_LENGTH);
+  if (!lex->tokenl && lex->tk>=_LEX_R_LIST_START && lex->tk<=_LEX_R_LIST_END) {
+    // a reserved word from pretokenised code (eg. `a.catch`) has no text, so make some
+    jslTokenAsString(lex->tk, lex->token, JSLEX_MAX_TOKEN_LENGTH);
+    lex->tokenl = (unsigned char)strlen(lex->token);
+  }
   lex->token[lex->tokenl]  = 0; // add final null
   return lex->token;
 }
@@ -843,9 +976,7 @@ JsVar *jslGetTokenValueAsVar() {
   if (lex->tokenValue) {
     return jsvLockAgain(lex->tokenValue);
   } else {
-    assert(lex->tokenl < JSLEX_MAX_TOKEN_LENGTH);
-    lex->token[lex->tokenl]  = 0; // add final null
-    return jsvNewFromString(lex->token);
+    return jsvNewFromString(jslGetTokenValueAsString());
   }
 }
 
@@ -879,29 +1010,31 @@ bool jslMatch(int expected_tk) {
   return true;
 }
 
-JsVar *jslNewTokenisedStringFromLexer(JslCharPos *charFrom, size_t charTo) {
-  // New method - tokenise functions
-  // save old lex
-  JsLex *oldLex = lex;
-  JsLex newLex;
-  lex = &newLex;
+/// Is this a token whose text gets copied verbatim into tokenised code?
+static bool jslIsTokenCopiedVerbatim(int tk) {
+  return tk==LEX_ID ||
+         tk==LEX_INT ||
+         tk==LEX_FLOAT ||
+         tk==LEX_STR ||
+         tk==LEX_TEMPLATE_LITERAL ||
+         tk==LEX_REGEX;
+}
+
+/** Tokenise the current lexer's source between charFrom and charTo. Returns 0 and
+ * sets isValid=false if an ID/number follows an ID/number (they'd run together) */
+static JsVar *jslNewTokenisedStringFromCurrentLexer(JslCharPos *charFrom, size_t charTo, bool *isValid) {
   // work out length
   size_t length = 0;
-  jslInit(oldLex->sourceVar);
+  *isValid = true;
   jslSeekToP(charFrom);
   int lastTk = LEX_EOF;
   while (lex->tk!=LEX_EOF && jsvStringIteratorGetIndex(&lex->it)<=charTo+1) {
     if ((lex->tk==LEX_ID || lex->tk==LEX_FLOAT || lex->tk==LEX_INT) &&
         ( lastTk==LEX_ID ||  lastTk==LEX_FLOAT ||  lastTk==LEX_INT)) {
-      jsExceptionHere(JSET_SYNTAXERROR, "ID/number following ID/number isn't valid JS");
-      length = 0;
-      break;
+      *isValid = false;
+      return 0;
     }
-    if (lex->tk==LEX_ID ||
-        lex->tk==LEX_INT ||
-        lex->tk==LEX_FLOAT ||
-        lex->tk==LEX_STR ||
-        lex->tk==LEX_TEMPLATE_LITERAL) {
+    if (jslIsTokenCopiedVerbatim(lex->tk)) {
       length += jsvStringIteratorGetIndex(&lex->it)-jsvStringIteratorGetIndex(&lex->tokenStart.it);
     } else {
       length++;
@@ -918,11 +1051,7 @@ JsVar *jslNewTokenisedStringFromLexer(JslCharPos *charFrom, size_t charTo) {
     // now start appending
     jslSeekToP(charFrom);
     while (lex->tk!=LEX_EOF && jsvStringIteratorGetIndex(&lex->it)<=charTo+1) {
-      if (lex->tk==LEX_ID ||
-          lex->tk==LEX_INT ||
-          lex->tk==LEX_FLOAT ||
-          lex->tk==LEX_STR ||
-          lex->tk==LEX_TEMPLATE_LITERAL) {
+      if (jslIsTokenCopiedVerbatim(lex->tk)) {
         jsvStringIteratorSetCharAndNext(&dstit, lex->tokenStart.currCh);
         JsvStringIterator it = jsvStringIteratorClone(&lex->tokenStart.it);
         while (jsvStringIteratorGetIndex(&it)+1 < jsvStringIteratorGetIndex(&lex->it)) {
@@ -933,11 +1062,26 @@ JsVar *jslNewTokenisedStringFromLexer(JslCharPos *charFrom, size_t charTo) {
       } else {
         jsvStringIteratorSetCharAndNext(&dstit, (char)lex->tk);
       }
-      lastTk = lex->tk;
       jslGetNextToken();
     }
     jsvStringIteratorFree(&dstit);
   }
+  return var;
+}
+
+JsVar *jslNewTokenisedStringFromLexer(JslCharPos *charFrom, size_t charTo) {
+  // New method - tokenise functions
+  // save old lex
+  JsLex *oldLex = lex;
+  JsLex newLex;
+  lex = &newLex;
+  jslInit(oldLex->sourceVar);
+  bool isValid;
+  JsVar *var = jslNewTokenisedStringFromCurrentLexer(charFrom, charTo, &isValid);
+  if (!isValid) {
+    jsExceptionHere(JSET_SYNTAXERROR, "ID/number following ID/number isn't valid JS");
+    var = jsvNewFromEmptyString();
+  }
   // restore lex
   jslKill();
   lex = oldLex;
@@ -945,6 +1089,117 @@ JsVar *jslNewTokenisedStringFromLexer(JslCharPos *charFrom, size_t charTo) {
   return var;
 }
 
+JsVar *jslNewTokenisedStringFromString(JsVar *code) {
+  JsLex *oldLex = lex;
+  JsLex newLex;
+  lex = &newLex;
+  jslInit(code);
+  JslCharPos charFrom = jslCharPosClone(&lex->tokenStart);
+  bool isValid;
+  JsVar *var = jslNewTokenisedStringFromCurrentLexer(&charFrom, jsvGetStringLength(code), &isValid);
+  jslCharPosFree(&charFrom);
+  jslKill();
+  lex = oldLex;
+  return var;
+}
+
+#ifndef SAVE_ON_FLASH
+size_t jslGetSourcePosition(JsVar *code, JsVar *tokenisedCode, size_t tokenisedPos) {
+  JsLex *oldLex = lex;
+  JsLex newLex;
+  lex = &newLex;
+  // Count the tokens before tokenisedPos...
+  unsigned int tokens = 0;
+  jslInit(tokenisedCode);
+  while (lex->tk!=LEX_EOF && jsvStringIteratorGetIndex(&lex->tokenStart.it)<tokenisedPos) {
+    tokens++;
+    jslGetNextToken();
+  }
+  jslKill();
+  // ... and skip the same number of tokens in the original code
+  jslInit(code);
+  while (tokens-- && lex->tk!=LEX_EOF)
+    jslGetNextToken();
+  size_t pos = jsvStringIteratorGetIndex(&lex->tokenStart.it);
+  jslKill();
+  lex = oldLex;
+  return pos;
+}
+
+JsVar *jslNewBlockIndex(JsVar *code) {
+  // Count '{' to see how much space we need (some may be in strings, but that's ok)
+  unsigned int count = 0;
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, code, 0);
+  while (jsvStringIteratorHasChar(&it)) {
+    if (jsvStringIteratorGetChar(&it)=='{') count++;
+    jsvStringIteratorNext(&it);
+  }
+  jsvStringIteratorFree(&it);
+  if (!count) return 0;
+  JsVar *index = jsvNewFlatStringOfLength((unsigned int)(count*sizeof(JslBlockIndexEntry)));
+  if (!index) return 0;
+  JslBlockIndexEntry *blocks = (JslBlockIndexEntry*)jsvGetFlatStringPointer(index);
+  memset(blocks, 0xFF, count*sizeof(JslBlockIndexEntry)); // so unused entries are at the end
+
+  int stack[JSL_BLOCK_INDEX_MAX_DEPTH];
+  int depth = 0;
+  unsigned int blockCount = 0;
+  bool ok = true;
+  JsLex *oldLex = lex;
+  JsLex newLex;
+  lex = &newLex;
+  jslInit(code);
+  while (ok && lex->tk!=LEX_EOF) {
+    uint32_t pos = (uint32_t)jsvStringIteratorGetIndex(&lex->tokenStart.it);
+    if (lex->tk=='{') {
+      if (depth>=JSL_BLOCK_INDEX_MAX_DEPTH || blockCount>=count) {
+        ok = false;
+      } else {
+        blocks[blockCount].open = pos;
+        blocks[blockCount].parent = depth ? stack[depth-1] : -1;
+        stack[depth++] = (int)blockCount++;
+      }
+    } else if (lex->tk=='}') {
+      if (depth) blocks[stack[--depth]].close = pos;
+      else ok = false;
+    } else if (lex->tk==LEX_UNFINISHED_STR || lex->tk==LEX_UNFINISHED_TEMPLATE_LITERAL ||
+               lex->tk==LEX_UNFINISHED_REGEX || lex->tk==LEX_UNFINISHED_COMMENT)
+      ok = false;
+    jslGetNextToken();
+  }
+  jslKill();
+  lex = oldLex;
+  if (!ok || depth || !blockCount) {
+    jsvUnLock(index);
+    return 0;
+  }
+  return index;
+}
+
+bool jslSkipBlock() {
+  if (!lex->blockIndex) return false;
+  size_t pos = jsvStringIteratorGetIndex(&lex->tokenStart.it);
+  JslBlockIndexEntry *blocks = (JslBlockIndexEntry*)jsvGetFlatStringPointer(lex->blockIndex);
+  int count = (int)(jsvGetStringLength(lex->blockIndex) / sizeof(JslBlockIndexEntry));
+  // find the last block that starts before the current token
+  int lo = 0, hi = count-1;
+  while (lo<=hi) {
+    int mid = (lo+hi) >> 1;
+    if (blocks[mid].open < pos) lo = mid+1;
+    else hi = mid-1;
+  }
+  // if that block ended before the current token, we're in one of the blocks containing it
+  int i = hi;
+  while (i>=0 && blocks[i].close < pos)
+    i = blocks[i].parent;
+  if (i<0) return false;
+  if (blocks[i].close != pos)
+    jslSeekTo(blocks[i].close-1);
+  return lex->tk=='}';
+}
+#endif
+
 JsVar *jslNewStringFromLexer(JslCharPos *charFrom, size_t charTo) {
   // Original method - just copy it verbatim
   size_t maxLength = charTo + 1 - jsvStringIteratorGetIndex(&charFrom->it);
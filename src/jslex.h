@@ -111,6 +111,45 @@ typedef struct JslCharPos {
 void jslCharPosFree(JslCharPos *pos);
 JslCharPos jslCharPosClone(JslCharPos *pos);
 
+#if defined(LINUX) && !defined(SAVE_ON_FLASH)
+/* When loops iterate, tokens in their body are remembered so they don't have to be
+ * lexed again each time around. This uses a fair bit of static RAM, so is Linux only */
+#define JSL_TOKEN_CACHES 8 ///< How many nested function calls can have a loop with a token cache
+#define JSL_TOKEN_CACHE_SIZE 128 ///< How many tokens each cache can hold
+#define JSL_TOKEN_CACHE_TEXT_SIZE 1024 ///< How many bytes of token text each cache can hold
+
+/// A token that was lexed from a certain position, along with the lexer's state afterwards
+typedef struct JslCachedToken {
+  size_t from; ///< Position in the data that the lexer was at before the token
+  JsvStringIterator tokenStart; ///< see JsLex.tokenStart
+  JsvStringIterator it; ///< see JsLex.it
+  short tk;
+  char tokenStartCh; ///< see JsLex.tokenStart.currCh
+  char currCh;
+  unsigned char tokenl;
+  uint16_t textIdx; ///< Index of the token's text in JslTokenCache.text
+} JslCachedToken;
+
+typedef struct JslTokenCache {
+  JslCachedToken tokens[JSL_TOKEN_CACHE_SIZE]; ///< Tokens, sorted by 'from'
+  char text[JSL_TOKEN_CACHE_TEXT_SIZE]; ///< Text of each token (JsLex.token)
+  unsigned int count; ///< Number of tokens
+  unsigned int lastIdx; ///< Index of the last token we replayed
+  uint16_t textLen; ///< Amount of text used
+} JslTokenCache;
+#endif
+
+#ifndef SAVE_ON_FLASH
+#define JSL_BLOCK_INDEX_MAX_DEPTH 32 ///< Blocks nested deeper than this mean we won't make a block index
+
+/// The positions of a block's brackets in some code - see jslNewBlockIndex
+typedef struct JslBlockIndexEntry {
+  uint32_t open; ///< Position of the '{' token (or 0xFFFFFFFF if unused)
+  uint32_t close; ///< Position of the matching '}' token
+  int32_t parent; ///< Index of the block that contains this one, or -1
+} JslBlockIndexEntry;
+#endif
+
 typedef struct JsLex
 {
   // Actual Lexing related stuff
@@ -135,6 +174,13 @@ typedef struct JsLex
    */
   JsVar *sourceVar; // the actual string var
   JsvStringIterator it; // Iterator for the string
+#ifdef JSL_TOKEN_CACHE_SIZE
+  JslTokenCache *tokenCache; ///< If set, tokens we lex are remembered/replayed from here (see jslTokenCacheStart)
+#endif
+#ifndef SAVE_ON_FLASH
+  JsVar *blockIndex; ///< If set, a block index for sourceVar (see jslNewBlockIndex). Not locked by the lexer
+  struct JsLex *prevActive; ///< The lexer that was running when this one was initialised (see jslForEachActiveSource)
+#endif
 } JsLex;
 
 // The lexer
@@ -144,12 +190,25 @@ JsLex *jslSetLex(JsLex *l);
 
 void jslInit(JsVar *var);
 void jslKill();
+#ifndef SAVE_ON_FLASH
+/// Call 'callback' with the code of every lexer that has been initialised and not killed yet (see jsvDefragment)
+void jslForEachActiveSource(void (*callback)(JsVar *sourceVar));
+#endif
 void jslReset();
 void jslSeekTo(size_t seekToChar);
 void jslSeekToP(JslCharPos *seekToChar);
 
 bool jslMatch(int expected_tk); ///< Match, and return true on success, false on failure
 
+#ifdef JSL_TOKEN_CACHE_SIZE
+/** Start remembering the tokens we lex (eg. for a loop's body) so that after a jslSeekToP
+ * they can be replayed rather than lexed again. Returns false if a cache is already in use
+ * for this lexer (or none are free) - otherwise jslTokenCacheEnd must be called after */
+bool jslTokenCacheStart();
+/// Stop remembering tokens - see jslTokenCacheStart
+void jslTokenCacheEnd();
+#endif
+
 /** When printing out a function, with pretokenise a
  * character could end up being a special token. This
  * handles that case. */
@@ -170,6 +229,24 @@ JsVar *jslNewStringFromLexer(JslCharPos *charFrom, size_t charTo);
 /// Create a new STRING from part of the lexer - keywords get tokenised
 JsVar *jslNewTokenisedStringFromLexer(JslCharPos *charFrom, size_t charTo);
 
+/// Create a tokenised copy of a whole code STRING, or return 0 if it can't be tokenised without changing its meaning
+JsVar *jslNewTokenisedStringFromString(JsVar *code);
+
+#ifndef SAVE_ON_FLASH
+/** Given the position of a token (as in lex->tokenStart) in code made by jslNewTokenisedStringFromString,
+ * return the position of the same token in the original code */
+size_t jslGetSourcePosition(JsVar *code, JsVar *tokenisedCode, size_t tokenisedPos);
+
+/** Create a flat string of JslBlockIndexEntry, sorted by position, for every `{ ... }`
+ * block in the code. This lets jslSkipBlock skip to the end of a block without lexing
+ * it. Returns 0 if the brackets don't match up, or if there's not enough memory */
+JsVar *jslNewBlockIndex(JsVar *code);
+
+/** If the lexer has a block index, jump to the '}' token that ends the block
+ * we're currently in and return true. Otherwise return false */
+bool jslSkipBlock();
+#endif
+
 /// Return the line number at the current character position (this isn't fast as it searches the string)
 unsigned int jslGetLineNumber();
 
@@ -26,6 +26,27 @@
 /* Info about execution when Parsing - this saves passing it on the stack
  * for each call */
 JsExecInfo execInfo;
+#ifndef SAVE_ON_FLASH
+unsigned int jspScopeGeneration = 0;
+unsigned int jspObjectGeneration = 0;
+
+/** A call in tail position ('return f(...)') of the function that's currently
+ * finishing. Rather than making the call from inside that function (using more
+ * stack), jspeFunctionCall makes it once that function has returned. */
+typedef struct {
+  JsVar *function; ///< The function to call (or 0 if no call is waiting)
+  JsVar *functionName; ///< The name it was called with (or 0)
+  JsVar *thisArg;
+  int argCount;
+  JsVar *args[JSP_TAIL_CALL_MAX_ARGS];
+  unsigned int callDepth; ///< jspCallDepth of the function that made the call - only its caller can make it
+} JspTailCall;
+static JspTailCall jspTailCall;
+/// How many calls to jspeFunctionCallInternal we're inside
+static unsigned int jspCallDepth = 0;
+
+volatile bool jspProfileSampleDue = false;
+#endif
 
 // ----------------------------------------------- Forward decls
 JsVar *jspeAssignmentExpression();
@@ -130,17 +151,54 @@ JsVar *jspeiGetTopScope() {
 }
 JsVar *jspeiFindOnTop(const char *name, bool createIfNotFound) {
   JsVar *scope = jspeiGetTopScope();
-  JsVar *result = jsvFindChildFromString(scope, name, createIfNotFound);
+  JsVar *result = jsvFindChildFromString(scope, name, false);
+  if (!result && createIfNotFound) {
+#ifndef SAVE_ON_FLASH
+    jspScopeGeneration++; // the new variable could shadow one we've cached
+#endif
+    result = jsvFindChildFromString(scope, name, true);
+  }
   jsvUnLock(scope);
   return result;
 }
 JsVar *jspeiFindNameOnTop(JsVar *childName, bool createIfNotFound) {
   JsVar *scope = jspeiGetTopScope();
-  JsVar *result = jsvFindChildFromVar(scope, childName, createIfNotFound);
+  JsVar *result = jsvFindChildFromVar(scope, childName, false);
+  if (!result && createIfNotFound) {
+#ifndef SAVE_ON_FLASH
+    jspScopeGeneration++; // the new variable could shadow one we've cached
+#endif
+    result = jsvFindChildFromVar(scope, childName, true);
+  }
   jsvUnLock(scope);
   return result;
 }
 
+#ifndef SAVE_ON_FLASH
+/** Like jspeiFindInScopes, but for the identifier that the lexer is currently on.
+ * If we've already looked that token up during this function call, use the
+ * variable we found last time rather than searching all the scopes again. */
+static JsVar *jspeiFindTokenInScopes(const char *name) {
+  JspScopeCache *cache = execInfo.scopeCache;
+  if (!cache || cache->lex != lex)
+    return jspeiFindInScopes(name);
+  if (cache->generation != jspScopeGeneration) {
+    memset(cache->name, 0, sizeof(cache->name));
+    cache->generation = jspScopeGeneration;
+  }
+  size_t pos = jsvStringIteratorGetIndex(&lex->tokenStart.it);
+  unsigned int idx = (unsigned int)pos & (JSP_SCOPE_CACHE_SIZE-1);
+  if (cache->name[idx] && cache->tokenPos[idx]==pos)
+    return jsvLock(cache->name[idx]);
+  JsVar *a = jspeiFindInScopes(name);
+  if (a) {
+    cache->tokenPos[idx] = pos;
+    cache->name[idx] = jsvGetRef(a);
+  }
+  return a;
+}
+#endif
+
 JsVar *jspFindPrototypeFor(const char *className) {
   JsVar *obj = jsvObjectGetChild(execInfo.root, className, 0);
   if (!obj) return 0;
@@ -453,6 +511,17 @@ NO_INLINE bool jspeParseFunctionCallBrackets() {
   return 0;
 }
 
+#ifndef SAVE_ON_FLASH
+/* Called when we're about to parse a returned expression. If it's just a
+ * function call, it can be made as a tail call (see jspeFactorFunctionCall) */
+static ALWAYS_INLINE void jspMarkTailCallPosition() {
+  // Not for 'return' in eval'd code or at the top level, as nothing would make the call
+  if ((jsFlags&JSF_TAIL_CALLS) && JSP_SHOULD_EXECUTE && !execInfo.tryDepth &&
+      execInfo.scopeCache && execInfo.scopeCache->lex==lex)
+    execInfo.tailCallPos = jsvStringIteratorGetIndex(&lex->tokenStart.it);
+}
+#endif
+
 /** Handle a function call (assumes we've parsed the function name and we're
  * on the start bracket). 'thisArg' is the value of the 'this' variable when the
  * function is executed (it's usually the parent object)
@@ -464,7 +533,7 @@ NO_INLINE bool jspeParseFunctionCallBrackets() {
  *
  * functionName is used only for error reporting - and can be 0
  */
-NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *thisArg, bool isParsing, int argCount, JsVar **argPtr) {
+static JsVar *jspeFunctionCallInternal(JsVar *function, JsVar *functionName, JsVar *thisArg, bool isParsing, int argCount, JsVar **argPtr) {
   if (JSP_SHOULD_EXECUTE && !function) {
     if (functionName)
       jsExceptionHere(JSET_ERROR, "Function %q not found!", functionName);
@@ -612,6 +681,10 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
 
       JsVar *functionScope = 0;
       JsVar *functionCode = 0;
+#ifndef SAVE_ON_FLASH
+      JsVar *functionTokenisedCode = 0;
+      JsVar *functionBlockIndex = 0;
+#endif
       JsVar *functionInternalName = 0;
       uint16_t functionLineNumber = 0;
 
@@ -672,7 +745,13 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
       // Now go through what's left
       while (jsvObjectIteratorHasValue(&it)) {
         JsVar *param = jsvObjectIteratorGetKey(&it);
-        if (jsvIsString(param)) {
+        /* Check for parameters first - a parameter called 'tok' is stored as
+         * \xFFtok, which would otherwise look just like one of our hidden names */
+        if (jsvIsFunctionParameter(param)) {
+          JsVar *defaultVal = jsvSkipName(param);
+          jsvAddFunctionParameter(functionRoot, jsvNewFromStringVar(param,1,JSVAPPENDSTRINGVAR_MAXLENGTH), defaultVal);
+          jsvUnLock(defaultVal);
+        } else if (jsvIsString(param)) {
           if (jsvIsStringEqual(param, JSPARSE_FUNCTION_SCOPE_NAME)) functionScope = jsvSkipName(param);
           else if (jsvIsStringEqual(param, JSPARSE_FUNCTION_CODE_NAME)) functionCode = jsvSkipName(param);
           else if (jsvIsStringEqual(param, JSPARSE_FUNCTION_NAME_NAME)) functionInternalName = jsvSkipName(param);
@@ -680,17 +759,41 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
             jsvUnLock(thisVar);
             thisVar = jsvSkipName(param);
           } else if (jsvIsStringEqual(param, JSPARSE_FUNCTION_LINENUMBER_NAME)) functionLineNumber = (uint16_t)jsvGetIntegerAndUnLock(jsvSkipName(param));
-          else if (jsvIsFunctionParameter(param)) {
-            JsVar *defaultVal = jsvSkipName(param);
-            jsvAddFunctionParameter(functionRoot, jsvNewFromStringVar(param,1,JSVAPPENDSTRINGVAR_MAXLENGTH), defaultVal);
-            jsvUnLock(defaultVal);
-          }
+#ifndef SAVE_ON_FLASH
+          else if (jsvIsStringEqual(param, JSPARSE_FUNCTION_TOKENISED_NAME)) functionTokenisedCode = jsvSkipName(param);
+          else if (jsvIsStringEqual(param, JSPARSE_FUNCTION_BLOCKS_NAME)) functionBlockIndex = jsvSkipName(param);
+#endif
         }
         jsvUnLock(param);
         jsvObjectIteratorNext(&it);
       }
       jsvObjectIteratorFree(&it);
 
+#ifndef SAVE_ON_FLASH
+      /* If asked to, tokenise the function's code the first time it's called
+       * and keep that alongside it. Functions with line numbers are left alone
+       * so that error messages and the debugger can still refer to their source. */
+      if (!functionTokenisedCode && jsfGetFlag(JSF_TOKENISE_ON_CALL) &&
+          jsvIsString(functionCode) && !jsvIsNativeString(functionCode) && !functionLineNumber) {
+        functionTokenisedCode = jslNewTokenisedStringFromString(functionCode);
+        /* If it couldn't be tokenised or was no shorter (eg. it was already
+         * pretokenised) just reference the original code so we don't try again */
+        if (!functionTokenisedCode || jsvGetStringLength(functionTokenisedCode)>=jsvGetStringLength(functionCode)) {
+          jsvUnLock(functionTokenisedCode);
+          functionTokenisedCode = jsvLockAgain(functionCode);
+        }
+        jsvUnLock(jsvAddNamedChild(function, functionTokenisedCode, JSPARSE_FUNCTION_TOKENISED_NAME));
+        // Index where blocks start and end, so we can skip over them quickly when not executing
+        functionBlockIndex = jslNewBlockIndex(functionTokenisedCode);
+        if (functionBlockIndex)
+          jsvUnLock(jsvAddNamedChild(function, functionBlockIndex, JSPARSE_FUNCTION_BLOCKS_NAME));
+      }
+      if (functionTokenisedCode) {
+        jsvUnLock(functionCode);
+        functionCode = functionTokenisedCode;
+      }
+#endif
+
       // setup a the function's name (if a named function)
       if (functionInternalName) {
         JsVar *name = jsvMakeIntoVariableName(jsvNewFromStringVar(functionInternalName,0,JSVAPPENDSTRINGVAR_MAXLENGTH), function);
@@ -744,6 +847,23 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
             JsLex *oldLex = jslSetLex(&newLex);
             jslInit(functionCode);
             newLex.lineNumberOffset = functionLineNumber;
+#ifndef SAVE_ON_FLASH
+            newLex.blockIndex = functionBlockIndex;
+            JspScopeCache scopeCache;
+            JspScopeCache *oldScopeCache = execInfo.scopeCache;
+            scopeCache.lex = &newLex;
+            scopeCache.generation = jspScopeGeneration;
+            memset(scopeCache.name, 0, sizeof(scopeCache.name));
+            execInfo.scopeCache = &scopeCache;
+            unsigned char oldTryDepth = execInfo.tryDepth;
+            execInfo.tryDepth = 0;
+            JspCallFrame callFrame;
+            callFrame.function = function;
+            callFrame.functionName = functionName;
+            callFrame.lex = &newLex;
+            callFrame.caller = execInfo.callFrame;
+            execInfo.callFrame = &callFrame;
+#endif
             JSP_SAVE_EXECUTE();
             // force execute without any previous state
 #ifdef USE_DEBUGGER
@@ -760,8 +880,12 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
                 }
               #endif
               // implicit return - we just need an expression (optional)
-              if (lex->tk != ';' && lex->tk != '}')
+              if (lex->tk != ';' && lex->tk != '}') {
+#ifndef SAVE_ON_FLASH
+                jspMarkTailCallPosition();
+#endif
                 returnVar = jsvSkipNameAndUnLock(jspeExpression());
+              }
             } else {
               // setup a return variable
               JsVar *returnVarName = jsvAddNamedChild(functionRoot, 0, JSPARSE_RETURN_VAR);
@@ -793,6 +917,11 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
               execInfo.execute |= EXEC_DEBUGGER_NEXT_LINE;
 #endif
 
+#ifndef SAVE_ON_FLASH
+            execInfo.scopeCache = oldScopeCache;
+            execInfo.tryDepth = oldTryDepth;
+            execInfo.callFrame = callFrame.caller;
+#endif
             jslKill();
             jslSetLex(oldLex);
 
@@ -822,7 +951,7 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
         jsvUnLock(execInfo.scopesVar);
         execInfo.scopesVar = oldScopeVar;
       }
-      jsvUnLock(functionCode);
+      jsvUnLock2(functionCode, functionBlockIndex);
       jsvUnLock(functionRoot);
     }
 
@@ -836,32 +965,92 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
   } else return 0;
 }
 
+#ifndef SAVE_ON_FLASH
+/// Make any tail calls left by the function we just called - the last one's result replaces returnVar
+static NO_INLINE JsVar *jspeTailCalls(JsVar *returnVar, JsVar *function, JsVar *functionName) {
+  /* The function that made each tail call has returned, but leave a frame for
+   * it while the call is made so the profiler can still see where it came from */
+  JspCallFrame callerFrame;
+  callerFrame.function = function;
+  callerFrame.functionName = functionName;
+  callerFrame.lex = 0;
+  callerFrame.caller = execInfo.callFrame;
+  bool callerLocked = false; // did we lock callerFrame's variables?
+  while (jspTailCall.function && jspTailCall.callDepth==jspCallDepth+1) {
+    // take a copy, so the function we call can leave a tail call of its own
+    JspTailCall call = jspTailCall;
+    jspTailCall.function = 0;
+    jsvUnLock(returnVar);
+    if (JSP_SHOULD_EXECUTE) {
+      execInfo.callFrame = &callerFrame;
+      jspCallDepth++;
+      returnVar = jspeFunctionCallInternal(call.function, call.functionName, call.thisArg, false, call.argCount, call.args);
+      jspCallDepth--;
+      execInfo.callFrame = callerFrame.caller;
+    } else // we were interrupted - don't make the call
+      returnVar = 0;
+    jsvUnLockMany((unsigned)call.argCount, call.args);
+    jsvUnLock(call.thisArg);
+    if (callerLocked)
+      jsvUnLock2(callerFrame.function, callerFrame.functionName);
+    // this call is the caller of any tail call it made
+    callerFrame.function = call.function;
+    callerFrame.functionName = call.functionName;
+    callerLocked = true;
+  }
+  if (callerLocked)
+    jsvUnLock2(callerFrame.function, callerFrame.functionName);
+  return returnVar;
+}
+#endif
+
+NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *thisArg, bool isParsing, int argCount, JsVar **argPtr) {
+#ifndef SAVE_ON_FLASH
+  jspCallDepth++;
+#endif
+  JsVar *returnVar = jspeFunctionCallInternal(function, functionName, thisArg, isParsing, argCount, argPtr);
+#ifndef SAVE_ON_FLASH
+  jspCallDepth--;
+  /* Only make a tail call if it was left by the function we just called. Calls
+   * after its 'return' are parsed but not executed, and mustn't make it. */
+  if (jspTailCall.function && jspTailCall.callDepth==jspCallDepth+1)
+    returnVar = jspeTailCalls(returnVar, function, functionName);
+#endif
+  return returnVar;
+}
+
+/// Find a built-in function for a variable that wasn't in any scope (or create a new unattached variable name)
+static JsVar *jspGetNamedBuiltIn(const char *tokenName) {
+  JsVar *a = 0;
+  /* Special case! We haven't found the variable, so check out
+   * and see if it's one of our builtins...  */
+  if (jswIsBuiltInObject(tokenName)) {
+    // Check if we have a built-in function for it
+    // OPT: Could we instead have jswIsBuiltInObjectWithoutConstructor?
+    JsVar *obj = jswFindBuiltInFunction(0, tokenName);
+    // If not, make one
+    if (!obj)
+      obj = jspNewBuiltin(tokenName);
+    if (obj) { // not out of memory
+      a = jsvAddNamedChild(execInfo.root, obj, tokenName);
+      jsvUnLock(obj);
+    }
+  } else {
+    a = jswFindBuiltInFunction(0, tokenName);
+    if (!a) {
+      /* Variable doesn't exist! JavaScript says we should create it
+       * (we won't add it here. This is done in the assignment operator)*/
+      a = jsvMakeIntoVariableName(jsvNewFromString(tokenName), 0);
+    }
+  }
+  return a;
+}
+
 // Find a variable (or built-in function) based on the current scopes
 JsVar *jspGetNamedVariable(const char *tokenName) {
   JsVar *a = JSP_SHOULD_EXECUTE ? jspeiFindInScopes(tokenName) : 0;
-  if (JSP_SHOULD_EXECUTE && !a) {
-    /* Special case! We haven't found the variable, so check out
-     * and see if it's one of our builtins...  */
-    if (jswIsBuiltInObject(tokenName)) {
-      // Check if we have a built-in function for it
-      // OPT: Could we instead have jswIsBuiltInObjectWithoutConstructor?
-      JsVar *obj = jswFindBuiltInFunction(0, tokenName);
-      // If not, make one
-      if (!obj)
-        obj = jspNewBuiltin(tokenName);
-      if (obj) { // not out of memory
-        a = jsvAddNamedChild(execInfo.root, obj, tokenName);
-        jsvUnLock(obj);
-      }
-    } else {
-      a = jswFindBuiltInFunction(0, tokenName);
-      if (!a) {
-        /* Variable doesn't exist! JavaScript says we should create it
-         * (we won't add it here. This is done in the assignment operator)*/
-        a = jsvMakeIntoVariableName(jsvNewFromString(tokenName), 0);
-      }
-    }
-  }
+  if (JSP_SHOULD_EXECUTE && !a)
+    a = jspGetNamedBuiltIn(tokenName);
   return a;
 }
 
@@ -990,6 +1179,128 @@ JsVar *jspGetVarNamedField(JsVar *object, JsVar *nameVar, bool returnName) {
   else return jsvSkipNameAndUnLock(child);
 }
 
+#ifdef JSP_INLINE_CACHE_SIZE
+/// Where a member access found its field last time
+typedef struct {
+  JsVarRef source; ///< The code (lex->sourceVar) containing the member access
+  size_t tokenPos; ///< Position of the field name's token in the code
+  JsVarRef object; ///< The object the field was looked up in (or 0 if unused, or the object has been freed)
+  JsVarRef protoName; ///< If the field was in the object's prototype, the object's __proto__ name (or 0)
+  JsVarRef holder; ///< The object the field was actually found in (object or its prototype)
+  JsVarRef child; ///< The name of the field
+  unsigned int childIdx; ///< The index of the field in holder's list of children
+} JspInlineCacheEntry;
+
+static JspInlineCacheEntry jspInlineCache[JSP_INLINE_CACHE_SIZE];
+static unsigned int jspInlineCacheGeneration; ///< The value of jspObjectGeneration when jspInlineCache was last cleared
+uint64_t jspInlineCacheObjects;
+unsigned int jspInlineCacheHits, jspInlineCacheMisses;
+
+void jspInlineCacheForget(JsVarRef ref) {
+  uint64_t objects = 0;
+  for (int i=0;i<JSP_INLINE_CACHE_SIZE;i++) {
+    JspInlineCacheEntry *e = &jspInlineCache[i];
+    if (e->object==ref || e->holder==ref) {
+      // keep childIdx, as the next object we see here may well have the same fields
+      e->object = 0;
+      e->holder = 0;
+    }
+    if (e->object)
+      objects |= JSP_INLINE_CACHE_OBJECT_BIT(e->object) | JSP_INLINE_CACHE_OBJECT_BIT(e->holder);
+  }
+  jspInlineCacheObjects = objects;
+}
+
+/// Remember that the member access at the current token found 'childRef' in 'holder'
+static void jspInlineCacheSet(JspInlineCacheEntry *e, JsVarRef sourceRef, size_t pos, JsVarRef objectRef, JsVarRef protoName, JsVarRef holder, JsVarRef childRef, unsigned int childIdx) {
+  e->source = sourceRef;
+  e->tokenPos = pos;
+  e->object = objectRef;
+  e->protoName = protoName;
+  e->holder = holder;
+  e->child = childRef;
+  e->childIdx = childIdx;
+  jspInlineCacheObjects |= JSP_INLINE_CACHE_OBJECT_BIT(objectRef) | JSP_INLINE_CACHE_OBJECT_BIT(holder);
+}
+
+/** Like jspGetNamedField(object, name, true), but for the field name token the lexer is
+ * currently on. If the same bit of code found this field on this object last time, we
+ * can use what we found then rather than searching the object (and its prototype).
+ * If it was a different object with the field in the same place (eg. both were made
+ * by the same constructor) we can go straight to that field too. */
+static JsVar *jspGetNamedFieldCached(JsVar *object, const char *name) {
+  // Arrays can have children removed without jsvRemoveChild, so we don't cache them
+  if (!jsvIsObject(object) && !jsvIsFunction(object)) {
+    jspInlineCacheMisses++;
+    return jspGetNamedField(object, name, true);
+  }
+  if (jspInlineCacheGeneration != jspObjectGeneration) {
+    memset(jspInlineCache, 0, sizeof(jspInlineCache));
+    jspInlineCacheObjects = 0;
+    jspInlineCacheGeneration = jspObjectGeneration;
+  }
+  JsVarRef objectRef = jsvGetRef(object);
+  JsVarRef sourceRef = jsvGetRef(lex->sourceVar);
+  size_t pos = jsvStringIteratorGetIndex(&lex->tokenStart.it);
+  JspInlineCacheEntry *e = &jspInlineCache[(pos ^ ((size_t)sourceRef<<3)) & (JSP_INLINE_CACHE_SIZE-1)];
+  JsVar *child = 0;
+  if (e->tokenPos==pos && e->source==sourceRef) {
+    if (e->object==objectRef) {
+      child = jsvLock(e->child);
+      // check the name - the code we cached this for could have been freed and replaced
+      if (!jsvIsStringEqual(child, name)) {
+        jsvUnLock(child);
+        child = 0;
+      } else if (!e->protoName) {
+        jspInlineCacheHits++;
+        return child;
+      } else if (jsvGetFirstChild(_jsvGetAddressOf(e->protoName)) != e->holder) {
+        // it was found in the prototype, but the object's prototype has changed since
+        jsvUnLock(child);
+        child = 0;
+      } else
+        jspInlineCacheHits++;
+    } else if (!e->protoName) {
+      // A different object - but if it's similar, the field may be in the same place
+      child = jsvGetChildAtIndexIfNamed(object, e->childIdx, name);
+      if (child) {
+        jspInlineCacheHits++;
+        jspInlineCacheSet(e, sourceRef, pos, objectRef, 0, objectRef, jsvGetRef(child), e->childIdx);
+        return child;
+      }
+    }
+  }
+
+  if (!child) {
+    jspInlineCacheMisses++;
+    unsigned int childIdx;
+    child = jsvFindChildFromStringWithIndex(object, name, &childIdx);
+    if (child) {
+      jspInlineCacheSet(e, sourceRef, pos, objectRef, 0, objectRef, jsvGetRef(child), childIdx);
+      return child;
+    }
+    // We only cache fields found directly in the object's __proto__
+    JsVar *protoName = jsvIsObject(object) ? jsvFindChildFromString(object, JSPARSE_INHERITS_VAR, false) : 0;
+    JsVar *proto = jsvSkipName(protoName);
+    if (jsvHasChildren(proto) && proto!=object) {
+      child = jsvFindChildFromStringWithIndex(proto, name, &childIdx);
+      if (child)
+        jspInlineCacheSet(e, sourceRef, pos, objectRef, jsvGetRef(protoName), jsvGetRef(proto), jsvGetRef(child), childIdx);
+    }
+    jsvUnLock2(protoName, proto);
+    if (!child) return jspGetNamedFieldInParents(object, name, true);
+  }
+  // as in jspGetNamedFieldInParents, create a new name that references the object
+  JsVar *value = jsvGetValueOfName(child);
+  jsvUnLock(child);
+  child = value;
+  JsVar *nameVar = jsvNewFromString(name);
+  JsVar *newChild = jsvCreateNewChild(object, nameVar, child);
+  jsvUnLock2(nameVar, child);
+  return newChild;
+}
+#endif
+
 /// Call the named function on the object - whether it's built in, or predefined. Returns the return value of the function.
 JsVar *jspCallNamedFunction(JsVar *object, char* name, int argCount, JsVar **argPtr) {
   JsVar *child = jspGetNamedField(object, name, false);
@@ -1014,8 +1325,13 @@ NO_INLINE JsVar *jspeFactorMember(JsVar *a, JsVar **parentResult) {
 
           JsVar *aVar = jsvSkipNameWithParent(a,true,parent);
           JsVar *child = 0;
+#ifdef JSP_INLINE_CACHE_SIZE
+          if (aVar)
+            child = jspGetNamedFieldCached(aVar, name);
+#else
           if (aVar)
             child = jspGetNamedField(aVar, name, true);
+#endif
           if (!child) {
             if (!jsvIsUndefined(aVar)) {
               // if no child found, create a pointer to where it could be
@@ -1112,7 +1428,56 @@ NO_INLINE JsVar *jspeConstruct(JsVar *func, JsVar *funcName, bool hasArgs) {
   return thisObj;
 }
 
+#ifndef SAVE_ON_FLASH
+/** Parse the arguments of a call to a non-native function that's in tail position.
+ * If the call turns out to be the whole of the returned expression, leave it in
+ * jspTailCall to be made once the current function has returned, otherwise just
+ * call the function as normal. */
+static NO_INLINE JsVar *jspeTailCall(JsVar *function, JsVar *functionName, JsVar *thisArg) {
+  JsVar *args[JSP_TAIL_CALL_MAX_ARGS];
+  JsVar **argPtr = args;
+  unsigned int argPtrSize = JSP_TAIL_CALL_MAX_ARGS;
+  int argCount = 0;
+  JSP_MATCH('(');
+  while (!JSP_SHOULDNT_PARSE && lex->tk!=')' && lex->tk!=LEX_EOF) {
+    if ((unsigned)argCount>=argPtrSize) {
+      // allocate more space on stack - this won't be a tail call now
+      unsigned int newArgPtrSize = argPtrSize*4;
+      JsVar **newArgPtr = (JsVar**)alloca(sizeof(JsVar*)*newArgPtrSize);
+      memcpy(newArgPtr, argPtr, (unsigned)argCount*sizeof(JsVar*));
+      argPtr = newArgPtr;
+      argPtrSize = newArgPtrSize;
+    }
+    argPtr[argCount++] = jsvSkipNameAndUnLock(jspeAssignmentExpression());
+    if (lex->tk!=')') JSP_MATCH_WITH_CLEANUP_AND_RETURN(',',jsvUnLockMany((unsigned)argCount, argPtr);, 0);
+  }
+  JSP_MATCH_WITH_CLEANUP_AND_RETURN(')',jsvUnLockMany((unsigned)argCount, argPtr);, 0);
+  if (JSP_SHOULD_EXECUTE && argCount<=JSP_TAIL_CALL_MAX_ARGS &&
+      (lex->tk==';' || lex->tk=='}' || lex->tk==LEX_EOF)) {
+    assert(!jspTailCall.function);
+    jspTailCall.function = jsvLockAgain(function);
+    jspTailCall.functionName = jsvLockAgainSafe(functionName);
+    jspTailCall.thisArg = jsvLockAgainSafe(thisArg);
+    jspTailCall.argCount = argCount;
+    jspTailCall.callDepth = jspCallDepth;
+    memcpy(jspTailCall.args, argPtr, (unsigned)argCount*sizeof(JsVar*));
+    return 0;
+  }
+  JsVar *returnVar = jspeFunctionCall(function, functionName, thisArg, false, argCount, argPtr);
+  jsvUnLockMany((unsigned)argCount, argPtr);
+  return returnVar;
+}
+#endif
+
 NO_INLINE JsVar *jspeFactorFunctionCall() {
+#ifndef SAVE_ON_FLASH
+  // Are we the expression after 'return'? If so, function calls we make could be tail calls
+  bool isTailCallPos = false;
+  if (execInfo.tailCallPos) {
+    isTailCallPos = execInfo.tailCallPos==jsvStringIteratorGetIndex(&lex->tokenStart.it);
+    execInfo.tailCallPos = 0;
+  }
+#endif
   /* The parent if we're executing a method call */
   bool isConstructor = false;
   if (lex->tk==LEX_R_NEW) {
@@ -1153,7 +1518,12 @@ NO_INLINE JsVar *jspeFactorFunctionCall() {
       bool parseArgs = lex->tk=='(';
       a = jspeConstruct(func, funcName, parseArgs);
       isConstructor = false; // don't treat subsequent brackets as constructors
-    } else
+    }
+#ifndef SAVE_ON_FLASH
+    else if (isTailCallPos && JSP_SHOULD_EXECUTE && jsvIsFunction(func) && !jsvIsNative(func))
+      a = jspeTailCall(func, funcName, parent);
+#endif
+    else
       a = jspeFunctionCall(func, funcName, parent, true, 0, 0);
 
     jsvUnLock3(funcName, func, parent);
@@ -1558,7 +1928,16 @@ NO_INLINE JsVar *jspeClassDefinition(bool parseNamedClass) {
 
 NO_INLINE JsVar *jspeFactor() {
   if (lex->tk==LEX_ID) {
+#ifndef SAVE_ON_FLASH
+    JsVar *a = 0;
+    if (JSP_SHOULD_EXECUTE) {
+      const char *tokenName = jslGetTokenValueAsString(lex);
+      a = jspeiFindTokenInScopes(tokenName);
+      if (!a) a = jspGetNamedBuiltIn(tokenName);
+    }
+#else
     JsVar *a = jspGetNamedVariable(jslGetTokenValueAsString(lex));
+#endif
     JSP_ASSERT_MATCH(LEX_ID);
 #ifndef SAVE_ON_FLASH
     if (lex->tk==LEX_TEMPLATE_LITERAL)
@@ -1726,10 +2105,8 @@ NO_INLINE JsVar *__jspePostfixExpression(JsVar *a) {
     int op = lex->tk;
     JSP_ASSERT_MATCH(op);
     if (JSP_SHOULD_EXECUTE) {
-      JsVar *one = jsvNewFromInteger(1);
       JsVar *oldValue = jsvAsNumberAndUnLock(jsvSkipName(a)); // keep the old value (but convert to number)
-      JsVar *res = jsvMathsOpSkipNames(oldValue, one, op==LEX_PLUSPLUS ? '+' : '-');
-      jsvUnLock(one);
+      JsVar *res = jsvMathsOpSkipNamesAndUnLock(jsvLockAgainSafe(oldValue), jsvNewFromInteger(1), op==LEX_PLUSPLUS ? '+' : '-');
 
       // in-place add/subtract
       jsvReplaceWith(a, res);
@@ -1750,9 +2127,7 @@ NO_INLINE JsVar *jspePostfixExpression() {
     JSP_ASSERT_MATCH(op);
     a = jspePostfixExpression();
     if (JSP_SHOULD_EXECUTE) {
-      JsVar *one = jsvNewFromInteger(1);
-      JsVar *res = jsvMathsOpSkipNames(a, one, op==LEX_PLUSPLUS ? '+' : '-');
-      jsvUnLock(one);
+      JsVar *res = jsvMathsOpSkipNamesAndUnLock(jsvLockAgainSafe(a), jsvNewFromInteger(1), op==LEX_PLUSPLUS ? '+' : '-');
       // in-place add/subtract
       jsvReplaceWith(a, res);
       jsvUnLock(res);
@@ -1909,8 +2284,9 @@ NO_INLINE JsVar *__jspeBinaryExpression(JsVar *a, unsigned int lastPrecedence) {
           jsvUnLock3(av, bv, a);
           a = jsvNewFromBool(inst);
         } else {  // --------------------------------------------- NORMAL
-          JsVar *res = jsvMathsOpSkipNames(a, b, op);
-          jsvUnLock(a); a = res;
+          // a and b may be reused for the result if they're temporary numbers
+          a = jsvMathsOpSkipNamesAndUnLock(a, b, op);
+          b = 0;
         }
       }
       jsvUnLock(b);
@@ -2003,7 +2379,8 @@ NO_INLINE JsVar *__jspeAssignmentExpression(JsVar *lhs) {
         }
         if (op) {
           /* Fallback which does a proper add */
-          JsVar *res = jsvMathsOpSkipNames(lhs,rhs,op);
+          JsVar *res = jsvMathsOpSkipNamesAndUnLock(jsvLockAgainSafe(lhs),rhs,op);
+          rhs = 0; // unlocked above (or reused for res)
           jsvReplaceWith(lhs, res);
           jsvUnLock(res);
         }
@@ -2034,6 +2411,10 @@ NO_INLINE JsVar *jspeExpression() {
 
 /** Parse a block `{ ... }` */
 NO_INLINE void jspeSkipBlock() {
+#ifndef SAVE_ON_FLASH
+  // if we know where the block ends, just go there
+  if (jslSkipBlock()) return;
+#endif
   // fast skip of blocks
   int brackets = 1;
   while (lex->tk && brackets) {
@@ -2179,7 +2560,133 @@ NO_INLINE JsVar *jspeStatementIf() {
   return result;
 }
 
+#if defined(LINUX) && !defined(SAVE_ON_FLASH)
+/* Switch statements whose cases are all integer literals remember where each case
+ * is the first time they run, so after that they can jump straight to the right
+ * case rather than checking (and skipping over) every case before it. This uses
+ * some static RAM, so is Linux only */
+#define JSP_SWITCH_CACHE_SIZE 16 ///< How many switch statements we can remember (must be a power of 2)
+#define JSP_SWITCH_CACHE_CASES 64 ///< The most cases a switch statement can have for us to remember it
+
+typedef enum {
+  JSP_SWITCH_UNUSED,
+  JSP_SWITCH_FILLING, ///< The switch is running for the first time, and we're adding its cases
+  JSP_SWITCH_READY, ///< All cases are known, so we can jump to them
+  JSP_SWITCH_UNUSABLE, ///< The cases aren't all integer literals, so we can't jump to them
+} JspSwitchCacheState;
+
+typedef struct {
+  JsVarInt value; ///< The value in the case statement
+  size_t tokenPos; ///< Position of the 'case' token
+} JspSwitchCase;
+
+typedef struct {
+  JsVarRef source; ///< The code (lex->sourceVar) containing the switch statement
+  size_t tokenPos; ///< Position of the 'switch' token
+  size_t defaultPos; ///< Position of the 'default' token, or of the final '}' if there isn't one
+  JspSwitchCacheState state;
+  int caseCount;
+  JspSwitchCase cases[JSP_SWITCH_CACHE_CASES]; ///< The cases, sorted by value (first case first if values are the same)
+} JspSwitchCacheEntry;
+
+static JspSwitchCacheEntry jspSwitchCache[JSP_SWITCH_CACHE_SIZE];
+
+/** Get the cache entry for the switch statement at 'pos'. If the entry isn't for
+ * this switch statement (and isn't being filled by another one) it's set up to be filled,
+ * otherwise 0 is returned if there's nothing we can do */
+static JspSwitchCacheEntry *jspSwitchCacheGet(size_t pos) {
+  JsVarRef sourceRef = jsvGetRef(lex->sourceVar);
+  JspSwitchCacheEntry *e = &jspSwitchCache[(pos ^ ((size_t)sourceRef<<3)) & (JSP_SWITCH_CACHE_SIZE-1)];
+  if (e->source==sourceRef && e->tokenPos==pos)
+    return e->state==JSP_SWITCH_READY ? e : 0;
+  if (e->state==JSP_SWITCH_FILLING)
+    return 0; // an outer switch statement is using this entry
+  e->source = sourceRef;
+  e->tokenPos = pos;
+  e->state = JSP_SWITCH_FILLING;
+  e->caseCount = 0;
+  return e;
+}
+
+/// Add a case to an entry that's being filled - or mark it unusable if 'test' isn't a constant integer
+static void jspSwitchCacheAddCase(JspSwitchCacheEntry *e, size_t casePos, size_t testPos, JsVar *test) {
+  if (e->state!=JSP_SWITCH_FILLING) return;
+  // the case must be a single integer literal token, followed by ':'
+  if (!testPos || lex->tk!=':' || lex->tokenLastStart+1!=testPos ||
+      !jsvIsInt(test) || jsvIsPin(test) || e->caseCount>=JSP_SWITCH_CACHE_CASES) {
+    e->state = JSP_SWITCH_UNUSABLE;
+    return;
+  }
+  JsVarInt value = jsvGetInteger(test);
+  // insertion sort - after any cases with the same value, as the first one is the one that matches
+  int i = e->caseCount++;
+  while (i>0 && e->cases[i-1].value > value) {
+    e->cases[i] = e->cases[i-1];
+    i--;
+  }
+  e->cases[i].value = value;
+  e->cases[i].tokenPos = casePos;
+}
+
+/** Finish filling an entry. 'ok' is true if we got to the end of the cases,
+ * and the lexer is now on the 'default' or final '}' token */
+static void jspSwitchCacheFillEnd(JspSwitchCacheEntry *e, bool ok) {
+  if (!e || e->state!=JSP_SWITCH_FILLING) return;
+  if (ok && (lex->tk==LEX_R_DEFAULT || lex->tk=='}')) {
+    e->defaultPos = jsvStringIteratorGetIndex(&lex->tokenStart.it);
+    e->state = JSP_SWITCH_READY;
+  } else
+    e->state = JSP_SWITCH_UNUSABLE;
+}
+
+/// Seek to the token at the given position (as returned by jsvStringIteratorGetIndex(&lex->tokenStart.it))
+static void jspSwitchCacheSeek(size_t tokenPos) {
+  jslSeekTo(tokenPos-1);
+}
+
+/** Jump to the case that matches 'value' (or to the default/end if there isn't one).
+ * Returns false (and leaves the lexer where it was) if we couldn't */
+static bool jspSwitchCacheJump(JspSwitchCacheEntry *e, JsVar *value) {
+  if (!jsvIsInt(value)) return false;
+  JsVarInt v = jsvGetInteger(value);
+  size_t pos = e->defaultPos;
+  int min = 0, max = e->caseCount-1;
+  while (min<=max) {
+    int mid = (min+max)>>1;
+    if (e->cases[mid].value < v) min = mid+1;
+    else max = mid-1; // find the first case with this value
+  }
+  if (min<e->caseCount && e->cases[min].value==v)
+    pos = e->cases[min].tokenPos;
+  size_t bodyPos = jsvStringIteratorGetIndex(&lex->tokenStart.it);
+  jspSwitchCacheSeek(pos);
+  // check we landed on what we expected - the code could have been replaced
+  if (pos==e->defaultPos ? (lex->tk==LEX_R_DEFAULT || lex->tk=='}') : lex->tk==LEX_R_CASE)
+    return true;
+  e->state = JSP_SWITCH_UNUSABLE;
+  jspSwitchCacheSeek(bodyPos);
+  return false;
+}
+#endif
+
+void jspCachesForget() {
+  jspScopeGeneration++; // this clears scope caches...
+  jspObjectGeneration++; // ... and the inline cache
+#ifdef JSP_SWITCH_CACHE_SIZE
+  for (int i=0;i<JSP_SWITCH_CACHE_SIZE;i++) {
+    // a switch statement being filled is running now, so its code is locked and can't have moved
+    if (jspSwitchCache[i].state!=JSP_SWITCH_FILLING) {
+      jspSwitchCache[i].source = 0;
+      jspSwitchCache[i].state = JSP_SWITCH_UNUSED;
+    }
+  }
+#endif
+}
+
 NO_INLINE JsVar *jspeStatementSwitch() {
+#ifdef JSP_SWITCH_CACHE_SIZE
+  size_t switchPos = jsvStringIteratorGetIndex(&lex->tokenStart.it);
+#endif
   JSP_ASSERT_MATCH(LEX_R_SWITCH);
   JSP_MATCH('(');
   JsVar *switchOn = jspeExpression();
@@ -2191,14 +2698,34 @@ NO_INLINE JsVar *jspeStatementSwitch() {
   JSP_MATCH_WITH_CLEANUP_AND_RETURN('{', jsvUnLock(switchOn), 0);
 
   bool executeDefault = true;
+#ifdef JSP_SWITCH_CACHE_SIZE
+  JspSwitchCacheEntry *cache = jspSwitchCacheGet(switchPos);
+  if (cache && cache->state==JSP_SWITCH_READY) {
+    JsVar *switchValue = jsvSkipName(switchOn);
+    jspSwitchCacheJump(cache, switchValue);
+    jsvUnLock(switchValue);
+    cache = 0; // it's already filled in
+  }
+#endif
   if (execute) execInfo.execute=EXEC_NO|EXEC_IN_SWITCH;
   while (lex->tk==LEX_R_CASE) {
+#ifdef JSP_SWITCH_CACHE_SIZE
+    size_t casePos = jsvStringIteratorGetIndex(&lex->tokenStart.it);
+#endif
     JSP_MATCH_WITH_CLEANUP_AND_RETURN(LEX_R_CASE, jsvUnLock(switchOn), 0);
     JsExecFlags oldFlags = execInfo.execute;
     if (execute) execInfo.execute=EXEC_YES|EXEC_IN_SWITCH;
+#ifdef JSP_SWITCH_CACHE_SIZE
+    size_t testPos = lex->tk==LEX_INT ? jsvStringIteratorGetIndex(&lex->tokenStart.it) : 0;
+#endif
     JsVar *test = jspeAssignmentExpression();
     execInfo.execute = oldFlags|EXEC_IN_SWITCH;;
+#ifdef JSP_SWITCH_CACHE_SIZE
+    if (cache) jspSwitchCacheAddCase(cache, casePos, testPos, test);
+    JSP_MATCH_WITH_CLEANUP_AND_RETURN(':', jspSwitchCacheFillEnd(cache, false);jsvUnLock2(switchOn, test), 0);
+#else
     JSP_MATCH_WITH_CLEANUP_AND_RETURN(':', jsvUnLock2(switchOn, test), 0);
+#endif
     bool cond = false;
     if (execute)
       cond = jsvGetBoolAndUnLock(jsvMathsOpSkipNames(switchOn, test, LEX_TYPEEQUAL));
@@ -2210,6 +2737,9 @@ NO_INLINE JsVar *jspeStatementSwitch() {
       jsvUnLock(jspeBlockOrStatement());
     oldExecute |= execInfo.execute & (EXEC_ERROR_MASK|EXEC_RETURN); // copy across any errors/exceptions/returns
   }
+#ifdef JSP_SWITCH_CACHE_SIZE
+  jspSwitchCacheFillEnd(cache, !JSP_SHOULDNT_PARSE);
+#endif
   jsvUnLock(switchOn);
   if (execute && (execInfo.execute&EXEC_RUN_MASK)==EXEC_BREAK) {
     execInfo.execute=EXEC_YES|EXEC_IN_SWITCH;
@@ -2286,6 +2816,9 @@ NO_INLINE JsVar *jspeStatementDoOrWhile(bool isWhile) {
 
   JslCharPos whileBodyEnd;
   whileBodyEnd = jslCharPosClone(&lex->tokenStart);
+#ifdef JSL_TOKEN_CACHE_SIZE
+  bool hasTokenCache = !hasHadBreak && loopCond && jslTokenCacheStart();
+#endif
 
   while (!hasHadBreak && loopCond
 #ifdef JSPARSE_MAX_LOOP_ITERATIONS
@@ -2311,6 +2844,9 @@ NO_INLINE JsVar *jspeStatementDoOrWhile(bool isWhile) {
     }
   }
   jslSeekToP(&whileBodyEnd);
+#ifdef JSL_TOKEN_CACHE_SIZE
+  if (hasTokenCache) jslTokenCacheEnd();
+#endif
   jslCharPosFree(&whileCondStart);
   jslCharPosFree(&whileBodyStart);
   jslCharPosFree(&whileBodyEnd);
@@ -2389,6 +2925,9 @@ NO_INLINE JsVar *jspeStatementFor() {
             /* for of */ JSIF_EVERY_ARRAY_ELEMENT :
             /* for in */ JSIF_DEFINED_ARRAY_ElEMENTS);
         bool hasHadBreak = false;
+#ifdef JSL_TOKEN_CACHE_SIZE
+        bool hasTokenCache = jslTokenCacheStart();
+#endif
         while (JSP_SHOULD_EXECUTE && jsvIteratorHasElement(&it) && !hasHadBreak) {
           JsVar *loopIndexVar = jsvIteratorGetKey(&it);
           bool ignore = false;
@@ -2441,6 +2980,9 @@ NO_INLINE JsVar *jspeStatementFor() {
         }
         assert(!foundPrototype);
         jsvIteratorFree(&it);
+#ifdef JSL_TOKEN_CACHE_SIZE
+        if (hasTokenCache) jslTokenCacheEnd();
+#endif
       } else if (!jsvIsUndefined(array)) {
         jsExceptionHere(JSET_ERROR, "FOR loop can only iterate over Arrays, Strings or Objects, not %t", array);
       }
@@ -2491,6 +3033,9 @@ NO_INLINE JsVar *jspeStatementFor() {
       }
     }
     if (!loopCond) JSP_RESTORE_EXECUTE();
+#ifdef JSL_TOKEN_CACHE_SIZE
+    bool hasTokenCache = !hasHadBreak && loopCond && jslTokenCacheStart();
+#endif
     if (loopCond) {
       jslSeekToP(&forIterStart);
       if (lex->tk != ')') jsvUnLock(jspeExpression());
@@ -2528,6 +3073,9 @@ NO_INLINE JsVar *jspeStatementFor() {
       }
     }
     jslSeekToP(&forBodyEnd);
+#ifdef JSL_TOKEN_CACHE_SIZE
+    if (hasTokenCache) jslTokenCacheEnd();
+#endif
 
     jslCharPosFree(&forCondStart);
     jslCharPosFree(&forIterStart);
@@ -2546,6 +3094,9 @@ NO_INLINE JsVar *jspeStatementFor() {
 NO_INLINE JsVar *jspeStatementTry() {
   // execute the try block
   JSP_ASSERT_MATCH(LEX_R_TRY);
+#ifndef SAVE_ON_FLASH
+  execInfo.tryDepth++; // a tail call would be made outside the try/catch/finally
+#endif
   bool shouldExecuteBefore = JSP_SHOULD_EXECUTE;
   jspeBlock();
   bool hadException = shouldExecuteBefore && ((execInfo.execute & EXEC_EXCEPTION)!=0);
@@ -2582,10 +3133,16 @@ NO_INLINE JsVar *jspeStatementTry() {
       jspeBlock();
       JSP_RESTORE_EXECUTE();
     } else {
+#ifndef SAVE_ON_FLASH
+      jspScopeGeneration++; // the exception variable could shadow one we've cached
+#endif
       if (!scope || jspeiAddScope(scope)) {
         jspeBlock();
         if (scope) jspeiRemoveScope();
       }
+#ifndef SAVE_ON_FLASH
+      jspScopeGeneration++; // ... and now it has gone
+#endif
     }
     jsvUnLock(scope);
   }
@@ -2597,6 +3154,9 @@ NO_INLINE JsVar *jspeStatementTry() {
     // put the flag back!
     if (hadException && !hadCatch) execInfo.execute = execInfo.execute | EXEC_EXCEPTION;
   }
+#ifndef SAVE_ON_FLASH
+  execInfo.tryDepth--;
+#endif
   return 0;
 }
 
@@ -2604,6 +3164,9 @@ NO_INLINE JsVar *jspeStatementReturn() {
   JsVar *result = 0;
   JSP_ASSERT_MATCH(LEX_R_RETURN);
   if (lex->tk != ';' && lex->tk != '}') {
+#ifndef SAVE_ON_FLASH
+    jspMarkTailCallPosition();
+#endif
     // we only want the value, so skip the name if there was one
     result = jsvSkipNameAndUnLock(jspeExpression());
   }
@@ -2676,7 +3239,188 @@ NO_INLINE JsVar *jspeStatementFunctionDecl(bool isClass) {
   return funcName;
 }
 
+#ifndef SAVE_ON_FLASH
+/// Append the name of the function in the given call frame (or '(root)' if there isn't one)
+static void jspProfileAppendFunctionName(JsVar *str, JspCallFrame *frame) {
+  JsVar *name = 0;
+  if (frame) {
+    name = jsvLockAgainSafe(frame->functionName);
+    // Tail calls and callbacks don't have a name - but the function itself might
+    if (!jsvIsString(name)) {
+      jsvUnLock(name);
+      name = jsvObjectGetChild(frame->function, JSPARSE_FUNCTION_NAME_NAME, 0);
+    }
+  }
+  if (jsvIsString(name))
+    jsvAppendStringVarComplete(str, name);
+  else
+    jsvAppendString(str, frame ? "(anonymous)" : "(root)");
+  jsvUnLock(name);
+}
+
+/// Append the names of the functions in the call stack, outermost first, separated by ';'
+static void jspProfileAppendStack(JsVar *str, JspCallFrame *frame) {
+  if (frame && frame->caller) {
+    jspProfileAppendStack(str, frame->caller);
+    jsvAppendCharacter(str, ';');
+  } else if (frame) {
+    jsvAppendString(str, "(root);");
+  }
+  jspProfileAppendFunctionName(str, frame);
+}
+
+/// Add 'amount' to the count of samples for 'key' in the given histogram
+static void jspProfileCount(JsVar *profile, const char *histogramName, JsVar *key, JsVarInt amount) {
+  JsVar *histogram = jsvObjectGetChild(profile, histogramName, JSV_OBJECT);
+  JsVar *countName = histogram ? jsvFindChildFromVar(histogram, key, true) : 0;
+  if (countName) {
+    JsVar *count = jsvNewFromInteger(jsvGetIntegerAndUnLock(jsvSkipName(countName))+amount);
+    jsvSetValueOfName(countName, count);
+    jsvUnLock(count);
+  }
+  jsvUnLock3(countName, histogram, key);
+}
+
+/** Count a sample at the current token in function 'name'. Working out the line
+ * number means searching the code, so we just remember the token's position
+ * and leave that until jspProfileStop. */
+static void jspProfileCountPosition(JsVar *profile, JsVar *name, JspCallFrame *frame) {
+  JsVar *positions = jsvObjectGetChild(profile, "positions", JSV_ARRAY);
+  if (!positions) return;
+  // One entry for each function name and bit of code we've been in
+  JsVar *entry = 0;
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, positions);
+  while (!entry && jsvObjectIteratorHasValue(&it)) {
+    JsVar *e = jsvObjectIteratorGetValue(&it);
+    JsVar *source = jsvObjectGetChild(e, "source", 0);
+    JsVar *entryName = jsvObjectGetChild(e, "name", 0);
+    if (source==lex->sourceVar && jsvCompareString(entryName, name, 0, 0, false)==0)
+      entry = e;
+    else
+      jsvUnLock(e);
+    jsvUnLock2(source, entryName);
+    jsvObjectIteratorNext(&it);
+  }
+  jsvObjectIteratorFree(&it);
+  if (!entry) {
+    entry = jsvNewObject();
+    if (entry) {
+      jsvObjectSetChild(entry, "name", name);
+      jsvObjectSetChild(entry, "source", lex->sourceVar);
+      // The code we're executing may be a tokenised copy of the function's code
+      if (frame) jsvObjectSetChildAndUnLock(entry, "code", jsvObjectGetChild(frame->function, JSPARSE_FUNCTION_CODE_NAME, 0));
+      jsvObjectSetChildAndUnLock(entry, "lineNumberOffset", jsvNewFromInteger(lex->lineNumberOffset));
+      jsvArrayPush(positions, entry);
+    }
+  }
+  if (entry)
+    jspProfileCount(entry, "counts", jsvNewFromInteger((JsVarInt)jsvStringIteratorGetIndex(&lex->tokenStart.it)), 1);
+  jsvUnLock2(entry, positions);
+}
+
+/// Turn the token positions recorded by jspProfileCountPosition into counts for each line
+static void jspProfileCountLines(JsVar *profile) {
+  JsVar *positions = jsvObjectGetChild(profile, "positions", 0);
+  if (!positions) return;
+  jsvObjectRemoveChild(profile, "positions");
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, positions);
+  while (jsvObjectIteratorHasValue(&it)) {
+    JsVar *entry = jsvObjectIteratorGetValue(&it);
+    JsVar *name = jsvObjectGetChild(entry, "name", 0);
+    JsVar *source = jsvObjectGetChild(entry, "source", 0);
+    JsVar *code = jsvObjectGetChild(entry, "code", 0);
+    JsVarInt lineNumberOffset = jsvGetIntegerAndUnLock(jsvObjectGetChild(entry, "lineNumberOffset", 0));
+    JsVar *counts = jsvObjectGetChild(entry, "counts", 0);
+    JsvObjectIterator cit;
+    jsvObjectIteratorNew(&cit, counts);
+    while (jsvObjectIteratorHasValue(&cit)) {
+      size_t pos = (size_t)jsvGetIntegerAndUnLock(jsvObjectIteratorGetKey(&cit));
+      JsVar *lineCode = source;
+      // If we were executing a tokenised copy of the function's code, find where we were in the original
+      if (jsvIsString(code) && code!=source) {
+        pos = jslGetSourcePosition(code, source, pos);
+        lineCode = code;
+      }
+      size_t line, col;
+      jsvGetLineAndCol(lineCode, pos-1, &line, &col);
+      if (lineNumberOffset)
+        line += (size_t)lineNumberOffset - 1;
+      jspProfileCount(profile, "lines", jsvVarPrintf("%v:%d", name, (int)line), jsvGetIntegerAndUnLock(jsvObjectIteratorGetValue(&cit)));
+      jsvObjectIteratorNext(&cit);
+    }
+    jsvObjectIteratorFree(&cit);
+    jsvUnLock3(counts, code, source);
+    jsvUnLock2(name, entry);
+    jsvObjectIteratorNext(&it);
+  }
+  jsvObjectIteratorFree(&it);
+  jsvUnLock(positions);
+}
+
+/// Record which function, line and call stack we're currently executing
+static NO_INLINE void jspProfileSample() {
+  jspProfileSampleDue = false;
+  JsVar *profile = jsvObjectGetChild(execInfo.hiddenRoot, JSPARSE_PROFILE_VAR, 0);
+  if (!profile) return;
+  jsvObjectSetChildAndUnLock(profile, "samples", jsvNewFromInteger(jsvGetIntegerAndUnLock(jsvObjectGetChild(profile, "samples", 0))+1));
+  // The innermost frame is only the one we're in if it's the code we're executing (it might be eval'd code)
+  JspCallFrame *frame = execInfo.callFrame;
+  if (frame && frame->lex!=lex) frame = 0;
+
+  JsVar *name = jsvNewFromEmptyString();
+  if (name) {
+    jspProfileAppendFunctionName(name, frame);
+    jspProfileCountPosition(profile, name, frame);
+    jspProfileCount(profile, "functions", name, 1);
+  }
+  JsVar *stack = jsvNewFromEmptyString();
+  if (stack) {
+    jspProfileAppendStack(stack, frame ? frame : execInfo.callFrame);
+    jspProfileCount(profile, "stacks", stack, 1);
+  }
+  jsvUnLock(profile);
+}
+
+void jspProfileStart() {
+  jsvObjectSetChildAndUnLock(execInfo.hiddenRoot, JSPARSE_PROFILE_VAR, jsvNewObject());
+  jspProfileSampleDue = false;
+}
+
+JsVar *jspProfileStop() {
+  JsVar *profile = jsvObjectGetChild(execInfo.hiddenRoot, JSPARSE_PROFILE_VAR, 0);
+  if (!profile) return 0;
+  jsvObjectRemoveChild(execInfo.hiddenRoot, JSPARSE_PROFILE_VAR);
+  jspProfileSampleDue = false;
+  jspProfileCountLines(profile);
+  /* Turn the call stacks into 'folded' format for flame graphs, eg:
+   *   (root);a;b 12
+   *   (root);a 4  */
+  JsVar *folded = jsvNewFromEmptyString();
+  JsVar *stacks = jsvObjectGetChild(profile, "stacks", 0);
+  if (folded && stacks) {
+    JsvObjectIterator it;
+    jsvObjectIteratorNew(&it, stacks);
+    while (jsvObjectIteratorHasValue(&it)) {
+      JsVar *key = jsvObjectIteratorGetKey(&it);
+      jsvAppendPrintf(folded, "%v %d\n", key, jsvGetIntegerAndUnLock(jsvObjectIteratorGetValue(&it)));
+      jsvUnLock(key);
+      jsvObjectIteratorNext(&it);
+    }
+    jsvObjectIteratorFree(&it);
+  }
+  jsvUnLock(stacks);
+  jsvObjectSetChildAndUnLock(profile, "folded", folded);
+  return profile;
+}
+#endif
+
 NO_INLINE JsVar *jspeStatement() {
+#ifndef SAVE_ON_FLASH
+  if (jspProfileSampleDue)
+    jspProfileSample();
+#endif
 #ifdef USE_DEBUGGER
   if (execInfo.execute&EXEC_DEBUGGER_NEXT_LINE &&
       lex->tk!=';' &&
@@ -2873,6 +3617,13 @@ JsVar *jspGetConstructor(JsVar *object) {
 // -----------------------------------------------------------------------------
 
 void jspSoftInit() {
+#ifndef SAVE_ON_FLASH
+  jspScopeGeneration++; // variables may have moved - forget anything we cached
+  jspObjectGeneration++;
+#endif
+#ifdef JSP_SWITCH_CACHE_SIZE
+  memset(jspSwitchCache, 0, sizeof(jspSwitchCache)); // code may have been replaced
+#endif
   execInfo.root = jsvFindOrCreateRoot();
   // Root now has a lock and a ref
   execInfo.hiddenRoot = jsvObjectGetChild(execInfo.root, JS_HIDDEN_CHAR_STR, JSV_OBJECT);
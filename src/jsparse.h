@@ -126,6 +126,73 @@ typedef enum  {
   EXEC_PERSIST = EXEC_ERROR_MASK|EXEC_CTRL_C_MASK, ///< Things we should keep track of even after executing
 } JsExecFlags;
 
+#ifndef SAVE_ON_FLASH
+/* How many variable lookups each function call remembers (must be a power of 2).
+ * Each call has a JspScopeCache on the stack, so keep it small on devices */
+#ifdef LINUX
+#define JSP_SCOPE_CACHE_SIZE 32
+#else
+#define JSP_SCOPE_CACHE_SIZE 8
+#endif
+
+/** The variables that identifiers in a function's code were found to refer to,
+ * keyed by the position of the identifier's token. This saves us searching
+ * every scope each time the same bit of code runs (eg. in a loop). Everything in
+ * here is forgotten whenever jspScopeGeneration changes. */
+typedef struct {
+  JsLex *lex; ///< The lexer that token positions refer to
+  unsigned int generation; ///< The value of jspScopeGeneration when this was last cleared
+  size_t tokenPos[JSP_SCOPE_CACHE_SIZE]; ///< Position of the identifier's token
+  JsVarRef name[JSP_SCOPE_CACHE_SIZE]; ///< The variable name it was found to be (or 0 if unused)
+} JspScopeCache;
+
+/** Incremented whenever a variable name may have been removed from a scope, or
+ * one that shadows another may have been added - see JspScopeCache. This also
+ * changes when any name is removed from any object, or vars are garbage collected. */
+extern unsigned int jspScopeGeneration;
+/** Incremented whenever any name is removed from any object, or vars are garbage
+ * collected or moved. The inline cache is forgotten when this changes - unlike
+ * jspScopeGeneration, it doesn't change when a new variable is declared. */
+extern unsigned int jspObjectGeneration;
+/// Variables have been moved in memory (see jsvDefragment) - forget everything that was cached about where they were
+void jspCachesForget();
+
+#define JSP_TAIL_CALL_MAX_ARGS 8 ///< Calls with more arguments than this are never made as tail calls
+
+/** A function call that is currently executing. Each one links to the function
+ * that called it, so the profiler can see the whole call stack */
+typedef struct JspCallFrame {
+  JsVar *function; ///< The function being executed
+  JsVar *functionName; ///< The name it was called with (or 0)
+  JsLex *lex; ///< The lexer executing the function's code
+  struct JspCallFrame *caller; ///< The frame of the function that called this one (or 0)
+} JspCallFrame;
+
+/// Set (from a timer or signal handler) when the profiler should record where we are at the next statement
+extern volatile bool jspProfileSampleDue;
+/// Start recording samples of where code is executing (something else must set jspProfileSampleDue periodically)
+void jspProfileStart();
+/** Stop recording samples and return an object containing how many samples were
+ * in each function, each line of each function, and each call stack (or 0 if we weren't profiling) */
+JsVar *jspProfileStop();
+#endif
+
+#if defined(LINUX) && !defined(SAVE_ON_FLASH)
+/* Member accesses (`a.b`) remember which object they last looked in, and which
+ * name they found (either in the object or its prototype) so they don't have
+ * to search for it again next time. This uses some static RAM, so is Linux only */
+#define JSP_INLINE_CACHE_SIZE 64 ///< How many member accesses we can remember (must be a power of 2)
+/// Get the bit in jspInlineCacheObjects that is used for the given object's ref
+#define JSP_INLINE_CACHE_OBJECT_BIT(ref) (((uint64_t)1)<<((ref)&63))
+/** One bit for every object that has an entry in the inline cache (see JSP_INLINE_CACHE_OBJECT_BIT).
+ * If an object with its bit set gets a new child or is freed, jspInlineCacheForget must be called */
+extern uint64_t jspInlineCacheObjects;
+/// Number of member accesses that were/weren't found in the inline cache
+extern unsigned int jspInlineCacheHits, jspInlineCacheMisses;
+/// Forget anything in the inline cache that relies on the object with the given ref
+void jspInlineCacheForget(JsVarRef ref);
+#endif
+
 /** This structure is used when parsing the JavaScript. It contains
  * everything that should be needed. */
 typedef struct {
@@ -136,6 +203,16 @@ typedef struct {
   JsVar *scopesVar;
   /// Value of 'this' reserved word
   JsVar *thisVar;
+#ifndef SAVE_ON_FLASH
+  /// Variables we have looked up in the function that's currently executing (or 0)
+  JspScopeCache *scopeCache;
+  /// Position of the expression after 'return' - a function call that starts here can be a tail call (or 0)
+  size_t tailCallPos;
+  /// How many 'try' statements we're in inside the function that's currently executing (we can't make tail calls from these)
+  unsigned char tryDepth;
+  /// The function call that's currently executing (or 0 if we're not in a function)
+  JspCallFrame *callFrame;
+#endif
 
   volatile JsExecFlags execute;
 } JsExecInfo;
@@ -301,6 +301,11 @@ static bool jstBufferTaskChecker(UtilTimerTask *task, void *data) {
   JsVarRef ref = *(JsVarRef*)data;
   return task->data.buffer.currentBuffer==ref || task->data.buffer.nextBuffer==ref;
 }
+
+static bool jstAnyBufferTaskChecker(UtilTimerTask *task, void *data) {
+  NOT_USED(data);
+  return UET_IS_BUFFER_EVENT(task->type);
+}
 #endif
 
 // data = *Pin
@@ -336,6 +341,12 @@ bool jstGetLastBufferTimerTask(JsVar *var, UtilTimerTask *task) {
   JsVarRef ref = jsvGetRef(var);
   return utilTimerGetLastTask(jstBufferTaskChecker, (void*)&ref, task);
 }
+
+/// Return true if any timer tasks are reading from or writing to variables
+bool jstHasBufferTimerTasks() {
+  UtilTimerTask task;
+  return utilTimerGetLastTask(jstAnyBufferTaskChecker, 0, &task);
+}
 #endif
 
 bool jstPinOutputAtTime(JsSysTime time, Pin *pins, int pinCount, uint8_t value) {
@@ -241,6 +241,31 @@ typedef int64_t JsSysTime;
 
 #define JSPARSE_MAX_SCOPES  8
 
+#ifndef SAVE_ON_FLASH
+#ifndef JSV_OBJECT_INDEX_MIN_CHILDREN
+/// Objects with at least this many children get a hash index of their names, so finding a child doesn't need a linear search
+#define JSV_OBJECT_INDEX_MIN_CHILDREN 32
+#endif
+#ifndef JSV_ARRAY_INDEX_MIN_LENGTH
+/// Dense arrays at least this long get a table of their elements, so indexing them doesn't need a linear search
+#define JSV_ARRAY_INDEX_MIN_LENGTH 16
+#endif
+#ifndef JSV_GC_GREY_STACK_SIZE
+/// How many variables the incremental garbage collector can have found but not yet looked inside (see E.setGCBudget)
+#define JSV_GC_GREY_STACK_SIZE 64
+#endif
+/// Keep a bitmap of which variables are free, so flat strings can be allocated without searching the free list
+#define JSV_FREE_BITMAP
+#ifndef JSV_STRING_TAIL_CACHE_SIZE
+/// How many long strings we remember the last StringExt of, so appending doesn't walk the whole string (must be a power of 2)
+#define JSV_STRING_TAIL_CACHE_SIZE 4
+#endif
+#ifndef JSV_STRING_SKIP_INDEX_SIZE
+/// How many long strings we keep an index of StringExts for, so seeking to a character doesn't walk the whole string (must be a power of 2)
+#define JSV_STRING_SKIP_INDEX_SIZE 2
+#endif
+#endif
+
 #define STRINGIFY_HELPER(x) #x
 #define STRINGIFY(x) STRINGIFY_HELPER(x)
 #define NOT_USED(x) ( (void)(x) )
@@ -258,12 +283,15 @@ typedef int64_t JsSysTime;
 #define JSPARSE_FUNCTION_THIS_NAME JS_HIDDEN_CHAR_STR"ths" // the 'this' variable - for bound functions
 #define JSPARSE_FUNCTION_NAME_NAME JS_HIDDEN_CHAR_STR"nam" // for named functions (a = function foo() { foo(); })
 #define JSPARSE_FUNCTION_LINENUMBER_NAME JS_HIDDEN_CHAR_STR"lin" // The line number offset of the function
+#define JSPARSE_FUNCTION_TOKENISED_NAME JS_HIDDEN_CHAR_STR"tok" // cached tokenised copy of the function's code (see JSF_TOKENISE_ON_CALL)
+#define JSPARSE_FUNCTION_BLOCKS_NAME JS_HIDDEN_CHAR_STR"blk" // index of the blocks in the tokenised code (see jslNewBlockIndex)
 #define JS_EVENT_PREFIX "#on"
 #define JS_TIMEZONE_VAR "tz"
 #define JS_GRAPHICS_VAR "gfx"
 
 #define JSPARSE_EXCEPTION_VAR "except" // when exceptions are thrown, they're stored in the root scope
 #define JSPARSE_STACKTRACE_VAR "sTrace" // for errors/exceptions, a stack trace is stored as a string
+#define JSPARSE_PROFILE_VAR "prof" // when profiling, the number of samples recorded for each function/line/stack
 #define JSPARSE_MODULE_CACHE_NAME "modules"
 
 #if !defined(NO_ASSERT)
@@ -21,6 +21,7 @@
 #include "jswrap_object.h" // for jswrap_object_toString
 #include "jswrap_arraybuffer.h" // for jsvNewTypedArray
 #include "jswrap_dataview.h" // for jsvNewDataViewWithData
+#include "jstimer.h" // for jstHasBufferTimerTasks
 
 #ifdef DEBUG
   /** When freeing, clear the references (nextChild/etc) in the JsVar.
@@ -41,6 +42,9 @@ JsVar **jsVarBlocks = 0;
 unsigned int jsVarsSize = 0;
 #define JSVAR_BLOCK_SIZE 4096
 #define JSVAR_BLOCK_SHIFT 12
+/* Indices of jsVarBlocks, in the order the blocks are in memory - so
+ * jsvGetRef can binary search for the block a variable is in */
+static unsigned int *jsVarBlockOrder = 0;
 #else
 #ifdef JSVAR_MALLOC
 unsigned int jsVarsSize = 0;
@@ -61,6 +65,40 @@ volatile bool touchedFreeList = false;
 volatile JsVarRef jsVarFirstEmpty; ///< reference of first unused variable (variables are in a linked list)
 volatile MemBusyType isMemoryBusy; ///< Are we doing garbage collection or similar, so can't access memory?
 
+#ifdef JSV_FREE_BITMAP
+/* One bit for each variable, set if the variable is in the free list. The
+ * free list is also linked backwards (with prevSibling), so a run of free
+ * variables found in here can be taken out of the free list without having
+ * to search it - see jsvNewFlatStringOfLength */
+#if defined(RESIZABLE_JSVARS) || defined(JSVAR_MALLOC)
+static uint32_t *jsvFreeBitmap;
+#else
+static uint32_t jsvFreeBitmap[(JSVAR_CACHE_SIZE+31)>>5];
+#endif
+#endif
+
+#ifdef JSV_GC_GREY_STACK_SIZE
+typedef enum {
+  JSV_GC_IDLE,  ///< No incremental garbage collection in progress
+  JSV_GC_MARK,  ///< Finding variables that are in use
+  JSV_GC_SWEEP, ///< Freeing variables that weren't found
+} JsvGCPhase;
+
+static JsvGCPhase jsvGCPhase; ///< What the incremental garbage collector is doing
+static JsVarFlags jsvGCBlack; ///< The value of JSV_GARBAGE_COLLECT for variables the incremental garbage collector knows are in use
+static unsigned int jsvGCBudget; ///< How many variables to look at in each slice of incremental garbage collection (0 = don't collect incrementally)
+static int jsvGCGrowth; ///< Variables allocated minus variables freed since the last garbage collection
+static void jsvGarbageCollectShade(JsVar *var);
+static void jsvGarbageCollectFlatStringAllocated(JsVarRef ref, unsigned int blocks);
+static void jsvGarbageCollectReset();
+#endif
+#ifdef JSV_STRING_TAIL_CACHE_SIZE
+static void jsvStringTailCacheForget(JsVar *str);
+#endif
+#ifdef JSV_STRING_SKIP_INDEX_SIZE
+static void jsvStringSkipIndexForget(JsVar *str);
+#endif
+
 // ----------------------------------------------------------------------------
 // ----------------------------------------------------------------------------
 
@@ -175,6 +213,19 @@ void jsvSetLastChild(JsVar *v, JsVarRef r) {
 }
 #endif
 
+#ifdef JSV_OBJECT_INDEX_MIN_CHILDREN
+/// Get the index of an object's children (or 0 if it doesn't have one) - see jsvObjectIndexBuild
+static ALWAYS_INLINE JsVarRef jsvGetObjectIndex(JsVar *v) {
+  return jsvIsObject(v) ? jsvGetNextSibling(v) : 0;
+}
+#endif
+#ifdef JSV_ARRAY_INDEX_MIN_LENGTH
+/// Get the table of an array's elements (or 0 if it doesn't have one) - see jsvArrayIndexBuild
+static ALWAYS_INLINE JsVarRef jsvGetArrayIndexTable(const JsVar *v) {
+  return jsvIsArray(v) ? jsvGetNextSibling(v) : 0;
+}
+#endif
+
 
 // For debugging/testing ONLY - maximum # of vars we are allowed to use
 void jsvSetMaxVarsUsed(unsigned int size) {
@@ -186,28 +237,99 @@ void jsvSetMaxVarsUsed(unsigned int size) {
   jsVarsSize = size;
 }
 
+#ifdef JSV_FREE_BITMAP
+static ALWAYS_INLINE void jsvFreeBitmapSet(JsVarRef ref) {
+  jsvFreeBitmap[(ref-1)>>5] |= 1u<<((ref-1)&31);
+}
+
+static ALWAYS_INLINE void jsvFreeBitmapClear(JsVarRef ref) {
+  jsvFreeBitmap[(ref-1)>>5] &= ~(1u<<((ref-1)&31));
+}
+
+static ALWAYS_INLINE bool jsvFreeBitmapGet(JsVarRef ref) {
+  return (jsvFreeBitmap[(ref-1)>>5] & (1u<<((ref-1)&31)))!=0;
+}
+
+/// Mark every variable as not free (before the free list is built again)
+static void jsvFreeBitmapReset() {
+  memset(jsvFreeBitmap, 0, ((jsVarsSize+31)>>5)*sizeof(uint32_t));
+}
+
+/// Take a variable out of the free list
+static void jsvFreeListRemove(JsVarRef ref) {
+  JsVar *var = jsvGetAddressOf(ref);
+  JsVarRef next = jsvGetNextSibling(var);
+  JsVarRef prev = jsvGetPrevSibling(var);
+  if (prev) jsvSetNextSibling(jsvGetAddressOf(prev), next);
+  else jsVarFirstEmpty = next;
+  if (next) jsvSetPrevSibling(jsvGetAddressOf(next), prev);
+  jsvFreeBitmapClear(ref);
+}
+
+/** Find 'blocks' free variables that are next to each other, and return the
+ * first (or 0 if there aren't any). This looks at 32 variables at a time */
+static JsVarRef jsvFreeBitmapFindRun(unsigned int blocks) {
+  unsigned int words = (jsVarsSize+31)>>5;
+  unsigned int w, run = 0;
+  JsVarRef start = 0;
+  for (w=0;w<words && run<blocks;w++) {
+#ifdef RESIZABLE_JSVARS
+    // variables in different blocks of memory aren't next to each other
+    if (!(w&((JSVAR_BLOCK_SIZE>>5)-1))) run = 0;
+#endif
+    uint32_t bits = jsvFreeBitmap[w];
+    if (bits==0xFFFFFFFF) { // all free
+      if (!run) start = (JsVarRef)((w<<5)+1);
+      run += 32;
+    } else if (!bits) { // none free
+      run = 0;
+    } else {
+      unsigned int b;
+      for (b=0;b<32 && run<blocks;b++) {
+        if (bits & (1u<<b)) {
+          if (!run) start = (JsVarRef)((w<<5)+b+1);
+          run++;
+        } else run = 0;
+      }
+    }
+  }
+  if (run<blocks || start+blocks-1>jsVarsSize) return 0;
+  return start;
+}
+#endif
+
+/// Add a free variable to the end of the free list that is being built, where 'lastEmpty' is currently the last one (or 0)
+static ALWAYS_INLINE void jsvFreeListAppend(JsVarRef *lastEmpty, JsVarRef ref) {
+  if (*lastEmpty) jsvSetNextSibling(jsvGetAddressOf(*lastEmpty), ref);
+  else jsVarFirstEmpty = ref;
+#ifdef JSV_FREE_BITMAP
+  jsvSetPrevSibling(jsvGetAddressOf(ref), *lastEmpty);
+  jsvFreeBitmapSet(ref);
+#endif
+  *lastEmpty = ref;
+}
+
 // maps the empty variables in...
 void jsvCreateEmptyVarList() {
   assert(!isMemoryBusy);
   isMemoryBusy = MEMBUSY_SYSTEM;
   jsVarFirstEmpty = 0;
-  JsVar firstVar; // temporary var to simplify code in the loop below
-  jsvSetNextSibling(&firstVar, 0);
-  JsVar *lastEmpty = &firstVar;
+#ifdef JSV_FREE_BITMAP
+  jsvFreeBitmapReset();
+#endif
+  JsVarRef lastEmpty = 0;
 
   JsVarRef i;
   for (i=1;i<=jsVarsSize;i++) {
     JsVar *var = jsvGetAddressOf(i);
     if ((var->flags&JSV_VARTYPEMASK) == JSV_UNUSED) {
-      jsvSetNextSibling(lastEmpty, i);
-      lastEmpty = var;
+      jsvFreeListAppend(&lastEmpty, i);
     } else if (jsvIsFlatString(var)) {
       // skip over used blocks for flat strings
       i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
     }
   }
-  jsvSetNextSibling(lastEmpty, 0);
-  jsVarFirstEmpty = jsvGetNextSibling(&firstVar);
+  if (lastEmpty) jsvSetNextSibling(jsvGetAddressOf(lastEmpty), 0);
   isMemoryBusy = MEM_NOT_BUSY;
 }
 
@@ -218,22 +340,39 @@ void jsvClearEmptyVarList() {
   assert(!isMemoryBusy);
   isMemoryBusy = MEMBUSY_SYSTEM;
   jsVarFirstEmpty = 0;
+#ifdef JSV_FREE_BITMAP
+  jsvFreeBitmapReset();
+#endif
   JsVarRef i;
   for (i=1;i<=jsVarsSize;i++) {
     JsVar *var = jsvGetAddressOf(i);
     if ((var->flags&JSV_VARTYPEMASK) == JSV_UNUSED) {
       // completely zero it (JSV_UNUSED==0, so it still stays the same)
       memset((void*)var,0,sizeof(JsVar));
-    } else if (jsvIsFlatString(var)) {
+    } else {
+#ifdef JSV_GC_GREY_STACK_SIZE
+      // forget about any incremental garbage collection
+      var->flags &= (JsVarFlags)~JSV_GARBAGE_COLLECT;
+#endif
       // skip over used blocks for flat strings
-      i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
+      if (jsvIsFlatString(var))
+        i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
     }
   }
+#ifdef JSV_GC_GREY_STACK_SIZE
+  jsvGarbageCollectReset();
+#endif
   isMemoryBusy = MEM_NOT_BUSY;
 }
 
 void jsvSoftInit() {
   jsvCreateEmptyVarList();
+#ifdef JSV_STRING_TAIL_CACHE_SIZE
+  jsvStringTailCacheForgetAll();
+#endif
+#ifdef JSV_STRING_SKIP_INDEX_SIZE
+  jsvStringSkipIndexForgetAll();
+#endif
 }
 
 void jsvSoftKill() {
@@ -250,6 +389,10 @@ static JsVarRef jsvInitJsVars(JsVarRef start, unsigned int count) {
     v->flags = JSV_UNUSED;
     // v->locks = 0; // locks is 0 anyway because it is stored in flags
     jsvSetNextSibling(v, (JsVarRef)(i+1)); // link to next
+#ifdef JSV_FREE_BITMAP
+    jsvSetPrevSibling(v, (i>start) ? (JsVarRef)(i-1) : 0);
+    jsvFreeBitmapSet(i);
+#endif
   }
   jsvSetNextSibling(jsvGetAddressOf((JsVarRef)(start+count-1)), (JsVarRef)0); // set the final one to 0
   return start;
@@ -261,14 +404,28 @@ void jsvInit(unsigned int size) {
   jsVarsSize = JSVAR_BLOCK_SIZE;
   jsVarBlocks = malloc(sizeof(JsVar*)); // just 1
   jsVarBlocks[0] = malloc(sizeof(JsVar) * JSVAR_BLOCK_SIZE);
+  jsVarBlockOrder = malloc(sizeof(unsigned int));
+  jsVarBlockOrder[0] = 0;
+#ifdef JSV_FREE_BITMAP
+  jsvFreeBitmap = malloc(sizeof(uint32_t) * (JSVAR_BLOCK_SIZE>>5));
+#endif
 #elif defined(JSVAR_MALLOC)
   if (size) jsVarsSize = size;
   if(!jsVars) jsVars = (JsVar *)malloc(sizeof(JsVar) * jsVarsSize);
+#ifdef JSV_FREE_BITMAP
+  if (!jsvFreeBitmap) jsvFreeBitmap = (uint32_t *)malloc(sizeof(uint32_t) * ((jsVarsSize+31)>>5));
+#endif
 #else
   assert(size==0);
 #endif
+#ifdef JSV_FREE_BITMAP
+  jsvFreeBitmapReset();
+#endif
 
   jsVarFirstEmpty = jsvInitJsVars(1/*first*/, jsVarsSize);
+#ifdef JSV_GC_GREY_STACK_SIZE
+  jsvGarbageCollectReset();
+#endif
   jsvSoftInit();
 }
 
@@ -279,6 +436,12 @@ void jsvKill() {
     free(jsVarBlocks[i]);
   free(jsVarBlocks);
   jsVarBlocks = 0;
+  free(jsVarBlockOrder);
+  jsVarBlockOrder = 0;
+#ifdef JSV_FREE_BITMAP
+  free(jsvFreeBitmap);
+  jsvFreeBitmap = 0;
+#endif
   jsVarsSize = 0;
 #endif
 }
@@ -330,10 +493,23 @@ void jsvSetMemoryTotal(unsigned int jsNewVarCount) {
   jsVarsSize = newBlockCount << JSVAR_BLOCK_SHIFT;
   // resize block table
   jsVarBlocks = realloc(jsVarBlocks, sizeof(JsVar*)*newBlockCount);
+  jsVarBlockOrder = realloc(jsVarBlockOrder, sizeof(unsigned int)*newBlockCount);
   // allocate more blocks
   unsigned int i;
-  for (i=oldBlockCount;i<newBlockCount;i++)
+  for (i=oldBlockCount;i<newBlockCount;i++) {
     jsVarBlocks[i] = malloc(sizeof(JsVar) * JSVAR_BLOCK_SIZE);
+    // insert into jsVarBlockOrder, keeping it sorted by address
+    unsigned int j = i;
+    while (j>0 && jsVarBlocks[jsVarBlockOrder[j-1]] > jsVarBlocks[i]) {
+      jsVarBlockOrder[j] = jsVarBlockOrder[j-1];
+      j--;
+    }
+    jsVarBlockOrder[j] = i;
+  }
+#ifdef JSV_FREE_BITMAP
+  jsvFreeBitmap = realloc(jsvFreeBitmap, sizeof(uint32_t) * (jsVarsSize>>5));
+  memset(&jsvFreeBitmap[oldSize>>5], 0, sizeof(uint32_t) * ((jsVarsSize-oldSize)>>5));
+#endif
   /** and now reset all the newly allocated vars. We know jsVarFirstEmpty
    * is 0 (because jsiFreeMoreMemory returned 0) so we can just assign it.  */
   assert(!jsVarFirstEmpty);
@@ -347,6 +523,79 @@ void jsvSetMemoryTotal(unsigned int jsNewVarCount) {
 #endif
 }
 
+#ifdef RESIZABLE_JSVARS
+/** If blocks at the end of memory are completely unused and we have a lot
+ * more memory than we're using, free them. Only blocks at the end can be freed,
+ * as a variable's JsVarRef says which block it is in */
+static void jsvShrinkMemory() {
+  unsigned int blockCount = jsVarsSize >> JSVAR_BLOCK_SHIFT;
+  if (isMemoryBusy || blockCount<=1) return;
+#ifdef JSV_GC_GREY_STACK_SIZE
+  if (jsvGCPhase!=JSV_GC_IDLE) return; // the incremental garbage collector has references to variables
+#endif
+  // quick check - if we're using over half our memory we can't give any back
+  if (!jsvMoreFreeVariablesThan((jsVarsSize+JSVAR_BLOCK_SIZE)/2)) return;
+  unsigned int usage = 0;
+  JsVarRef i, lastUsed = 0;
+  for (i=1;i<=jsVarsSize;i++) {
+    JsVar *var = jsvGetAddressOf(i);
+    if ((var->flags&JSV_VARTYPEMASK) != JSV_UNUSED) {
+      if (jsvIsFlatString(var)) {
+        unsigned int b = (unsigned int)jsvGetFlatStringBlocks(var);
+        i+=b;
+        usage+=b;
+      }
+      usage++;
+      lastUsed = i;
+    }
+  }
+  // keep twice what we're using, so we don't end up growing again straight away
+  unsigned int newBlockCount = (usage*2+JSVAR_BLOCK_SIZE-1) >> JSVAR_BLOCK_SHIFT;
+  if (newBlockCount < ((lastUsed+JSVAR_BLOCK_SIZE-1) >> JSVAR_BLOCK_SHIFT))
+    newBlockCount = (lastUsed+JSVAR_BLOCK_SIZE-1) >> JSVAR_BLOCK_SHIFT;
+  if (newBlockCount<1) newBlockCount = 1;
+  if (newBlockCount >= blockCount) return;
+  isMemoryBusy = MEMBUSY_SYSTEM;
+  for (i=newBlockCount;i<blockCount;i++)
+    free(jsVarBlocks[i]);
+  // remove the freed blocks from jsVarBlockOrder
+  unsigned int j = 0;
+  for (i=0;i<blockCount;i++)
+    if (jsVarBlockOrder[i] < newBlockCount)
+      jsVarBlockOrder[j++] = jsVarBlockOrder[i];
+  jsVarsSize = newBlockCount << JSVAR_BLOCK_SHIFT;
+  jsVarBlocks = realloc(jsVarBlocks, sizeof(JsVar*)*newBlockCount);
+  jsVarBlockOrder = realloc(jsVarBlockOrder, sizeof(unsigned int)*newBlockCount);
+#ifdef JSV_FREE_BITMAP
+  jsvFreeBitmap = realloc(jsvFreeBitmap, sizeof(uint32_t) * (jsVarsSize>>5));
+#endif
+  // jsiConsolePrintf("Resized memory from %d blocks to %d\n", blockCount, newBlockCount);
+  isMemoryBusy = MEM_NOT_BUSY;
+  // the free list had the variables we just freed in it
+  jsvCreateEmptyVarList();
+  touchedFreeList = true;
+#ifndef SAVE_ON_FLASH
+  jspCachesForget();
+#endif
+#ifdef JSV_STRING_TAIL_CACHE_SIZE
+  jsvStringTailCacheForgetAll();
+#endif
+#ifdef JSV_STRING_SKIP_INDEX_SIZE
+  jsvStringSkipIndexForgetAll();
+#endif
+}
+
+/// Has memory been allocated or freed since the last garbage collection, so that it may be worth trying to free some memory?
+bool jsvShrinkMemoryWanted() {
+#ifdef JSV_GC_GREY_STACK_SIZE
+  return jsVarsSize > JSVAR_BLOCK_SIZE &&
+         (jsvGCGrowth >= (int)(jsVarsSize/4) || jsvGCGrowth <= -(int)(jsVarsSize/4));
+#else
+  return false;
+#endif
+}
+#endif
+
 bool jsvMoreFreeVariablesThan(unsigned int vars) {
   if (!vars) return false;
   JsVarRef r = jsVarFirstEmpty;
@@ -464,6 +713,10 @@ void jsvResetVariable(JsVar *v, JsVarFlags flags) {
     ((uint32_t*)v)[i] = 0;
   // set flags
   assert(!(flags & JSV_LOCK_MASK));
+#ifdef JSV_GC_GREY_STACK_SIZE
+  // new variables are in use as far as any incremental garbage collection is concerned
+  flags = (flags & (JsVarFlags)~JSV_GARBAGE_COLLECT) | jsvGCBlack;
+#endif
   v->flags = flags | JSV_LOCK_ONE;
 }
 
@@ -475,8 +728,14 @@ JsVar *jsvNewWithFlags(JsVarFlags flags) {
   JsVar *v = 0;
   jshInterruptOff(); // to allow this to be used from an IRQ
   if (jsVarFirstEmpty!=0) {
+#ifdef JSV_FREE_BITMAP
+    jsvFreeBitmapClear(jsVarFirstEmpty);
+#endif
     v = jsvGetAddressOf(jsVarFirstEmpty); // jsvResetVariable will lock
     jsVarFirstEmpty = jsvGetNextSibling(v); // move our reference to the next in the fr
+#ifdef JSV_FREE_BITMAP
+    if (jsVarFirstEmpty) jsvSetPrevSibling(jsvGetAddressOf(jsVarFirstEmpty), 0);
+#endif
     touchedFreeList = true;
   }
   jshInterruptOn();
@@ -494,6 +753,9 @@ JsVar *jsvNewWithFlags(JsVarFlags flags) {
     } while (!__sync_bool_compare_and_swap(&jsVarFirstEmpty, empty, next));
     assert(v->flags == JSV_UNUSED);*/
     jsvResetVariable(v, flags); // setup variable, and add one lock
+#ifdef JSV_GC_GREY_STACK_SIZE
+    jsvGCGrowth++;
+#endif
     // return pointer
     return v;
   }
@@ -529,13 +791,36 @@ static NO_INLINE void jsvFreePtrInternal(JsVar *var) {
   var->flags = JSV_UNUSED;
   // add this to our free list
   jshInterruptOff(); // to allow this to be used from an IRQ
+  JsVarRef ref = jsvGetRef(var);
   jsvSetNextSibling(var, jsVarFirstEmpty);
-  jsVarFirstEmpty = jsvGetRef(var);
+#ifdef JSV_FREE_BITMAP
+  jsvSetPrevSibling(var, 0);
+  if (jsVarFirstEmpty) jsvSetPrevSibling(jsvGetAddressOf(jsVarFirstEmpty), ref);
+  jsvFreeBitmapSet(ref);
+#endif
+  jsVarFirstEmpty = ref;
   touchedFreeList = true;
   jshInterruptOn();
+#ifdef JSV_GC_GREY_STACK_SIZE
+  jsvGCGrowth--;
+#endif
 }
 
 ALWAYS_INLINE void jsvFreePtr(JsVar *var) {
+#ifdef JSV_OBJECT_INDEX_MIN_CHILDREN
+  if (jsvGetObjectIndex(var)) { // free the index of the object's children
+    JsVarRef index = jsvGetNextSibling(var);
+    jsvSetNextSibling(var, 0);
+    jsvUnRefRef(index);
+  }
+#endif
+#ifdef JSV_ARRAY_INDEX_MIN_LENGTH
+  if (jsvGetArrayIndexTable(var)) { // free the table of the array's elements
+    JsVarRef table = jsvGetNextSibling(var);
+    jsvSetNextSibling(var, 0);
+    jsvUnRefRef(table);
+  }
+#endif
   /* To be here, we're not supposed to be part of anything else. If
    * we were, we'd have been freed by jsvGarbageCollect */
   assert((!jsvGetNextSibling(var) && !jsvGetPrevSibling(var)) || // check that next/prevSibling are not set
@@ -564,6 +849,12 @@ ALWAYS_INLINE void jsvFreePtr(JsVar *var) {
   if (jsvHasStringExt(var)) {
     // Free the string without recursing
     JsVarRef stringDataRef = jsvGetLastChild(var);
+#ifdef JSV_STRING_TAIL_CACHE_SIZE
+    if (stringDataRef) jsvStringTailCacheForget(var);
+#endif
+#ifdef JSV_STRING_SKIP_INDEX_SIZE
+    if (stringDataRef) jsvStringSkipIndexForget(var);
+#endif
 #ifdef CLEAR_MEMORY_ON_FREE
     jsvSetLastChild(var, 0);
 #endif // CLEAR_MEMORY_ON_FREE
@@ -595,6 +886,10 @@ ALWAYS_INLINE void jsvFreePtr(JsVar *var) {
     can be ints or strings */
 
   if (jsvHasChildren(var)) {
+#ifdef JSP_INLINE_CACHE_SIZE
+    if (jspInlineCacheObjects & JSP_INLINE_CACHE_OBJECT_BIT(jsvGetRef(var)))
+      jspInlineCacheForget(jsvGetRef(var));
+#endif
     JsVarRef childref = jsvGetFirstChild(var);
 #ifdef CLEAR_MEMORY_ON_FREE
     jsvSetFirstChild(var, 0);
@@ -636,13 +931,15 @@ ALWAYS_INLINE void jsvFreePtr(JsVar *var) {
 ALWAYS_INLINE JsVarRef jsvGetRef(JsVar *var) {
   if (!var) return 0;
 #ifdef RESIZABLE_JSVARS
-  unsigned int i, c = jsVarsSize>>JSVAR_BLOCK_SHIFT;
-  for (i=0;i<c;i++) {
-    if (var>=jsVarBlocks[i] && var<&jsVarBlocks[i][JSVAR_BLOCK_SIZE]) {
-      JsVarRef r = (JsVarRef)(1 + (i<<JSVAR_BLOCK_SHIFT) + (var - jsVarBlocks[i]));
-      return r;
-    }
-  }
+  unsigned int lo = 0, hi = jsVarsSize>>JSVAR_BLOCK_SHIFT;
+  while (hi-lo > 1) {
+    unsigned int mid = (lo+hi)>>1;
+    if (var < jsVarBlocks[jsVarBlockOrder[mid]]) hi = mid;
+    else lo = mid;
+  }
+  unsigned int i = jsVarBlockOrder[lo];
+  if (var>=jsVarBlocks[i] && var<&jsVarBlocks[i][JSVAR_BLOCK_SIZE])
+    return (JsVarRef)(1 + (i<<JSVAR_BLOCK_SHIFT) + (var - jsVarBlocks[i]));
   return 0;
 #else
   return (JsVarRef)(1 + (var - jsVars));
@@ -655,6 +952,9 @@ ALWAYS_INLINE JsVar *jsvLock(JsVarRef ref) {
   //var->locks++;
   assert(jsvGetLocks(var) < JSV_LOCK_MAX);
   var->flags += JSV_LOCK_ONE;
+#ifdef JSV_GC_GREY_STACK_SIZE
+  if (jsvGCPhase==JSV_GC_MARK) jsvGarbageCollectShade(var); // locked vars are in use
+#endif
 #ifdef DEBUG
   if (jsvGetLocks(var)==0) {
     jsError("Too many locks to Variable!");
@@ -675,6 +975,9 @@ ALWAYS_INLINE JsVar *jsvLockAgain(JsVar *var) {
   assert(var);
   assert(jsvGetLocks(var) < JSV_LOCK_MAX);
   var->flags += JSV_LOCK_ONE;
+#ifdef JSV_GC_GREY_STACK_SIZE
+  if (jsvGCPhase==JSV_GC_MARK) jsvGarbageCollectShade(var);
+#endif
   return var;
 }
 
@@ -736,6 +1039,10 @@ NO_INLINE void jsvUnLockMany(unsigned int count, JsVar **vars) {
 JsVar *jsvRef(JsVar *var) {
   assert(var && jsvHasRef(var));
   jsvSetRefs(var, (JsVarRefCounter)(jsvGetRefs(var)+1));
+#ifdef JSV_GC_GREY_STACK_SIZE
+  // write barrier - whatever now references this could already have been marked
+  if (jsvGCPhase==JSV_GC_MARK) jsvGarbageCollectShade(var);
+#endif
   assert(jsvGetRefs(var));
   return var;
 }
@@ -770,6 +1077,9 @@ JsVarRef jsvUnRefRef(JsVarRef ref) {
 
 JsVar *jsvNewFlatStringOfLength(unsigned int byteLength) {
   bool firstRun = true;
+#ifndef SAVE_ON_FLASH
+  bool defragmented = false;
+#endif
   // Work out how many blocks we need. One for the header, plus some for the characters
   size_t requiredBlocks = 1 + ((byteLength+sizeof(JsVar)-1) / sizeof(JsVar));
   JsVar *flatString = 0;
@@ -778,6 +1088,30 @@ JsVar *jsvNewFlatStringOfLength(unsigned int byteLength) {
     return 0;
   }
   while (true) {
+#ifdef JSV_FREE_BITMAP
+    /* Find a run of 'requiredBlocks' free variables in the bitmap, and take
+    them out of the free list. An IRQ could allocate variables while we're
+    searching, so check they're still free once interrupts are off */
+    bool memoryTouched = true;
+    while (memoryTouched) {
+      memoryTouched = false;
+      JsVarRef startBlock = jsvFreeBitmapFindRun((unsigned int)requiredBlocks);
+      if (!startBlock) break;
+      JsVarRef endBlock = (JsVarRef)(startBlock+requiredBlocks);
+      JsVarRef i;
+      jshInterruptOff();
+      for (i=startBlock;i<endBlock && jsvFreeBitmapGet(i);i++);
+      if (i==endBlock) {
+        for (i=startBlock;i<endBlock;i++)
+          jsvFreeListRemove(i);
+        flatString = jsvGetAddressOf(startBlock);
+        // Set up the header block (including one lock)
+        jsvResetVariable(flatString, JSV_FLAT_STRING);
+        flatString->varData.integer = (JsVarInt)byteLength;
+      } else memoryTouched = true;
+      jshInterruptOn();
+    }
+#else
     /* Now try and find a contiguous set of 'requiredBlocks' blocks by
     searching the free list. This can be done as long as nobody's
     messed with the free list in the mean time (which we check for with
@@ -833,17 +1167,30 @@ JsVar *jsvNewFlatStringOfLength(unsigned int byteLength) {
         memoryTouched = true;
       }
     }
+#endif
 
     // all good
-    if (flatString || !firstRun)
-      break;
-    /* Nope... we couldn't find a free string. It could be because
-     * the free list is fragmented, so GCing might well fix it - which
-     * we'll try - but only ONCE */
-    firstRun = false;
-    jsvGarbageCollect();
+    if (flatString) break;
+    if (firstRun) {
+      /* Nope... we couldn't find a free string. It could be because
+       * the free list is fragmented, so GCing might well fix it - which
+       * we'll try - but only ONCE */
+      firstRun = false;
+      jsvGarbageCollect();
+#ifndef SAVE_ON_FLASH
+    } else if (!defragmented && !jshIsInInterrupt() && jsvMoreFreeVariablesThan((unsigned int)requiredBlocks)) {
+      /* There are enough free variables, they're just not next to each
+       * other - so move variables so they are, and try again */
+      defragmented = true;
+      if (!jsvDefragment()) break;
+#endif
+    } else break;
   };
   if (!flatString) return 0;
+#ifdef JSV_GC_GREY_STACK_SIZE
+  jsvGarbageCollectFlatStringAllocated(jsvGetRef(flatString), (unsigned int)requiredBlocks);
+  jsvGCGrowth += (int)requiredBlocks;
+#endif
   /* We now have the string! All that's left is to clear it */
   // clear data
   memset((char*)&flatString[1], 0, sizeof(JsVar)*(requiredBlocks-1));
@@ -1064,6 +1411,12 @@ JsVar *jsvMakeIntoVariableName(JsVar *var, JsVar *valueOrZero) {
       }
       jsvSetCharactersInVar(var, JSVAR_DATA_STRING_NAME_LEN);
       // Free any old stringexts
+#ifdef JSV_STRING_TAIL_CACHE_SIZE
+      jsvStringTailCacheForget(var);
+#endif
+#ifdef JSV_STRING_SKIP_INDEX_SIZE
+      jsvStringSkipIndexForget(var);
+#endif
       JsVarRef oldRef = jsvGetLastChild(var);
       while (oldRef) {
         JsVar *v = jsvGetAddressOf(oldRef);
@@ -1441,14 +1794,155 @@ bool jsvIsEmptyString(JsVar *v) {
   return jsvGetCharactersInVar(v)==0;
 }
 
+#ifdef JSV_STRING_TAIL_CACHE_SIZE
+/* Walking a long string's StringExts to find the end makes appending to it
+ * O(n), so we remember the last StringExt of a few strings. As StringExts
+ * are only ever added to the end of a string, the one we remember is still
+ * in the string and we just walk forwards from it. Entries are forgotten
+ * when the string is freed or changed into a name, and when variables are
+ * garbage collected or moved. */
+#define JSV_STRING_TAIL_CACHE_MIN_INDEX 64 ///< Strings shorter than this are quick to walk anyway
+
+typedef struct {
+  JsVarRef str; ///< The string (or 0)
+  JsVarRef last; ///< A StringExt near the end of it
+  size_t lastIndex; ///< The index in 'str' of the first character in 'last'
+} JsvStringTailCacheEntry;
+
+static JsvStringTailCacheEntry jsvStringTailCache[JSV_STRING_TAIL_CACHE_SIZE];
+
+JsVarRef jsvStringTailCacheGet(const JsVar *str, size_t *lastIndex) {
+  JsVarRef ref = jsvGetRef((JsVar*)str);
+  JsvStringTailCacheEntry *e = &jsvStringTailCache[ref & (JSV_STRING_TAIL_CACHE_SIZE-1)];
+  if (e->str!=ref) return 0;
+  *lastIndex = e->lastIndex;
+  return e->last;
+}
+
+void jsvStringTailCacheSet(const JsVar *str, JsVar *last, size_t lastIndex) {
+  if (lastIndex < JSV_STRING_TAIL_CACHE_MIN_INDEX) return;
+  JsVarRef ref = jsvGetRef((JsVar*)str);
+  JsvStringTailCacheEntry *e = &jsvStringTailCache[ref & (JSV_STRING_TAIL_CACHE_SIZE-1)];
+  e->str = ref;
+  e->last = jsvGetRef(last);
+  e->lastIndex = lastIndex;
+}
+
+/// The StringExts of 'str' are about to be freed
+static void jsvStringTailCacheForget(JsVar *str) {
+  JsVarRef ref = jsvGetRef(str);
+  JsvStringTailCacheEntry *e = &jsvStringTailCache[ref & (JSV_STRING_TAIL_CACHE_SIZE-1)];
+  if (e->str==ref) e->str = 0;
+}
+
+void jsvStringTailCacheForgetAll() {
+  memset(jsvStringTailCache, 0, sizeof(jsvStringTailCache));
+}
+#endif
+
+#ifdef JSV_STRING_SKIP_INDEX_SIZE
+/* Seeking to a character in a long string means walking its StringExts from
+ * the start, so indexing into one in a loop is O(n^2). For a few long strings
+ * we remember StringExts spaced out along the string, found while walking it.
+ * When we run out of room we drop every other one and space them out twice as
+ * far, so seeking costs O(n/JSV_STRING_SKIP_INDEX_POINTS). Like the tail cache
+ * this relies on StringExts only being added to the end of a string, and is
+ * forgotten at the same times. */
+#define JSV_STRING_SKIP_INDEX_MIN_INDEX 256 ///< Don't bother indexing strings until we're seeking this far into them
+#define JSV_STRING_SKIP_INDEX_POINTS 16 ///< How many StringExts we remember for each string
+#define JSV_STRING_SKIP_INDEX_SPACING 64 ///< Initial number of characters between each StringExt we remember
+
+typedef struct {
+  JsVarRef str; ///< The string (or 0)
+  unsigned char count; ///< How many StringExts we remember
+  size_t spacing; ///< How many characters there should be between StringExts we remember
+  size_t nextIndex; ///< The index in 'str' of the next StringExt we'd like to remember
+  JsVarRef ext[JSV_STRING_SKIP_INDEX_POINTS]; ///< StringExts of 'str'
+  size_t extIndex[JSV_STRING_SKIP_INDEX_POINTS]; ///< The index in 'str' of the first character in each of 'ext'
+} JsvStringSkipIndexEntry;
+
+static JsvStringSkipIndexEntry jsvStringSkipIndex[JSV_STRING_SKIP_INDEX_SIZE];
+
+JsVarRef jsvStringSkipIndexGet(const JsVar *str, size_t idx, size_t *extIndex) {
+  if (idx < JSV_STRING_SKIP_INDEX_MIN_INDEX) return 0;
+  JsVarRef ref = jsvGetRef((JsVar*)str);
+  JsvStringSkipIndexEntry *e = &jsvStringSkipIndex[ref & (JSV_STRING_SKIP_INDEX_SIZE-1)];
+  if (e->str!=ref) {
+    // start indexing this string - it'll be filled in as it's walked
+    e->str = ref;
+    e->count = 0;
+    e->spacing = JSV_STRING_SKIP_INDEX_SPACING;
+    e->nextIndex = JSV_STRING_SKIP_INDEX_SPACING;
+    return 0;
+  }
+  // find the last StringExt that starts at or before idx
+  int lo = 0, hi = e->count;
+  while (lo < hi) {
+    int mid = (lo+hi) >> 1;
+    if (e->extIndex[mid] <= idx) lo = mid+1;
+    else hi = mid;
+  }
+  if (!lo) return 0;
+  *extIndex = e->extIndex[lo-1];
+  return e->ext[lo-1];
+}
+
+void jsvStringSkipIndexAdd(const JsVar *str, JsVar *ext, size_t extIndex) {
+  JsVarRef ref = jsvGetRef((JsVar*)str);
+  JsvStringSkipIndexEntry *e = &jsvStringSkipIndex[ref & (JSV_STRING_SKIP_INDEX_SIZE-1)];
+  if (e->str!=ref || extIndex < e->nextIndex) return;
+  if (e->count == JSV_STRING_SKIP_INDEX_POINTS) {
+    // out of room - keep every other one, and space them out more
+    unsigned char i;
+    for (i=0;i<JSV_STRING_SKIP_INDEX_POINTS/2;i++) {
+      e->ext[i] = e->ext[i*2+1];
+      e->extIndex[i] = e->extIndex[i*2+1];
+    }
+    e->count = JSV_STRING_SKIP_INDEX_POINTS/2;
+    e->spacing *= 2;
+    if (extIndex < e->extIndex[e->count-1] + e->spacing) {
+      e->nextIndex = e->extIndex[e->count-1] + e->spacing;
+      return;
+    }
+  }
+  e->ext[e->count] = jsvGetRef(ext);
+  e->extIndex[e->count] = extIndex;
+  e->count++;
+  e->nextIndex = extIndex + e->spacing;
+}
+
+/// The StringExts of 'str' are about to be freed
+static void jsvStringSkipIndexForget(JsVar *str) {
+  JsVarRef ref = jsvGetRef(str);
+  JsvStringSkipIndexEntry *e = &jsvStringSkipIndex[ref & (JSV_STRING_SKIP_INDEX_SIZE-1)];
+  if (e->str==ref) e->str = 0;
+}
+
+void jsvStringSkipIndexForgetAll() {
+  unsigned int i;
+  for (i=0;i<JSV_STRING_SKIP_INDEX_SIZE;i++)
+    jsvStringSkipIndex[i].str = 0;
+}
+#endif
+
 size_t jsvGetStringLength(const JsVar *v) {
   size_t strLength = 0;
   const JsVar *var = v;
   JsVar *newVar = 0;
   if (!jsvHasCharacterData(v)) return 0;
+#ifdef JSV_STRING_TAIL_CACHE_SIZE
+  if (jsvGetLastChild(v)) {
+    // start from near the end if we can
+    JsVarRef last = jsvStringTailCacheGet(v, &strLength);
+    if (last) var = newVar = jsvLock(last);
+  }
+#endif
 
   while (var) {
     JsVarRef ref = jsvGetLastChild(var);
+#ifdef JSV_STRING_TAIL_CACHE_SIZE
+    if (!ref && var!=v) jsvStringTailCacheSet(v, (JsVar*)var, strLength);
+#endif
     strLength += jsvGetCharactersInVar(var);
 
     // Go to next
@@ -1607,13 +2101,7 @@ void jsvAppendStringBuf(JsVar *var, const char *str, size_t length) {
   JsvStringIterator dst;
   jsvStringIteratorNew(&dst, var, 0);
   jsvStringIteratorGotoEnd(&dst);
-  // now start appending
-  /* This isn't as fast as something single-purpose, but it's not that bad,
-   * and is less likely to break :) */
-  while (length) {
-    jsvStringIteratorAppend(&dst, *(str++));
-    length--;
-  }
+  jsvStringIteratorAppendBuf(&dst, str, length);
   jsvStringIteratorFree(&dst);
 }
 
@@ -1708,16 +2196,9 @@ void jsvSetCharInString(JsVar *v, size_t idx, char ch, bool bitwiseOR) {
 int jsvGetStringIndexOf(JsVar *str, char ch) {
   JsvStringIterator it;
   jsvStringIteratorNew(&it, str, 0);
-  while (jsvStringIteratorHasChar(&it)) {
-    if (jsvStringIteratorGetChar(&it) == ch) {
-      int idx = (int)jsvStringIteratorGetIndex(&it);
-      jsvStringIteratorFree(&it);
-      return idx;
-    };
-    jsvStringIteratorNext(&it);
-  }
+  int idx = jsvStringIteratorFindChar(&it, ch) ? (int)jsvStringIteratorGetIndex(&it) : -1;
   jsvStringIteratorFree(&it);
-  return -1;
+  return idx;
 }
 
 /** Does this string contain only Numeric characters (with optional '-'/'+' at the front)? NOT '.'/'e' and similar (allowDecimalPoint is for '.' only) */
@@ -2424,11 +2905,19 @@ JsVar *jsvCopy(JsVar *src, bool copyChildren) {
         jsvSetFirstChild(dst, jsvGetFirstChild(src));
       } else {
         JsVar *child = jsvLock(jsvGetFirstChild(src));
-        JsVar *childCopy = jsvRef(jsvCopy(child, true));
-        jsvUnLock(child);
-        if (childCopy) { // could have been out of memory
-          jsvSetFirstChild(dst, jsvGetRef(childCopy));
-          jsvUnLock(childCopy);
+        if (jsvIsString(child) && !jsvIsName(child)) {
+          /* Strings can't be changed from JS - anything that would change
+           * one in place (eg. string +=) checks it has only one reference
+           * and copies it otherwise - so we can just share it */
+          jsvSetFirstChild(dst, jsvGetRef(jsvRef(child)));
+          jsvUnLock(child);
+        } else {
+          JsVar *childCopy = jsvRef(jsvCopy(child, true));
+          jsvUnLock(child);
+          if (childCopy) { // could have been out of memory
+            jsvSetFirstChild(dst, jsvGetRef(childCopy));
+            jsvUnLock(childCopy);
+          }
         }
       }
     }
@@ -2483,9 +2972,308 @@ JsVar *jsvCopy(JsVar *src, bool copyChildren) {
   return dst;
 }
 
+/* Looking up a name. Names are zero padded, and most fit in the name's own
+ * JsVar - so rather than iterating over the characters of every child, we
+ * compare the number of characters (which is in the name's flags) and the
+ * first JSVAR_DATA_STRING_NAME_LEN bytes, and only look at StringExts if
+ * the name is longer than that. */
+typedef struct {
+  char str[JSVAR_DATA_STRING_NAME_LEN]; ///< The first characters of the name, zero padded
+  JsVarFlags type; ///< What a matching JSV_NAME_STRING_x would have in its flags
+  const char *name; ///< The whole name (if it doesn't fit in 'str')
+} JsvNameKey;
+
+static ALWAYS_INLINE void jsvNameKeyNew(JsvNameKey *key, const char *name) {
+  size_t i = 0;
+  while (i<JSVAR_DATA_STRING_NAME_LEN && name[i]) {
+    key->str[i] = name[i];
+    i++;
+  }
+  memset(&key->str[i], 0, JSVAR_DATA_STRING_NAME_LEN-i);
+  key->type = (JsVarFlags)(JSV_NAME_STRING_0 + i);
+  key->name = name[i] ? name : 0;
+}
+
+/// Set up 'key' from a short string variable - returns false if it isn't one (so jsvIsBasicVarEqual must be used)
+static ALWAYS_INLINE bool jsvNameKeyNewFromVar(JsvNameKey *key, JsVar *name) {
+  if (!jsvIsString(name) || jsvIsFlatString(name) || jsvIsNativeString(name) || jsvGetLastChild(name))
+    return false;
+  size_t chars = jsvGetCharactersInVar(name);
+  if (chars > JSVAR_DATA_STRING_NAME_LEN) return false;
+  memcpy(key->str, name->varData.str, chars);
+  memset(&key->str[chars], 0, JSVAR_DATA_STRING_NAME_LEN-chars);
+  key->type = (JsVarFlags)(JSV_NAME_STRING_0 + chars);
+  key->name = 0;
+  return true;
+}
+
+/// Is this child of an object the name in 'key'?
+static ALWAYS_INLINE bool jsvNameKeyEqual(const JsvNameKey *key, JsVar *child) {
+  JsVarFlags t = child->flags & JSV_VARTYPEMASK;
+  if (t!=key->type && t!=key->type-(JSV_NAME_STRING_0-JSV_NAME_STRING_INT_0)) return false;
+  if (memcmp(child->varData.str, key->str, JSVAR_DATA_STRING_NAME_LEN)) return false;
+  if (!jsvGetLastChild(child)) return !key->name;
+  return key->name && jsvIsStringEqualOrStartsWithOffset(child, &key->name[JSVAR_DATA_STRING_NAME_LEN], false, JSVAR_DATA_STRING_NAME_LEN, false);
+}
+
+#ifdef JSV_OBJECT_INDEX_MIN_CHILDREN
+/* Objects with lots of children can have an index, which is a flat string
+ * referenced from the object's nextSibling (which is otherwise unused for objects).
+ * The flat string is an array of JsVarRefs: the first is the number of names in
+ * the index, and the rest are a hash table (with linear probing) of the refs of
+ * all the object's children that are strings. Children that aren't strings (eg.
+ * integers) are never found when looking up a string, so aren't included. */
+
+/// Hash a string (FNV-1a) for the object index
+static uint32_t jsvObjectIndexHash(JsVar *str) {
+  uint32_t hash = 2166136261u;
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, str, 0);
+  while (jsvStringIteratorHasChar(&it)) {
+    hash = (hash ^ (unsigned char)jsvStringIteratorGetChar(&it)) * 16777619u;
+    jsvStringIteratorNext(&it);
+  }
+  jsvStringIteratorFree(&it);
+  return hash;
+}
+
+/// Hash a string (FNV-1a) for the object index - this must match jsvObjectIndexHash
+static uint32_t jsvObjectIndexHashCStr(const char *str) {
+  uint32_t hash = 2166136261u;
+  while (*str)
+    hash = (hash ^ (unsigned char)*(str++)) * 16777619u;
+  return hash;
+}
+
+/// Get the number of slots in the index's hash table (always a power of 2)
+static unsigned int jsvObjectIndexCapacity(JsVar *index) {
+  return (unsigned int)(jsvGetCharactersInVar(index) / sizeof(JsVarRef)) - 1;
+}
+
+/// Add a name to the index (which must have space)
+static void jsvObjectIndexInsert(JsVarRef *slots, unsigned int mask, JsVar *name) {
+  unsigned int i = jsvObjectIndexHash(name) & mask;
+  while (slots[1+i]) i = (i+1) & mask;
+  slots[1+i] = jsvGetRef(name);
+  slots[0]++;
+}
+
+/// (Re)build the index of an object's children, or remove it if there's not enough memory
+static void jsvObjectIndexBuild(JsVar *parent) {
+  assert(jsvIsObject(parent));
+  unsigned int count = 0;
+  JsVarRef childref = jsvGetFirstChild(parent);
+  while (childref) {
+    JsVar *child = jsvGetAddressOf(childref);
+    if (jsvIsString(child)) count++;
+    childref = jsvGetNextSibling(child);
+  }
+  // Keep the hash table no more than half full
+  unsigned int capacity = 16;
+  while (capacity < count*2) capacity <<= 1;
+  JsVar *index = jsvNewFlatStringOfLength((unsigned int)((capacity+1)*sizeof(JsVarRef)));
+  JsVarRef oldIndex = jsvGetNextSibling(parent);
+  jsvSetNextSibling(parent, 0);
+  if (oldIndex) jsvUnRefRef(oldIndex);
+  if (!index) return;
+  JsVarRef *slots = (JsVarRef*)jsvGetFlatStringPointer(index);
+  memset(slots, 0, (capacity+1)*sizeof(JsVarRef));
+  childref = jsvGetFirstChild(parent);
+  while (childref) {
+    JsVar *child = jsvGetAddressOf(childref);
+    if (jsvIsString(child)) jsvObjectIndexInsert(slots, capacity-1, child);
+    childref = jsvGetNextSibling(child);
+  }
+  jsvSetNextSibling(parent, jsvGetRef(jsvRef(index)));
+  jsvUnLock(index);
+}
+
+/// A name has been added to an object with an index - add it to the index too
+static void jsvObjectIndexAdd(JsVar *parent, JsVar *name) {
+  JsVar *index = jsvLock(jsvGetObjectIndex(parent));
+  unsigned int capacity = jsvObjectIndexCapacity(index);
+  JsVarRef *slots = (JsVarRef*)jsvGetFlatStringPointer(index);
+  if ((slots[0]+1)*2 > capacity) {
+    jsvUnLock(index);
+    jsvObjectIndexBuild(parent); // make a bigger one (this includes the new name)
+  } else {
+    jsvObjectIndexInsert(slots, capacity-1, name);
+    jsvUnLock(index);
+  }
+}
+
+/// A name has been removed from an object with an index - remove it from the index too
+static void jsvObjectIndexRemove(JsVar *parent, JsVar *name) {
+  JsVar *index = jsvLock(jsvGetObjectIndex(parent));
+  unsigned int mask = jsvObjectIndexCapacity(index)-1;
+  JsVarRef *slots = (JsVarRef*)jsvGetFlatStringPointer(index);
+  JsVarRef nameRef = jsvGetRef(name);
+  unsigned int i = jsvObjectIndexHash(name) & mask;
+  while (slots[1+i] && slots[1+i]!=nameRef) i = (i+1) & mask;
+  if (slots[1+i]) {
+    slots[0]--;
+    /* Remove it, then move back any names after it that wouldn't be found
+     * now there's a gap (so we don't need 'deleted' markers) */
+    unsigned int j = i;
+    while (true) {
+      j = (j+1) & mask;
+      if (!slots[1+j]) break;
+      unsigned int home = jsvObjectIndexHash(jsvGetAddressOf(slots[1+j])) & mask;
+      // move it if its home slot isn't cyclically in (i,j]
+      if ((i<=j) ? (home<=i || home>j) : (home<=i && home>j)) {
+        slots[1+i] = slots[1+j];
+        i = j;
+      }
+    }
+    slots[1+i] = 0;
+  }
+  jsvUnLock(index);
+}
+
+/// Search the object's index for a string child. Returns the (locked) name, or 0
+static JsVar *jsvObjectIndexFind(JsVar *parent, JsVar *nameVar, const char *name) {
+  JsVar *index = jsvGetAddressOf(jsvGetObjectIndex(parent));
+  unsigned int mask = jsvObjectIndexCapacity(index)-1;
+  JsVarRef *slots = (JsVarRef*)jsvGetFlatStringPointer(index);
+  unsigned int i = (nameVar ? jsvObjectIndexHash(nameVar) : jsvObjectIndexHashCStr(name)) & mask;
+  JsvNameKey key;
+  if (!nameVar) jsvNameKeyNew(&key, name);
+  while (slots[1+i]) {
+    JsVar *child = jsvGetAddressOf(slots[1+i]);
+    if (nameVar ? jsvIsBasicVarEqual(child, nameVar) : jsvNameKeyEqual(&key, child))
+      return jsvLockAgain(child);
+    i = (i+1) & mask;
+  }
+  return 0;
+}
+#endif
+
+#ifdef JSV_ARRAY_INDEX_MIN_LENGTH
+/* Arrays whose elements are exactly 0..length-1 (with no other children) can
+ * have a table of their elements, which is a flat string referenced from the
+ * array's nextSibling (which is otherwise unused for arrays). The flat string is
+ * an array of JsVarRefs: the first is the number of elements in the table, and
+ * element i's name is at 1+i. Adding or removing the last element keeps the
+ * table up to date - anything else just throws it away. Some array functions
+ * renumber elements in place, so every lookup checks the name it finds. */
+
+/// Remove the table of an array's elements
+static void jsvArrayIndexFree(JsVar *arr) {
+  JsVarRef table = jsvGetNextSibling(arr);
+  jsvSetNextSibling(arr, 0);
+  jsvUnRefRef(table);
+}
+
+/// Is 'name' the name of the element at 'index'? The table may refer to a var that has since been freed and reused
+static bool jsvArrayIndexIsElement(JsVar *name, JsVarInt index) {
+  return jsvIsName(name) && jsvIsInt(name) && name->varData.integer==index;
+}
+
+/// Get the number of elements the table has space for
+static unsigned int jsvArrayIndexCapacity(JsVar *table) {
+  return (unsigned int)(jsvGetCharactersInVar(table) / sizeof(JsVarRef)) - 1;
+}
+
+/// Build a table of the array's elements if they are dense, with space for 'capacity' elements
+static void jsvArrayIndexBuild(JsVar *arr, unsigned int capacity) {
+  JsVarInt length = jsvGetArrayLength(arr);
+  JsVarRef childref = jsvGetLastChild(arr);
+  // quick check - the last child must be the last element
+  if (!childref) return;
+  JsVar *child = jsvGetAddressOf(childref);
+  if (!jsvArrayIndexIsElement(child, length-1)) return;
+  // now check every element is there, in order
+  JsVarInt i = 0;
+  childref = jsvGetFirstChild(arr);
+  while (childref) {
+    child = jsvGetAddressOf(childref);
+    if (!jsvArrayIndexIsElement(child, i)) return;
+    i++;
+    childref = jsvGetNextSibling(child);
+  }
+  if ((JsVarInt)capacity < i) capacity = (unsigned int)i;
+  JsVar *table = jsvNewFlatStringOfLength((unsigned int)((capacity+1)*sizeof(JsVarRef)));
+  if (!table) return;
+  JsVarRef *slots = (JsVarRef*)jsvGetFlatStringPointer(table);
+  slots[0] = (JsVarRef)i;
+  i = 0;
+  childref = jsvGetFirstChild(arr);
+  while (childref) {
+    slots[1+i++] = childref;
+    childref = jsvGetNextSibling(jsvGetAddressOf(childref));
+  }
+  jsvSetNextSibling(arr, jsvGetRef(jsvRef(table)));
+  jsvUnLock(table);
+}
+
+/// A name has been added to an array with a table - add it to the table if it's a new last element
+static void jsvArrayIndexAdd(JsVar *arr, JsVar *name) {
+  JsVar *table = jsvGetAddressOf(jsvGetArrayIndexTable(arr));
+  JsVarRef *slots = (JsVarRef*)jsvGetFlatStringPointer(table);
+  JsVarRef count = slots[0];
+  if (!jsvArrayIndexIsElement(name, (JsVarInt)count) ||
+      jsvGetLastChild(arr)!=jsvGetRef(name) ||
+      jsvGetPrevSibling(name)!=(count ? slots[count] : 0)) {
+    jsvArrayIndexFree(arr); // not a push - forget about the table
+  } else if (count < jsvArrayIndexCapacity(table)) {
+    slots[1+count] = jsvGetRef(name);
+    slots[0]++;
+  } else { // no space - make a bigger one
+    jsvArrayIndexFree(arr);
+    jsvArrayIndexBuild(arr, (unsigned int)count*2);
+  }
+}
+
+/// A name has been removed from an array with a table - remove it if it was the last element
+static void jsvArrayIndexRemove(JsVar *arr, JsVar *name) {
+  JsVarRef *slots = (JsVarRef*)jsvGetFlatStringPointer(jsvGetAddressOf(jsvGetArrayIndexTable(arr)));
+  if (slots[0] && slots[slots[0]]==jsvGetRef(name))
+    slots[0]--;
+  else
+    jsvArrayIndexFree(arr);
+}
+
+/** Look up an element using the array's table, making one if the array is long enough.
+ * Returns true and sets *child to the (locked) name, or 0 if there's no such element,
+ * or returns false if the array must be searched. */
+static bool jsvArrayIndexFind(JsVar *arr, JsVarInt index, JsVar **child) {
+  if (!jsvGetArrayIndexTable(arr)) {
+    if (jsvGetArrayLength(arr) < JSV_ARRAY_INDEX_MIN_LENGTH) return false;
+    jsvArrayIndexBuild(arr, 0);
+    if (!jsvGetArrayIndexTable(arr)) return false;
+  }
+  JsVarRef *slots = (JsVarRef*)jsvGetFlatStringPointer(jsvGetAddressOf(jsvGetArrayIndexTable(arr)));
+  JsVarRef count = slots[0];
+  if (index>=0 && index<(JsVarInt)count) {
+    JsVar *name = jsvGetAddressOf(slots[1+index]);
+    if (jsvArrayIndexIsElement(name, index)) {
+      *child = jsvLockAgain(name);
+      return true;
+    }
+  } else if (count) {
+    // it's not there as long as the first/last elements haven't been renumbered
+    JsVarRef ref = (index<0) ? slots[1] : slots[count];
+    JsVar *name = jsvGetAddressOf(ref);
+    if (ref==((index<0) ? jsvGetFirstChild(arr) : jsvGetLastChild(arr)) &&
+        jsvArrayIndexIsElement(name, (index<0) ? 0 : (JsVarInt)count-1)) {
+      *child = 0;
+      return true;
+    }
+  }
+  // the elements were changed in a way the table doesn't know about
+  jsvArrayIndexFree(arr);
+  return false;
+}
+#endif
+
 void jsvAddName(JsVar *parent, JsVar *namedChild) {
   namedChild = jsvRef(namedChild); // ref here VERY important as adding to structure!
   assert(jsvIsName(namedChild));
+#ifdef JSP_INLINE_CACHE_SIZE
+  // the new child could hide one that the inline cache found in the prototype
+  if (jspInlineCacheObjects & JSP_INLINE_CACHE_OBJECT_BIT(jsvGetRef(parent)))
+    jspInlineCacheForget(jsvGetRef(parent));
+#endif
 
   // update array length
   if (jsvIsArray(parent) && jsvIsInt(namedChild)) {
@@ -2535,6 +3323,14 @@ void jsvAddName(JsVar *parent, JsVar *namedChild) {
     jsvSetFirstChild(parent, r);
     jsvSetLastChild(parent, r);
   }
+#ifdef JSV_OBJECT_INDEX_MIN_CHILDREN
+  if (jsvGetObjectIndex(parent) && jsvIsString(namedChild))
+    jsvObjectIndexAdd(parent, namedChild);
+#endif
+#ifdef JSV_ARRAY_INDEX_MIN_LENGTH
+  if (jsvGetArrayIndexTable(parent))
+    jsvArrayIndexAdd(parent, namedChild);
+#endif
 }
 
 JsVar *jsvAddNamedChild(JsVar *parent, JsVar *child, const char *name) {
@@ -2594,44 +3390,39 @@ JsVar *jsvSetValueOfName(JsVar *name, JsVar *src) {
 }
 
 JsVar *jsvFindChildFromString(JsVar *parent, const char *name, bool addIfNotFound) {
-  /* Pull out first 4 bytes, and ensure that everything
-   * is 0 padded so that we can do a nice speedy check. */
-  char fastCheck[4];
-  fastCheck[0] = name[0];
-  if (name[0]) {
-    fastCheck[1] = name[1];
-    if (name[1]) {
-      fastCheck[2] = name[2];
-      if (name[2]) {
-        fastCheck[3] = name[3];
-      } else {
-        fastCheck[3] = 0;
-      }
-    } else {
-      fastCheck[2] = 0;
-      fastCheck[3] = 0;
-    }
-  } else {
-    fastCheck[1] = 0;
-    fastCheck[2] = 0;
-    fastCheck[3] = 0;
-  }
-
   assert(jsvHasChildren(parent));
-  JsVarRef childref = jsvGetFirstChild(parent);
-  while (childref) {
-    // Don't Lock here, just use GetAddressOf - to try and speed up the finding
-    // TODO: We can do this now, but when/if we move to cacheing vars, it'll break
-    JsVar *child = jsvGetAddressOf(childref);
-    if (*(int*)fastCheck==*(int*)child->varData.str && // speedy check of first 4 bytes
-        jsvIsStringEqual(child, name)) {
-      // found it! unlock parent but leave child locked
-      return jsvLockAgain(child);
+  JsVar *child = 0;
+#ifdef JSV_OBJECT_INDEX_MIN_CHILDREN
+  if (jsvGetObjectIndex(parent)) {
+    child = jsvObjectIndexFind(parent, 0, name);
+    if (child) return child;
+  } else {
+    unsigned int childCount = 0;
+#endif
+    JsvNameKey key;
+    jsvNameKeyNew(&key, name);
+    JsVarRef childref = jsvGetFirstChild(parent);
+    while (childref) {
+      // Don't Lock here, just use GetAddressOf - to try and speed up the finding
+      // TODO: We can do this now, but when/if we move to cacheing vars, it'll break
+      child = jsvGetAddressOf(childref);
+      if (jsvNameKeyEqual(&key, child)) {
+        // found it! unlock parent but leave child locked
+        return jsvLockAgain(child);
+      }
+      childref = jsvGetNextSibling(child);
+#ifdef JSV_OBJECT_INDEX_MIN_CHILDREN
+      childCount++;
+#endif
     }
-    childref = jsvGetNextSibling(child);
+    child = 0;
+#ifdef JSV_OBJECT_INDEX_MIN_CHILDREN
+    // If that was a long search, make an index so next time it's quick
+    if (childCount>=JSV_OBJECT_INDEX_MIN_CHILDREN && jsvIsObject(parent))
+      jsvObjectIndexBuild(parent);
   }
+#endif
 
-  JsVar *child = 0;
   if (addIfNotFound) {
     child = jsvMakeIntoVariableName(jsvNewFromString(name), 0);
     if (child) // could be out of memory
@@ -2658,6 +3449,32 @@ JsVar *jsvFindChildFromStringI(JsVar *parent, const char *name) {
   return 0;
 }
 
+JsVar *jsvFindChildFromStringWithIndex(JsVar *parent, const char *name, unsigned int *childIdx) {
+  assert(jsvHasChildren(parent));
+  JsVarRef childref = jsvGetFirstChild(parent);
+  *childIdx = 0;
+  JsvNameKey key;
+  jsvNameKeyNew(&key, name);
+  while (childref) {
+    JsVar *child = jsvGetAddressOf(childref);
+    if (jsvNameKeyEqual(&key, child))
+      return jsvLockAgain(child);
+    childref = jsvGetNextSibling(child);
+    (*childIdx)++;
+  }
+  return 0;
+}
+
+JsVar *jsvGetChildAtIndexIfNamed(JsVar *parent, unsigned int childIdx, const char *name) {
+  assert(jsvHasChildren(parent));
+  JsVarRef childref = jsvGetFirstChild(parent);
+  while (childref && childIdx--)
+    childref = jsvGetNextSibling(jsvGetAddressOf(childref));
+  if (!childref) return 0;
+  JsVar *child = jsvGetAddressOf(childref);
+  return jsvIsStringEqual(child, name) ? jsvLockAgain(child) : 0;
+}
+
 /// See jsvIsNewChild - for fields that don't exist yet
 JsVar *jsvCreateNewChild(JsVar *parent, JsVar *index, JsVar *child) {
   JsVar *newChild = jsvAsName(index);
@@ -2690,17 +3507,49 @@ JsVar *jsvAsName(JsVar *var) {
 /** Non-recursive finding */
 JsVar *jsvFindChildFromVar(JsVar *parent, JsVar *childName, bool addIfNotFound) {
   JsVar *child;
-  JsVarRef childref = jsvGetFirstChild(parent);
-
-  while (childref) {
-    child = jsvLock(childref);
-    if (jsvIsBasicVarEqual(child, childName)) {
-      // found it! unlock parent but leave child locked
-      return child;
+#ifdef JSV_ARRAY_INDEX_MIN_LENGTH
+  if (jsvIsArray(parent) && jsvIsInt(childName) &&
+      jsvArrayIndexFind(parent, childName->varData.integer, &child)) {
+    if (child || !addIfNotFound) return child;
+    child = jsvAsName(childName);
+    jsvAddName(parent, child);
+    return child;
+  }
+#endif
+#ifdef JSV_OBJECT_INDEX_MIN_CHILDREN
+  unsigned int childCount = 0;
+  if (jsvGetObjectIndex(parent) && jsvIsString(childName)) {
+    child = jsvObjectIndexFind(parent, childName, 0);
+    if (child) return child;
+  } else {
+#endif
+    JsvNameKey key;
+    bool useKey = jsvNameKeyNewFromVar(&key, childName);
+    JsVarRef childref = jsvGetFirstChild(parent);
+    while (childref) {
+      if (useKey) {
+        child = jsvGetAddressOf(childref);
+        if (jsvNameKeyEqual(&key, child)) return jsvLockAgain(child);
+        childref = jsvGetNextSibling(child);
+      } else {
+        child = jsvLock(childref);
+        if (jsvIsBasicVarEqual(child, childName)) {
+          // found it! unlock parent but leave child locked
+          return child;
+        }
+        childref = jsvGetNextSibling(child);
+        jsvUnLock(child);
+      }
+#ifdef JSV_OBJECT_INDEX_MIN_CHILDREN
+      childCount++;
+#endif
     }
-    childref = jsvGetNextSibling(child);
-    jsvUnLock(child);
+#ifdef JSV_OBJECT_INDEX_MIN_CHILDREN
+    // If that was a long search, make an index so next time it's quick
+    if (childCount>=JSV_OBJECT_INDEX_MIN_CHILDREN && jsvIsObject(parent) && !jsvGetObjectIndex(parent))
+      jsvObjectIndexBuild(parent);
   }
+#endif
 
   child = 0;
   if (addIfNotFound && childName) {
@@ -2752,8 +3601,24 @@ void jsvRemoveChild(JsVar *parent, JsVar *child) {
 
   jsvSetPrevSibling(child, 0);
   jsvSetNextSibling(child, 0);
-  if (wasChild)
+#ifdef JSV_OBJECT_INDEX_MIN_CHILDREN
+  if (wasChild && jsvGetObjectIndex(parent) && jsvIsString(child))
+    jsvObjectIndexRemove(parent, child);
+#endif
+#ifdef JSV_ARRAY_INDEX_MIN_LENGTH
+  if (wasChild && jsvGetArrayIndexTable(parent))
+    jsvArrayIndexRemove(parent, child);
+#endif
+  if (wasChild) {
+#ifndef SAVE_ON_FLASH
+    // in case it was a variable in a scope, or an object's field (neither are in arrays)
+    if (!jsvIsArray(parent)) {
+      jspScopeGeneration++;
+      jspObjectGeneration++;
+    }
+#endif
     jsvUnRef(child);
+  }
 }
 
 void jsvRemoveAllChildren(JsVar *parent) {
@@ -2969,6 +3834,11 @@ size_t jsvCountJsVarsUsed(JsVar *v) {
 }
 
 JsVar *jsvGetArrayIndex(const JsVar *arr, JsVarInt index) {
+#ifdef JSV_ARRAY_INDEX_MIN_LENGTH
+  JsVar *indexedChild;
+  if (jsvIsArray(arr) && jsvArrayIndexFind((JsVar*)arr, index, &indexedChild))
+    return indexedChild;
+#endif
   JsVarRef childref = jsvGetLastChild(arr);
   JsVarInt lastArrayIndex = 0;
   // Look at last non-string element!
@@ -3201,6 +4071,10 @@ JsVar *jsvArrayPopFirst(JsVar *arr) {
       jsvUnLock(v);
     }
     jsvSetNextSibling(child, 0);
+#ifdef JSV_ARRAY_INDEX_MIN_LENGTH
+    if (jsvGetArrayIndexTable(arr))
+      jsvArrayIndexFree(arr); // the table's first element is now wrong
+#endif
     return child; // and return it
   } else {
     // no children!
@@ -3319,14 +4193,55 @@ bool jsvMathsOpTypeEqual(JsVar *a, JsVar *b) {
   return eql;
 }
 
-JsVar *jsvMathsOp(JsVar *a, JsVar *b, int op) {
+/// Is this a number that we have the only lock on, and which isn't referenced from anywhere?
+static bool jsvIsTemporaryNumber(JsVar *v) {
+  if (!v || (v->flags&JSV_NATIVE) || jsvGetLocks(v)!=1 || jsvGetRefs(v)) return false;
+  JsVarFlags type = v->flags&JSV_VARTYPEMASK;
+  return type==JSV_INTEGER || type==JSV_FLOAT || type==JSV_BOOLEAN;
+}
+
+/// Is this a (non-flat) string that we have the only lock on, and which isn't referenced from anywhere?
+static bool jsvIsTemporaryString(JsVar *v) {
+  return jsvIsBasicString(v) && !(v->flags&JSV_NATIVE) && jsvGetLocks(v)==1 && !jsvGetRefs(v);
+}
+
+/* jsvMathsOp creates its number and boolean results with these. If 'target' is
+ * set then it's a temporary number that nothing else is using, so the result is
+ * written into it rather than allocating a new variable (see jsvMathsOpSkipNamesAndUnLock) */
+static JsVar *jsvMathsOpSetType(JsVar *target, JsVarFlags type) {
+  target->flags = (JsVarFlags)((target->flags & ~JSV_VARTYPEMASK) | type);
+  return jsvLockAgain(target);
+}
+static JsVar *jsvMathsOpNewInteger(JsVar *target, JsVarInt value) {
+  if (!target) return jsvNewFromInteger(value);
+  target->varData.integer = value;
+  return jsvMathsOpSetType(target, JSV_INTEGER);
+}
+static JsVar *jsvMathsOpNewBool(JsVar *target, bool value) {
+  if (!target) return jsvNewFromBool(value);
+  target->varData.integer = value ? 1 : 0;
+  return jsvMathsOpSetType(target, JSV_BOOLEAN);
+}
+static JsVar *jsvMathsOpNewFloat(JsVar *target, JsVarFloat value) {
+  if (!target) return jsvNewFromFloat(value);
+  target->varData.floating = value;
+  return jsvMathsOpSetType(target, JSV_FLOAT);
+}
+static JsVar *jsvMathsOpNewLongInteger(JsVar *target, long long value) {
+  if (value>=-2147483648LL && value<=2147483647LL)
+    return jsvMathsOpNewInteger(target, (JsVarInt)value);
+  else
+    return jsvMathsOpNewFloat(target, (JsVarFloat)value);
+}
+
+static JsVar *jsvMathsOpInternal(JsVar *a, JsVar *b, int op, JsVar *target) {
   // Type equality check
   if (op == LEX_TYPEEQUAL || op == LEX_NTYPEEQUAL) {
     bool eql = jsvMathsOpTypeEqual(a,b);
     if (op == LEX_TYPEEQUAL)
-      return jsvNewFromBool(eql);
+      return jsvMathsOpNewBool(target, eql);
     else
-      return jsvNewFromBool(!eql);
+      return jsvMathsOpNewBool(target, !eql);
   }
 
   bool needsInt = op=='&' || op=='|' || op=='^' || op==LEX_LSHIFT || op==LEX_RSHIFT || op==LEX_RSHIFTUNSIGNED;
@@ -3345,9 +4260,9 @@ JsVar *jsvMathsOp(JsVar *a, JsVar *b, int op) {
   // do maths...
   if (jsvIsUndefined(a) && jsvIsUndefined(b)) {
     if (op == LEX_EQUAL)
-      return jsvNewFromBool(true);
+      return jsvMathsOpNewBool(target, true);
     else if (op == LEX_NEQUAL)
-      return jsvNewFromBool(false);
+      return jsvMathsOpNewBool(target, false);
     else
       return 0; // undefined
   } else if (needsNumeric ||
@@ -3359,23 +4274,23 @@ JsVar *jsvMathsOp(JsVar *a, JsVar *b, int op) {
       JsVarInt da = jsvGetInteger(a);
       JsVarInt db = jsvGetInteger(b);
       switch (op) {
-      case '+': return jsvNewFromLongInteger((long long)da + (long long)db);
-      case '-': return jsvNewFromLongInteger((long long)da - (long long)db);
-      case '*': return jsvNewFromLongInteger((long long)da * (long long)db);
-      case '/': return jsvNewFromFloat((JsVarFloat)da/(JsVarFloat)db);
-      case '&': return jsvNewFromInteger(da&db);
-      case '|': return jsvNewFromInteger(da|db);
-      case '^': return jsvNewFromInteger(da^db);
-      case '%': return db ? jsvNewFromInteger(da%db) : jsvNewFromFloat(NAN);
-      case LEX_LSHIFT: return jsvNewFromInteger(da << db);
-      case LEX_RSHIFT: return jsvNewFromInteger(da >> db);
-      case LEX_RSHIFTUNSIGNED: return jsvNewFromInteger((JsVarInt)(((JsVarIntUnsigned)da) >> db));
-      case LEX_EQUAL:     return jsvNewFromBool(da==db && jsvIsNull(a)==jsvIsNull(b));
-      case LEX_NEQUAL:    return jsvNewFromBool(da!=db || jsvIsNull(a)!=jsvIsNull(b));
-      case '<':           return jsvNewFromBool(da<db);
-      case LEX_LEQUAL:    return jsvNewFromBool(da<=db);
-      case '>':           return jsvNewFromBool(da>db);
-      case LEX_GEQUAL:    return jsvNewFromBool(da>=db);
+      case '+': return jsvMathsOpNewLongInteger(target, (long long)da + (long long)db);
+      case '-': return jsvMathsOpNewLongInteger(target, (long long)da - (long long)db);
+      case '*': return jsvMathsOpNewLongInteger(target, (long long)da * (long long)db);
+      case '/': return jsvMathsOpNewFloat(target, (JsVarFloat)da/(JsVarFloat)db);
+      case '&': return jsvMathsOpNewInteger(target, da&db);
+      case '|': return jsvMathsOpNewInteger(target, da|db);
+      case '^': return jsvMathsOpNewInteger(target, da^db);
+      case '%': return db ? jsvMathsOpNewInteger(target, da%db) : jsvMathsOpNewFloat(target, NAN);
+      case LEX_LSHIFT: return jsvMathsOpNewInteger(target, da << db);
+      case LEX_RSHIFT: return jsvMathsOpNewInteger(target, da >> db);
+      case LEX_RSHIFTUNSIGNED: return jsvMathsOpNewInteger(target, (JsVarInt)(((JsVarIntUnsigned)da) >> db));
+      case LEX_EQUAL:     return jsvMathsOpNewBool(target, da==db && jsvIsNull(a)==jsvIsNull(b));
+      case LEX_NEQUAL:    return jsvMathsOpNewBool(target, da!=db || jsvIsNull(a)!=jsvIsNull(b));
+      case '<':           return jsvMathsOpNewBool(target, da<db);
+      case LEX_LEQUAL:    return jsvMathsOpNewBool(target, da<=db);
+      case '>':           return jsvMathsOpNewBool(target, da>db);
+      case LEX_GEQUAL:    return jsvMathsOpNewBool(target, da>=db);
       default: return jsvMathsOpError(op, "Integer");
       }
     } else {
@@ -3383,21 +4298,21 @@ JsVar *jsvMathsOp(JsVar *a, JsVar *b, int op) {
       JsVarFloat da = jsvGetFloat(a);
       JsVarFloat db = jsvGetFloat(b);
       switch (op) {
-      case '+': return jsvNewFromFloat(da+db);
-      case '-': return jsvNewFromFloat(da-db);
-      case '*': return jsvNewFromFloat(da*db);
-      case '/': return jsvNewFromFloat(da/db);
-      case '%': return jsvNewFromFloat(jswrap_math_mod(da, db));
+      case '+': return jsvMathsOpNewFloat(target, da+db);
+      case '-': return jsvMathsOpNewFloat(target, da-db);
+      case '*': return jsvMathsOpNewFloat(target, da*db);
+      case '/': return jsvMathsOpNewFloat(target, da/db);
+      case '%': return jsvMathsOpNewFloat(target, jswrap_math_mod(da, db));
       case LEX_EQUAL:
       case LEX_NEQUAL:  { bool equal = da==db;
       if ((jsvIsNull(a) && jsvIsUndefined(b)) ||
           (jsvIsNull(b) && jsvIsUndefined(a))) equal = true; // JS quirk :)
-      return jsvNewFromBool((op==LEX_EQUAL) ? equal : ((bool)!equal));
+      return jsvMathsOpNewBool(target, (op==LEX_EQUAL) ? equal : ((bool)!equal));
       }
-      case '<':           return jsvNewFromBool(da<db);
-      case LEX_LEQUAL:    return jsvNewFromBool(da<=db);
-      case '>':           return jsvNewFromBool(da>db);
-      case LEX_GEQUAL:    return jsvNewFromBool(da>=db);
+      case '<':           return jsvMathsOpNewBool(target, da<db);
+      case LEX_LEQUAL:    return jsvMathsOpNewBool(target, da<=db);
+      case '>':           return jsvMathsOpNewBool(target, da>db);
+      case LEX_GEQUAL:    return jsvMathsOpNewBool(target, da>=db);
       default: return jsvMathsOpError(op, "Double");
       }
     }
@@ -3429,8 +4344,13 @@ JsVar *jsvMathsOp(JsVar *a, JsVar *b, int op) {
       return 0;
     }
     if (op=='+') {
-      JsVar *v = jsvCopy(da, false);
-      // TODO: can we be fancy and not copy da if we know it isn't reffed? what about locks?
+      JsVar *v;
+      /* If nothing else can see the string we're adding to (we were given it
+       * as a target, or it was made by jsvAsString) just append to it */
+      if (da==target || jsvIsTemporaryString(da))
+        v = jsvLockAgain(da);
+      else
+        v = jsvCopy(da, false);
       if (v) // could be out of memory
         jsvAppendStringVarComplete(v, db);
       jsvUnLock2(da, db);
@@ -3452,13 +4372,37 @@ JsVar *jsvMathsOp(JsVar *a, JsVar *b, int op) {
   }
 }
 
-JsVar *jsvNegateAndUnLock(JsVar *v) {
-  JsVar *zero = jsvNewFromInteger(0);
-  JsVar *res = jsvMathsOpSkipNames(zero, v, '-');
-  jsvUnLock2(zero, v);
+JsVar *jsvMathsOp(JsVar *a, JsVar *b, int op) {
+  return jsvMathsOpInternal(a, b, op, 0);
+}
+
+
+/** Same as jsvMathsOpSkipNames, but a and b are unlocked. If a or b is a temporary
+ * number (eg. the result of an earlier calculation) and the result is a number or
+ * boolean, it is written straight into that variable rather than allocating a new one.
+ * In the same way, adding to a temporary string appends to it rather than copying it */
+JsVar *jsvMathsOpSkipNamesAndUnLock(JsVar *a, JsVar *b, int op) {
+  JsVar *target = 0;
+  if (jsvIsTemporaryNumber(a)) target = a;
+  else if (jsvIsTemporaryNumber(b)) target = b;
+  JsVar *pa = jsvSkipName(a);
+  JsVar *pb = jsvSkipName(b);
+  JsVar *oa = jsvGetValueOf(pa);
+  JsVar *ob = jsvGetValueOf(pb);
+  jsvUnLock2(pa, pb);
+  // Only write into target if we're not going to have to convert to strings
+  if (!jsvIsNumeric(oa) || !jsvIsNumeric(ob)) target = 0;
+  // If we're adding to a temporary string, the result can go straight on the end of it
+  if (op=='+' && jsvIsTemporaryString(a)) target = a;
+  JsVar *res = jsvMathsOpInternal(oa,ob,op,target);
+  jsvUnLock4(oa, ob, a, b);
   return res;
 }
 
+JsVar *jsvNegateAndUnLock(JsVar *v) {
+  return jsvMathsOpSkipNamesAndUnLock(jsvNewFromInteger(0), v, '-');
+}
+
 /// see jsvGetPathTo
 static JsVar *jsvGetPathTo_int(JsVar *root, JsVar *element, int maxDepth, JsVar *ignoreParent, int *depth) {
   if (maxDepth<=0) return 0;
@@ -3645,6 +4589,181 @@ void jsvTrace(JsVar *var, int indent) {
 }
 
 
+#ifdef JSV_GC_GREY_STACK_SIZE
+/* Incremental garbage collection. This is a tri-colour mark and sweep that is
+ * done a few variables at a time from the idle loop, so there's never a long
+ * pause. Variables are 'white' (not known to be in use) or 'black' (in use)
+ * depending on whether JSV_GARBAGE_COLLECT matches jsvGCBlack - at the start
+ * of each collection we flip jsvGCBlack, which makes everything white without
+ * having to touch every variable. 'Grey' variables are black ones we haven't
+ * looked inside yet, and are kept on jsvGCGreyStack.
+ *
+ * While marking, anything that gets locked or referenced is made grey (see
+ * jsvLock/jsvRef), so the interpreter can never hide a white variable inside
+ * one we've already looked at. New variables are always black. */
+
+#define JSV_GC_NAMES_PER_STEP 16 ///< How many of an object's children to look at in one go
+
+static JsVarRef jsvGCGreyStack[JSV_GC_GREY_STACK_SIZE];
+static unsigned int jsvGCGreyCount;
+static bool jsvGCGreyOverflow; ///< Some grey variables didn't fit on jsvGCGreyStack
+static unsigned int jsvGCMaxDepth; ///< The most variables there have been on jsvGCGreyStack during the last collection
+static JsSysTime jsvGCMarkTime; ///< How long the last full garbage collection spent marking
+static bool jsvGCRescan; ///< Looking inside every black variable (because jsvGCGreyStack overflowed)
+static JsVarRef jsvGCCursor; ///< The next variable to look at while looking for locked variables, or sweeping
+static JsVarRef jsvGCFreedFirst, jsvGCFreedLast; ///< Variables freed while sweeping (they go in the free list at the end)
+
+/// Forget about any incremental garbage collection - all variables must have JSV_GARBAGE_COLLECT==jsvGCBlack
+static void jsvGarbageCollectReset() {
+  jsvGCPhase = JSV_GC_IDLE;
+  jsvGCBlack = 0;
+  jsvGCGrowth = 0;
+  jsvGCGreyCount = 0;
+  jsvGCGreyOverflow = false;
+  jsvGCMaxDepth = 0;
+  jsvGCFreedFirst = 0;
+  jsvGCFreedLast = 0;
+}
+
+/// Is this variable white (not yet known to be in use)?
+static ALWAYS_INLINE bool jsvGarbageCollectIsWhite(JsVar *var) {
+  return (var->flags&JSV_VARTYPEMASK)!=JSV_UNUSED &&
+         (var->flags&JSV_GARBAGE_COLLECT)!=jsvGCBlack;
+}
+
+/// Make the StringExts of a black string black (they don't reference anything else). Returns how many there were
+static unsigned int jsvGarbageCollectScanString(JsVar *var) {
+  unsigned int count = 0;
+  JsVarRef ref = jsvGetLastChild(var);
+  while (ref) {
+    JsVar *ext = jsvGetAddressOf(ref);
+    if (!jsvGarbageCollectIsWhite(ext)) break;
+    ext->flags ^= JSV_GARBAGE_COLLECT;
+    count++;
+    ref = jsvGetLastChild(ext);
+  }
+  return count;
+}
+
+/// Put a variable that has just been made black on jsvGCGreyStack, so we look inside it later
+static ALWAYS_INLINE void jsvGarbageCollectPush(JsVarRef ref) {
+  if (jsvGCGreyCount < JSV_GC_GREY_STACK_SIZE) {
+    jsvGCGreyStack[jsvGCGreyCount++] = ref;
+    if (jsvGCGreyCount > jsvGCMaxDepth) jsvGCMaxDepth = jsvGCGreyCount;
+  } else // it's black now, but we'll have to look inside all black variables later
+    jsvGCGreyOverflow = true;
+}
+
+/// Could this variable reference other variables? If not there's no need to look inside it
+static ALWAYS_INLINE bool jsvGarbageCollectHasRefs(JsVar *var) {
+  JsVarFlags t = var->flags&JSV_VARTYPEMASK;
+  if (t>=JSV_INTEGER && t<=JSV_PIN) return false; // numbers
+  if (t>=JSV_STRING_0 && t<=JSV_NATIVE_STRING) return jsvGetLastChild(var)!=0; // strings only reference their StringExts
+  return true;
+}
+
+/// If a variable is white, make it grey (or black if it doesn't reference anything)
+static ALWAYS_INLINE void jsvGarbageCollectShadeRef(JsVarRef ref) {
+  if (!ref) return;
+  JsVar *var = jsvGetAddressOf(ref);
+  if (!jsvGarbageCollectIsWhite(var)) return;
+  var->flags ^= JSV_GARBAGE_COLLECT;
+  if (jsvGarbageCollectHasRefs(var)) jsvGarbageCollectPush(ref);
+}
+
+/// If a variable is white, make it grey - for the write barrier in jsvLock/jsvRef
+static NO_INLINE void jsvGarbageCollectShade(JsVar *var) {
+  if (!jsvGarbageCollectIsWhite(var)) return;
+  var->flags ^= JSV_GARBAGE_COLLECT;
+  jshInterruptOff(); // this could be called from an IRQ
+  jsvGarbageCollectPush(jsvGetRef(var));
+  jshInterruptOn();
+}
+
+/** Make everything a black variable references grey (the same links as
+ * jsvGarbageCollectMarkUsed follows). Returns how many variables we looked at */
+static unsigned int jsvGarbageCollectScan(JsVar *var) {
+  unsigned int count = 1;
+  if (jsvIsName(var)) {
+    /* Names are the children of objects - go along the list. When a name's
+     * value needs looking inside, put it on the stack above the rest of the
+     * list so it's done first - that way the stack only gets as deep as the
+     * structure is (not as wide). Only do a few at once so a big object
+     * doesn't make one long slice. */
+    while (true) {
+      if (jsvHasCharacterData(var))
+        count += jsvGarbageCollectScanString(var);
+      JsVarRef next = jsvGetNextSibling(var);
+      JsVarRef valueRef = jsvHasSingleChild(var) ? jsvGetFirstChild(var) : 0;
+      JsVar *value = valueRef ? jsvGetAddressOf(valueRef) : 0;
+      if (value && jsvGarbageCollectIsWhite(value)) {
+        value->flags ^= JSV_GARBAGE_COLLECT;
+        if (jsvGarbageCollectHasRefs(value)) {
+          jsvGarbageCollectShadeRef(next);
+          jsvGarbageCollectPush(valueRef);
+          break;
+        }
+      }
+      if (!next) break;
+      if (count >= JSV_GC_NAMES_PER_STEP) {
+        jsvGarbageCollectShadeRef(next);
+        break;
+      }
+      var = jsvGetAddressOf(next);
+      if (!jsvGarbageCollectIsWhite(var)) break; // it'll do the rest of the list itself
+      var->flags ^= JSV_GARBAGE_COLLECT;
+      count++;
+    }
+    return count;
+  }
+  if (jsvHasCharacterData(var))
+    count += jsvGarbageCollectScanString(var);
+  if (jsvHasSingleChild(var)) {
+    jsvGarbageCollectShadeRef(jsvGetFirstChild(var));
+  } else if (jsvHasChildren(var)) {
+    jsvGarbageCollectShadeRef(jsvGetFirstChild(var));
+#ifdef JSV_OBJECT_INDEX_MIN_CHILDREN
+    jsvGarbageCollectShadeRef(jsvGetObjectIndex(var));
+#endif
+#ifdef JSV_ARRAY_INDEX_MIN_LENGTH
+    jsvGarbageCollectShadeRef(jsvGetArrayIndexTable(var));
+#endif
+  }
+  return count;
+}
+
+/// Look inside all the grey variables on jsvGCGreyStack
+static void jsvGarbageCollectMarkGrey() {
+  while (jsvGCGreyCount) {
+    JsVarRef ref = jsvGCGreyStack[--jsvGCGreyCount];
+    if (ref) jsvGarbageCollectScan(jsvGetAddressOf(ref));
+  }
+}
+
+/** Mark the variable and everything it references, using jsvGCGreyStack rather
+ * than recursion so deep structures can't overflow the stack. This is for full
+ * garbage collections, where marked just means JSV_GARBAGE_COLLECT is clear */
+static void jsvGarbageCollectMarkUsed(JsVar *var) {
+  assert(jsvGCPhase==JSV_GC_IDLE && !jsvGCBlack);
+  jsvGarbageCollectShade(var);
+  jsvGarbageCollectMarkGrey();
+  while (jsvGCGreyOverflow) {
+    /* We ran out of space on the stack, so some variables are marked but we
+     * haven't looked inside them - look inside every marked variable */
+    jsvGCGreyOverflow = false;
+    JsVarRef i;
+    for (i=1;i<=jsVarsSize;i++) {
+      JsVar *v = jsvGetAddressOf(i);
+      if ((v->flags&JSV_VARTYPEMASK)!=JSV_UNUSED && !(v->flags&JSV_GARBAGE_COLLECT)) {
+        jsvGarbageCollectScan(v);
+        jsvGarbageCollectMarkGrey();
+      }
+      if (jsvIsFlatString(v))
+        i = (JsVarRef)(i+jsvGetFlatStringBlocks(v));
+    }
+  }
+}
+#else
 /** Recursively mark the variable */
 static void jsvGarbageCollectMarkUsed(JsVar *var) {
   var->flags &= (JsVarFlags)~JSV_GARBAGE_COLLECT;
@@ -3667,6 +4786,14 @@ static void jsvGarbageCollectMarkUsed(JsVar *var) {
         jsvGarbageCollectMarkUsed(childVar);
     }
   } else if (jsvHasChildren(var)) {
+#ifdef JSV_OBJECT_INDEX_MIN_CHILDREN
+    if (jsvGetObjectIndex(var))
+      jsvGarbageCollectMarkUsed(jsvGetAddressOf(jsvGetObjectIndex(var)));
+#endif
+#ifdef JSV_ARRAY_INDEX_MIN_LENGTH
+    if (jsvGetArrayIndexTable(var))
+      jsvGarbageCollectMarkUsed(jsvGetAddressOf(jsvGetArrayIndexTable(var)));
+#endif
     JsVarRef child = jsvGetFirstChild(var);
     while (child) {
       JsVar *childVar;
@@ -3677,11 +4804,17 @@ static void jsvGarbageCollectMarkUsed(JsVar *var) {
     }
   }
 }
+#endif
 
 /** Run a garbage collection sweep - return nonzero if things have been freed */
 int jsvGarbageCollect() {
   if (isMemoryBusy) return false;
   isMemoryBusy = MEMBUSY_GC;
+#ifdef JSV_GC_GREY_STACK_SIZE
+  /* Abandon any incremental garbage collection - we're doing it all now. Anything
+   * it freed is JSV_UNUSED, so gets put back in the free list below */
+  jsvGarbageCollectReset();
+#endif
   JsVarRef i;
   // Add GC flags to anything that is currently used
   for (i=1;i<=jsVarsSize;i++)  {
@@ -3693,6 +4826,9 @@ int jsvGarbageCollect() {
         i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
     }
   }
+#ifdef JSV_GC_GREY_STACK_SIZE
+  JsSysTime markStart = jshGetSystemTime();
+#endif
   /* recursively remove anything that is referenced from a var that is locked. */
   for (i=1;i<=jsVarsSize;i++)  {
     JsVar *var = jsvGetAddressOf(i);
@@ -3703,13 +4839,19 @@ int jsvGarbageCollect() {
     if (jsvIsFlatString(var))
       i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
   }
+#ifdef JSV_GC_GREY_STACK_SIZE
+  jsvGCMarkTime = jshGetSystemTime() - markStart;
+#endif
   /* now sweep for things that we can GC!
    * Also update the free list - this means that every new variable that
    * gets allocated gets allocated towards the start of memory, which
    * hopefully helps compact everything towards the start. */
   unsigned int freedCount = 0;
   jsVarFirstEmpty = 0;
-  JsVar *lastEmpty = 0;
+#ifdef JSV_FREE_BITMAP
+  jsvFreeBitmapReset();
+#endif
+  JsVarRef lastEmpty = 0;
   for (i=1;i<=jsVarsSize;i++)  {
     JsVar *var = jsvGetAddressOf(i);
     if (var->flags & JSV_GARBAGE_COLLECT) {
@@ -3720,18 +4862,14 @@ int jsvGarbageCollect() {
         // Free the first block
         var->flags = JSV_UNUSED;
         // add this to our free list
-        if (lastEmpty) jsvSetNextSibling(lastEmpty, i);
-        else jsVarFirstEmpty = i;
-        lastEmpty = var;
+        jsvFreeListAppend(&lastEmpty, i);
         // free subsequent blocks
         while (count-- > 0) {
           i++;
           var = jsvGetAddressOf((JsVarRef)(i));
           var->flags = JSV_UNUSED;
           // add this to our free list
-          if (lastEmpty) jsvSetNextSibling(lastEmpty, i);
-          else jsVarFirstEmpty = i;
-          lastEmpty = var;
+          jsvFreeListAppend(&lastEmpty, i);
         }
       } else {
         // otherwise just free 1 block
@@ -3771,9 +4909,7 @@ int jsvGarbageCollect() {
         // free!
         var->flags = JSV_UNUSED;
         // add this to our free list
-        if (lastEmpty) jsvSetNextSibling(lastEmpty, i);
-        else jsVarFirstEmpty = i;
-        lastEmpty = var;
+        jsvFreeListAppend(&lastEmpty, i);
         freedCount++;
       }
     } else if (jsvIsFlatString(var)) {
@@ -3781,16 +4917,324 @@ int jsvGarbageCollect() {
       i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
     } else if (var->flags == JSV_UNUSED) {
       // this is already free - add it to the free list
-      if (lastEmpty) jsvSetNextSibling(lastEmpty, i);
-      else jsVarFirstEmpty = i;
-      lastEmpty = var;
+      jsvFreeListAppend(&lastEmpty, i);
     }
   }
-  if (lastEmpty) jsvSetNextSibling(lastEmpty, 0);
+  if (lastEmpty) jsvSetNextSibling(jsvGetAddressOf(lastEmpty), 0);
   isMemoryBusy = MEM_NOT_BUSY;
+#ifndef SAVE_ON_FLASH
+  if (freedCount) { // we didn't use jsvFreePtr, so anything cached could have been freed
+    jspScopeGeneration++;
+    jspObjectGeneration++;
+  }
+#endif
+#ifdef JSV_STRING_TAIL_CACHE_SIZE
+  if (freedCount) jsvStringTailCacheForgetAll();
+#endif
+#ifdef JSV_STRING_SKIP_INDEX_SIZE
+  if (freedCount) jsvStringSkipIndexForgetAll();
+#endif
+#ifdef RESIZABLE_JSVARS
+  jsvShrinkMemory(); // give back memory we don't need any more
+#endif
   return (int)freedCount;
 }
 
+#ifdef JSV_GC_GREY_STACK_SIZE
+/// A flat string has just been allocated - make sure we don't treat its data as variables
+static void jsvGarbageCollectFlatStringAllocated(JsVarRef ref, unsigned int blocks) {
+  if (jsvGCPhase==JSV_GC_IDLE) return;
+  JsVarRef last = (JsVarRef)(ref+blocks-1);
+  if (jsvGCCursor>ref && jsvGCCursor<=last)
+    jsvGCCursor = (JsVarRef)(last+1);
+  unsigned int i;
+  for (i=0;i<jsvGCGreyCount;i++)
+    if (jsvGCGreyStack[i]>ref && jsvGCGreyStack[i]<=last)
+      jsvGCGreyStack[i] = 0;
+}
+
+/// Free a white variable while sweeping
+static void jsvGarbageCollectFree(JsVarRef ref) {
+  JsVar *var = jsvGetAddressOf(ref);
+  var->flags = JSV_UNUSED;
+  if (jsvGCFreedLast) jsvSetNextSibling(jsvGetAddressOf(jsvGCFreedLast), ref);
+  else jsvGCFreedFirst = ref;
+#ifdef JSV_FREE_BITMAP
+  jsvSetPrevSibling(var, jsvGCFreedLast);
+#endif
+  jsvGCFreedLast = ref;
+}
+
+/// Do one step of marking or sweeping. Returns how many variables we looked at
+static unsigned int jsvGarbageCollectStep() {
+  unsigned int count = 1;
+  if (jsvGCPhase==JSV_GC_MARK) {
+    if (jsvGCGreyCount) { // look inside a grey variable
+      JsVarRef ref = jsvGCGreyStack[--jsvGCGreyCount];
+      if (ref) {
+        JsVar *var = jsvGetAddressOf(ref);
+        if ((var->flags&JSV_VARTYPEMASK)!=JSV_UNUSED) count = jsvGarbageCollectScan(var);
+      }
+    } else if (jsvGCCursor<=jsVarsSize) { // look for locked variables
+      JsVar *var = jsvGetAddressOf(jsvGCCursor);
+      if (jsvGetLocks(var)>0) jsvGarbageCollectShadeRef(jsvGCCursor);
+      if (jsvGCRescan && (var->flags&JSV_VARTYPEMASK)!=JSV_UNUSED && !jsvGarbageCollectIsWhite(var))
+        count = jsvGarbageCollectScan(var);
+      if (jsvIsFlatString(var))
+        jsvGCCursor = (JsVarRef)(jsvGCCursor+jsvGetFlatStringBlocks(var));
+      jsvGCCursor++;
+    } else if (jsvGCGreyOverflow) { // go around again, looking inside every black variable
+      jsvGCGreyOverflow = false;
+      jsvGCRescan = true;
+      jsvGCCursor = 1;
+    } else { // everything that's in use is black - free everything else
+      jsvGCPhase = JSV_GC_SWEEP;
+      jsvGCCursor = 1;
+    }
+  } else if (jsvGCCursor<=jsVarsSize) { // JSV_GC_SWEEP
+    JsVar *var = jsvGetAddressOf(jsvGCCursor);
+    if (jsvGarbageCollectIsWhite(var)) {
+      if (jsvIsFlatString(var)) {
+        unsigned int count = (unsigned int)jsvGetFlatStringBlocks(var);
+        while (count-- > 0) jsvGarbageCollectFree(jsvGCCursor++);
+      } else if (jsvHasSingleChild(var)) {
+        // unref the child if it's in use (see jsvGarbageCollect)
+        JsVarRef ch = jsvGetFirstChild(var);
+        if (ch) {
+          JsVar *child = jsvGetAddressOf(ch);
+          if ((child->flags&JSV_VARTYPEMASK)!=JSV_UNUSED && !jsvGarbageCollectIsWhite(child))
+            jsvUnRef(child);
+        }
+      }
+      jsvGarbageCollectFree(jsvGCCursor);
+    } else if (jsvIsFlatString(var)) {
+      jsvGCCursor = (JsVarRef)(jsvGCCursor+jsvGetFlatStringBlocks(var));
+    }
+    jsvGCCursor++;
+  } else { // finished sweeping - add what we freed to the free list
+    if (jsvGCFreedLast) {
+      jshInterruptOff();
+#ifdef JSV_FREE_BITMAP
+      JsVarRef ref = jsvGCFreedFirst;
+      jsvFreeBitmapSet(ref);
+      while (ref!=jsvGCFreedLast) {
+        ref = jsvGetNextSibling(jsvGetAddressOf(ref));
+        jsvFreeBitmapSet(ref);
+      }
+#endif
+      jsvSetNextSibling(jsvGetAddressOf(jsvGCFreedLast), jsVarFirstEmpty);
+#ifdef JSV_FREE_BITMAP
+      if (jsVarFirstEmpty) jsvSetPrevSibling(jsvGetAddressOf(jsVarFirstEmpty), jsvGCFreedLast);
+#endif
+      jsVarFirstEmpty = jsvGCFreedFirst;
+      touchedFreeList = true;
+      jshInterruptOn();
+      jspScopeGeneration++; // anything cached could have been freed
+      jspObjectGeneration++;
+#ifdef JSV_STRING_TAIL_CACHE_SIZE
+      jsvStringTailCacheForgetAll();
+#endif
+#ifdef JSV_STRING_SKIP_INDEX_SIZE
+      jsvStringSkipIndexForgetAll();
+#endif
+    }
+    jsvGCFreedFirst = 0;
+    jsvGCFreedLast = 0;
+    jsvGCPhase = JSV_GC_IDLE;
+  }
+  return count;
+}
+
+bool jsvGarbageCollectIncremental() {
+  if (isMemoryBusy) return jsvGCPhase!=JSV_GC_IDLE;
+  isMemoryBusy = MEMBUSY_GC;
+  if (jsvGCPhase==JSV_GC_IDLE) {
+    // everything is black - flip what black means, so everything is white
+    jsvGCBlack ^= JSV_GARBAGE_COLLECT;
+    jsvGCPhase = JSV_GC_MARK;
+    jsvGCRescan = false;
+    jsvGCCursor = 1;
+    jsvGCGrowth = 0;
+    jsvGCMaxDepth = 0;
+  }
+  unsigned int count = 0;
+  while (jsvGCPhase!=JSV_GC_IDLE && (!jsvGCBudget || count<jsvGCBudget))
+    count += jsvGarbageCollectStep();
+  isMemoryBusy = MEM_NOT_BUSY;
+  return jsvGCPhase!=JSV_GC_IDLE;
+}
+
+bool jsvGarbageCollectInProgress() {
+  return jsvGCPhase!=JSV_GC_IDLE;
+}
+
+bool jsvGarbageCollectWanted() {
+  return jsvGCGrowth >= (int)(jsVarsSize/4) ||
+         !jsvMoreFreeVariablesThan(JS_VARS_BEFORE_IDLE_GC);
+}
+
+void jsvSetGarbageCollectBudget(unsigned int budget) {
+  jsvGCBudget = budget;
+}
+
+unsigned int jsvGetGarbageCollectBudget() {
+  return jsvGCBudget;
+}
+
+JsSysTime jsvGetGarbageCollectMarkTime() {
+  return jsvGCMarkTime;
+}
+
+unsigned int jsvGetGarbageCollectMaxDepth() {
+  return jsvGCMaxDepth;
+}
+#endif
+
+#ifndef SAVE_ON_FLASH
+/* Defragmentation. Variables that can be moved are moved from the end of memory
+ * into free variables nearer the start. A variable that has been moved is left
+ * JSV_UNUSED with firstChild set to where it went - nothing can reference an
+ * unused variable, so once everything has moved we go through every reference
+ * and point it at the new location. Locked variables can't be moved because
+ * something has a pointer to them, and flat strings are left where they are.
+ * The lexers that are running read their code without locking it, so that is
+ * 'pinned' by setting JSV_GARBAGE_COLLECT (which the garbage collection we do
+ * first leaves clear on everything). */
+
+/// Can jsvDefragment move this variable?
+static bool jsvDefragmentCanMove(JsVar *var) {
+  return (var->flags&JSV_VARTYPEMASK)!=JSV_UNUSED && !jsvIsFlatString(var) && jsvGetLocks(var)==0 &&
+         !(var->flags&JSV_GARBAGE_COLLECT);
+}
+
+/// Stop the StringExts of a lexer's code from being moved - see jslGetNextCh
+static void jsvDefragmentPin(JsVar *code) {
+  if (jsvIsFlatString(code) || jsvIsNativeString(code)) return;
+  while (jsvGetLastChild(code)) {
+    code = jsvGetAddressOf(jsvGetLastChild(code));
+    code->flags |= (JsVarFlags)JSV_GARBAGE_COLLECT;
+  }
+}
+
+/// Allow a lexer's code to be moved again - see jsvDefragmentPin
+static void jsvDefragmentUnpin(JsVar *code) {
+  if (jsvIsFlatString(code) || jsvIsNativeString(code)) return;
+  while (jsvGetLastChild(code)) {
+    code = jsvGetAddressOf(jsvGetLastChild(code));
+    code->flags &= (JsVarFlags)~JSV_GARBAGE_COLLECT;
+  }
+}
+
+/// If the variable 'ref' was moved by jsvDefragment, return where it is now
+static JsVarRef jsvDefragmentNewRef(JsVarRef ref) {
+  if (!ref) return 0;
+  JsVar *var = jsvGetAddressOf(ref);
+  return ((var->flags&JSV_VARTYPEMASK)==JSV_UNUSED) ? jsvGetFirstChild(var) : ref;
+}
+
+/// Update the JsVarRefs in a table of names or elements (see jsvObjectIndexBuild/jsvArrayIndexBuild)
+static void jsvDefragmentUpdateTable(JsVarRef tableRef, bool isArray) {
+  JsVar *table = jsvGetAddressOf(tableRef);
+  JsVarRef *slots = (JsVarRef*)jsvGetFlatStringPointer(table);
+  unsigned int i, count = isArray ? slots[0] : (unsigned int)(jsvGetCharactersInVar(table) / sizeof(JsVarRef)) - 1;
+  for (i=1;i<=count;i++)
+    slots[i] = jsvDefragmentNewRef(slots[i]);
+}
+
+/// Point all of a variable's references at where the variables are now (the same links as jsvGarbageCollectMarkUsed follows)
+static void jsvDefragmentUpdateRefs(JsVar *var) {
+  if (jsvHasCharacterData(var))
+    jsvSetLastChild(var, jsvDefragmentNewRef(jsvGetLastChild(var))); // StringExt
+  if (jsvIsName(var)) {
+    jsvSetNextSibling(var, jsvDefragmentNewRef(jsvGetNextSibling(var)));
+    jsvSetPrevSibling(var, jsvDefragmentNewRef(jsvGetPrevSibling(var)));
+  }
+  if (jsvHasSingleChild(var)) {
+    jsvSetFirstChild(var, jsvDefragmentNewRef(jsvGetFirstChild(var)));
+  } else if (jsvHasChildren(var)) {
+    jsvSetFirstChild(var, jsvDefragmentNewRef(jsvGetFirstChild(var)));
+    jsvSetLastChild(var, jsvDefragmentNewRef(jsvGetLastChild(var)));
+#ifdef JSV_OBJECT_INDEX_MIN_CHILDREN
+    if (jsvGetObjectIndex(var)) jsvDefragmentUpdateTable(jsvGetObjectIndex(var), false);
+#endif
+#ifdef JSV_ARRAY_INDEX_MIN_LENGTH
+    if (jsvGetArrayIndexTable(var)) jsvDefragmentUpdateTable(jsvGetArrayIndexTable(var), true);
+#endif
+  }
+}
+
+unsigned int jsvDefragment() {
+  // a waveform's buffer is read directly by the utility timer, so it mustn't move
+  if (isMemoryBusy || jstHasBufferTimerTasks()) return 0;
+  // get rid of garbage (this also stops any incremental garbage collection)
+  jsvGarbageCollect();
+  isMemoryBusy = MEMBUSY_SYSTEM;
+  jslForEachActiveSource(jsvDefragmentPin);
+  /* Find where memory will end once everything is moved down. Variables
+   * from 'boundary' upwards get moved into free variables below it */
+  unsigned int movable = 0, holes = 0;
+  JsVarRef i, boundary = 0;
+  for (i=1;i<=jsVarsSize;i++) {
+    JsVar *var = jsvGetAddressOf(i);
+    if (jsvDefragmentCanMove(var)) movable++;
+    if (jsvIsFlatString(var)) i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
+  }
+  for (i=1;i<=jsVarsSize;i++) {
+    if (holes >= movable) { boundary = i; break; }
+    JsVar *var = jsvGetAddressOf(i);
+    if ((var->flags&JSV_VARTYPEMASK)==JSV_UNUSED) holes++;
+    else if (jsvDefragmentCanMove(var)) movable--; // doesn't need moving
+    if (jsvIsFlatString(var)) i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
+  }
+  // Move the variables
+  unsigned int moved = 0;
+  JsVarRef to = 1;
+  for (i=boundary;i && i<=jsVarsSize;i++) {
+    JsVar *var = jsvGetAddressOf(i);
+    if (jsvDefragmentCanMove(var)) {
+      JsVar *toVar = jsvGetAddressOf(to);
+      while ((toVar->flags&JSV_VARTYPEMASK)!=JSV_UNUSED) {
+        if (jsvIsFlatString(toVar)) to = (JsVarRef)(to+jsvGetFlatStringBlocks(toVar));
+        toVar = jsvGetAddressOf(++to);
+      }
+      assert(to<boundary);
+      *toVar = *var;
+      var->flags = JSV_UNUSED;
+      jsvSetFirstChild(var, to);
+      moved++;
+    }
+    if (jsvIsFlatString(var)) i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
+  }
+  if (moved) {
+    // Now point all references at where things are now
+    for (i=1;i<=jsVarsSize;i++) {
+      JsVar *var = jsvGetAddressOf(i);
+      if ((var->flags&JSV_VARTYPEMASK)!=JSV_UNUSED)
+        jsvDefragmentUpdateRefs(var);
+      if (jsvIsFlatString(var)) i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
+    }
+    timerArray = jsvDefragmentNewRef(timerArray);
+    watchArray = jsvDefragmentNewRef(watchArray);
+    jspCachesForget();
+#ifdef JSV_STRING_TAIL_CACHE_SIZE
+    jsvStringTailCacheForgetAll();
+#endif
+#ifdef JSV_STRING_SKIP_INDEX_SIZE
+    jsvStringSkipIndexForgetAll();
+#endif
+  }
+  jslForEachActiveSource(jsvDefragmentUnpin);
+  isMemoryBusy = MEM_NOT_BUSY;
+  // the variables we moved from are now free
+  jsvCreateEmptyVarList();
+  touchedFreeList = true;
+#ifdef RESIZABLE_JSVARS
+  jsvShrinkMemory(); // memory at the end may be empty now
+#endif
+  return moved;
+}
+#endif
+
 #ifndef RELEASE
 // Dump any locked variables that aren't referenced from `global` - for debugging memory leaks
 void jsvDumpLockedVars() {
@@ -310,6 +310,10 @@ bool jsvMoreFreeVariablesThan(unsigned int vars); ///< Return whether there are
 void jsvShowAllocated(); ///< Show what is still allocated, for debugging memory problems
 /// Try and allocate more memory - only works if RESIZABLE_JSVARS is defined
 void jsvSetMemoryTotal(unsigned int jsNewVarCount);
+#ifdef RESIZABLE_JSVARS
+/// Would garbage collecting now maybe let us give some memory back?
+bool jsvShrinkMemoryWanted();
+#endif
 
 
 // Note that jsvNew* don't REF a variable for you, but the do LOCK it
@@ -484,6 +488,16 @@ JsVar *jsvAsStringAndUnLock(JsVar *var); ///< Same as jsvAsString, but unlocks '
 JsVar *jsvAsFlatString(JsVar *var); ///< Create a flat string from the given variable (or return it if it is already a flat string). NOTE: THIS CONVERTS VIA A STRING
 bool jsvIsEmptyString(JsVar *v); ///< Returns true if the string is empty - faster than jsvGetStringLength(v)==0
 size_t jsvGetStringLength(const JsVar *v); ///< Get the length of this string, IF it is a string
+#ifdef JSV_STRING_TAIL_CACHE_SIZE
+JsVarRef jsvStringTailCacheGet(const JsVar *str, size_t *lastIndex); ///< If we remember a StringExt near the end of this string, return it and set lastIndex to the index of its first character (otherwise return 0)
+void jsvStringTailCacheSet(const JsVar *str, JsVar *last, size_t lastIndex); ///< Remember the last StringExt of this string (and the index of its first character)
+void jsvStringTailCacheForgetAll(); ///< Forget all remembered StringExts (eg. because variables have been freed or moved)
+#endif
+#ifdef JSV_STRING_SKIP_INDEX_SIZE
+JsVarRef jsvStringSkipIndexGet(const JsVar *str, size_t idx, size_t *extIndex); ///< If we remember a StringExt of this string at or before character 'idx', return it and set extIndex to the index of its first character (otherwise return 0)
+void jsvStringSkipIndexAdd(const JsVar *str, JsVar *ext, size_t extIndex); ///< We've walked to this StringExt of 'str' (and it starts at character 'extIndex') - remember it if it's worth it
+void jsvStringSkipIndexForgetAll(); ///< Forget all indexed strings (eg. because variables have been freed or moved)
+#endif
 size_t jsvGetFlatStringBlocks(const JsVar *v); ///< return the number of blocks used by the given flat string - EXCLUDING the first data block
 char *jsvGetFlatStringPointer(JsVar *v); ///< Get a pointer to the data in this flat string
 JsVar *jsvGetFlatStringFromPointer(char *v); ///< Given a pointer to the first element of a flat string, return the flat string itself (DANGEROUS!)
@@ -630,6 +644,7 @@ JsVar *jsvAsName(JsVar *var);
 
 /// MATHS!
 JsVar *jsvMathsOpSkipNames(JsVar *a, JsVar *b, int op);
+JsVar *jsvMathsOpSkipNamesAndUnLock(JsVar *a, JsVar *b, int op); ///< Like jsvMathsOpSkipNames, but unlocks a and b and may reuse them for the result
 bool jsvMathsOpTypeEqual(JsVar *a, JsVar *b);
 JsVar *jsvMathsOp(JsVar *a, JsVar *b, int op);
 /// Negates an integer/double value
@@ -652,6 +667,8 @@ JsVar *jsvSetNamedChild(JsVar *parent, JsVar *child, const char *name); // Add a
 JsVar *jsvSetValueOfName(JsVar *name, JsVar *src); // Set the value of a child created with jsvAddName,jsvAddNamedChild. Returns the UNLOCKED name argument
 JsVar *jsvFindChildFromString(JsVar *parent, const char *name, bool createIfNotFound); // Non-recursive finding of child with name. Returns a LOCKED var
 JsVar *jsvFindChildFromStringI(JsVar *parent, const char *name); ///< Find a child with a matching name using a case insensitive search
+JsVar *jsvFindChildFromStringWithIndex(JsVar *parent, const char *name, unsigned int *childIdx); ///< As jsvFindChildFromString (without creating), but also return the child's index in the list of children
+JsVar *jsvGetChildAtIndexIfNamed(JsVar *parent, unsigned int childIdx, const char *name); ///< Return the child at the given index in the list of children (LOCKED), but only if it has the given name
 JsVar *jsvFindChildFromVar(JsVar *parent, JsVar *childName, bool addIfNotFound); ///< Non-recursive finding of child with name. Returns a LOCKED var
 
 /// Remove a child - note that the child MUST ACTUALLY BE A CHILD! and should be a name, not a value.
@@ -710,6 +727,30 @@ void jsvTrace(JsVar *var, int indent);
 /** Run a garbage collection sweep - return nonzero if things have been freed */
 int jsvGarbageCollect();
 
+#ifndef SAVE_ON_FLASH
+/** Move variables towards the start of memory so that free variables are all
+ * together (so big flat strings can be allocated). Returns how many were moved */
+unsigned int jsvDefragment();
+#endif
+
+#ifdef JSV_GC_GREY_STACK_SIZE
+/** Do one slice of incremental garbage collection (looking at up to the number of
+ * variables set with jsvSetGarbageCollectBudget), starting a new collection if one
+ * isn't in progress. Returns true if the collection hasn't finished yet. */
+bool jsvGarbageCollectIncremental();
+/// Is there an incremental garbage collection in progress?
+bool jsvGarbageCollectInProgress();
+/// Should we start an incremental garbage collection? (when memory use has grown by a quarter since the last one, or memory is low)
+bool jsvGarbageCollectWanted();
+/// Set how many variables to look at in each slice of incremental garbage collection (0 = collect all in one go)
+void jsvSetGarbageCollectBudget(unsigned int budget);
+unsigned int jsvGetGarbageCollectBudget();
+/// How long the last full garbage collection spent marking variables that are in use
+JsSysTime jsvGetGarbageCollectMarkTime();
+/// The most variables waiting to be marked at once during the last garbage collection
+unsigned int jsvGetGarbageCollectMaxDepth();
+#endif
+
 #ifndef RELEASE
 // Dump any locked variables that aren't referenced from `global` - for debugging memory leaks
 void jsvDumpLockedVars();
@@ -171,6 +171,22 @@ void jsvStringIteratorNew(JsvStringIterator *it, JsVar *str, size_t startIdx) {
   } else{
     it->ptr = &it->var->varData.str[0];
   }
+#ifdef JSV_STRING_SKIP_INDEX_SIZE
+  // for long strings, skip to a StringExt near startIdx if we can
+  bool indexed = startIdx >= it->charsInVar && jsvGetLastChild(str);
+  if (indexed) {
+    size_t extIndex;
+    JsVarRef ext = jsvStringSkipIndexGet(str, startIdx, &extIndex);
+    if (ext) {
+      jsvUnLock(it->var);
+      it->var = jsvLock(ext);
+      it->ptr = &it->var->varData.str[0];
+      it->charsInVar = jsvGetCharactersInVar(it->var);
+      it->varIndex = extIndex;
+      it->charIdx = startIdx - extIndex;
+    }
+  }
+#endif
   while (it->charIdx>0 && it->charIdx >= it->charsInVar) {
     it->charIdx -= it->charsInVar;
     it->varIndex += it->charsInVar;
@@ -181,6 +197,9 @@ void jsvStringIteratorNew(JsvStringIterator *it, JsVar *str, size_t startIdx) {
         it->var = next;
         it->ptr = &next->varData.str[0];
         it->charsInVar = jsvGetCharactersInVar(it->var);
+#ifdef JSV_STRING_SKIP_INDEX_SIZE
+        if (indexed) jsvStringSkipIndexAdd(str, it->var, it->varIndex); // remember StringExts as we pass them
+#endif
       } else {
         jsvUnLock(it->var);
         it->var = 0;
@@ -220,8 +239,70 @@ void jsvStringIteratorNext(JsvStringIterator *it) {
   jsvStringIteratorNextInline(it);
 }
 
+bool jsvStringIteratorFindChar(JsvStringIterator *it, char ch) {
+  while (jsvStringIteratorHasChar(it)) {
+    if (!jsvIsNativeString(it->var)) {
+      // search the rest of this block all in one go
+      char *p = memchr(&it->ptr[it->charIdx], ch, it->charsInVar - it->charIdx);
+      if (p) {
+        it->charIdx = (size_t)(p - it->ptr);
+        return true;
+      }
+      it->charIdx = it->charsInVar-1;
+    } else if (jsvStringIteratorGetChar(it) == ch) {
+      // native strings may be in flash, so must be read with READ_FLASH_UINT8
+      return true;
+    }
+    jsvStringIteratorNextInline(it);
+  }
+  return false;
+}
+
+bool jsvStringIteratorFind(JsvStringIterator *it, JsVar *search) {
+  JsvStringIterator sit;
+  jsvStringIteratorNew(&sit, search, 0);
+  if (!jsvStringIteratorHasChar(&sit)) {
+    jsvStringIteratorFree(&sit);
+    return true; // the empty string is everywhere
+  }
+  char first = jsvStringIteratorGetChar(&sit);
+  jsvStringIteratorNext(&sit);
+  bool found = false;
+  // find the first character, then check the rest of the string matches
+  while (!found && jsvStringIteratorFindChar(it, first)) {
+    JsvStringIterator a = jsvStringIteratorClone(it);
+    JsvStringIterator b = jsvStringIteratorClone(&sit);
+    jsvStringIteratorNextInline(&a);
+    while (jsvStringIteratorHasChar(&b) && jsvStringIteratorHasChar(&a) &&
+           jsvStringIteratorGetChar(&a) == jsvStringIteratorGetChar(&b)) {
+      jsvStringIteratorNextInline(&a);
+      jsvStringIteratorNextInline(&b);
+    }
+    found = !jsvStringIteratorHasChar(&b);
+    jsvStringIteratorFree(&a);
+    jsvStringIteratorFree(&b);
+    if (!found) jsvStringIteratorNextInline(it);
+  }
+  jsvStringIteratorFree(&sit);
+  return found;
+}
+
 void jsvStringIteratorGotoEnd(JsvStringIterator *it) {
   assert(it->var);
+#ifdef JSV_STRING_TAIL_CACHE_SIZE
+  JsVar *str = 0;
+  if (it->varIndex==0 && jsvGetLastChild(it->var)) {
+    // skip straight to near the end if we can
+    str = it->var;
+    size_t lastIndex;
+    JsVarRef last = jsvStringTailCacheGet(str, &lastIndex);
+    if (last) {
+      it->var = jsvLock(last);
+      it->varIndex = lastIndex;
+      it->charsInVar = jsvGetCharactersInVar(it->var);
+    } else jsvLockAgain(str);
+  }
+#endif
   while (jsvGetLastChild(it->var)) {
     JsVar *next = jsvLock(jsvGetLastChild(it->var));
     jsvUnLock(it->var);
@@ -229,6 +310,12 @@ void jsvStringIteratorGotoEnd(JsvStringIterator *it) {
     it->varIndex += it->charsInVar;
     it->charsInVar = jsvGetCharactersInVar(it->var);
   }
+#ifdef JSV_STRING_TAIL_CACHE_SIZE
+  if (str) {
+    jsvStringTailCacheSet(str, it->var, it->varIndex);
+    jsvUnLock(str);
+  }
+#endif
   it->ptr = &it->var->varData.str[0];
   if (it->charsInVar) it->charIdx = it->charsInVar-1;
   else it->charIdx = 0;
@@ -268,6 +355,27 @@ void jsvStringIteratorAppend(JsvStringIterator *it, char ch) {
   jsvSetCharactersInVar(it->var, it->charsInVar);
 }
 
+void jsvStringIteratorAppendBuf(JsvStringIterator *it, const char *buf, size_t length) {
+  while (length && it->var) {
+    // Append one character normally - this adds a new StringExt if we're full...
+    jsvStringIteratorAppend(it, *(buf++));
+    length--;
+    if (!it->var) return; // out of memory
+    // ...then copy whatever fits in the rest of this block
+    size_t maxChars = jsvGetMaxCharactersInVar(it->var);
+    size_t n = (maxChars > it->charsInVar) ? maxChars - it->charsInVar : 0;
+    if (n > length) n = length;
+    if (n) {
+      memcpy(&it->ptr[it->charsInVar], buf, n);
+      it->charsInVar += n;
+      it->charIdx = it->charsInVar-1;
+      jsvSetCharactersInVar(it->var, it->charsInVar);
+      buf += n;
+      length -= n;
+    }
+  }
+}
+
 void jsvStringIteratorAppendString(JsvStringIterator *it, JsVar *str, size_t startIdx) {
   JsvStringIterator sit;
   jsvStringIteratorNew(&sit, str, startIdx);
@@ -102,12 +102,21 @@ static ALWAYS_INLINE void jsvStringIteratorNextInline(JsvStringIterator *it) {
 }
 
 
+/// Move forwards to the next occurrence of 'ch' and return true, or to the end of the string and return false
+bool jsvStringIteratorFindChar(JsvStringIterator *it, char ch);
+
+/// Move forwards to the next occurrence of the string 'search' and return true, or to the end of the string and return false
+bool jsvStringIteratorFind(JsvStringIterator *it, JsVar *search);
+
 /// Go to the end of the string iterator - for use with jsvStringIteratorAppend
 void jsvStringIteratorGotoEnd(JsvStringIterator *it);
 
 /// Append a character TO THE END of a string iterator
 void jsvStringIteratorAppend(JsvStringIterator *it, char ch);
 
+/// Append 'length' characters TO THE END of a string iterator, copying as many as will fit into each block at once
+void jsvStringIteratorAppendBuf(JsvStringIterator *it, const char *buf, size_t length);
+
 /// Append an entire JsVar string TO THE END of a string iterator
 void jsvStringIteratorAppendString(JsvStringIterator *it, JsVar *str, size_t startIdx);
 
@@ -21,6 +21,10 @@
 #include "jswrapper.h"
 #include "jsinteractive.h"
 #include "jstimer.h"
+#if defined(LINUX) && !defined(__MINGW32__)
+#include <signal.h>
+#include <sys/time.h>
+#endif
 
 /*JSON{
   "type" : "class",
@@ -710,6 +714,8 @@ Get Espruino's interpreter flags that control the way it handles your JavaScript
 * `pretokenise` - When adding functions, pre-minify them and tokenise reserved words
 * `unsafeFlash` - Some platforms stop writes/erases to interpreter memory to stop you bricking the device accidentally - this removes that protection
 * `unsyncFiles` - When writing files, *don't* flush all data to the SD card after each command (the default is *to* flush). This is much faster, but can cause filesystem damage if power is lost without the filesystem unmounted.
+* `tokeniseOnCall` - When a function is first called, store a tokenised copy of its code alongside it and execute from that on subsequent calls. Uses more memory, but functions that are called often run faster.
+* `tailCalls` - When a function ends with `return f(...)`, call `f` once the first function has returned rather than from inside it. This means tail-recursive functions can recurse as deeply as they like without running out of stack, but stack traces won't include the functions that made tail calls.
 */
 /*JSON{
   "type" : "staticmethod",
@@ -1124,6 +1130,56 @@ void jswrap_e_dumpFragmentation() {
 }
 #endif
 
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "setGCBudget",
+  "generate" : "jswrap_espruino_setGCBudget",
+  "params" : [
+    ["budget","int","The number of variables to look at each time around the idle loop, or 0 to collect garbage all in one go"]
+  ]
+}
+Normally, Espruino collects garbage (data that refers to itself but that
+isn't referenced from anywhere else) all in one go when it is idle and
+memory is getting low. On devices with a lot of memory this can take
+several milliseconds.
+
+If a budget is set, garbage is instead collected a little at a time, each
+time around the idle loop, looking at no more than `budget` variables each
+time. This starts whenever memory use has grown by a quarter of the total
+since the last collection, or when memory is low. Running out of memory will still cause a full collection.
+
+For instance `E.setGCBudget(200)`.
+ */
+void jswrap_espruino_setGCBudget(int budget) {
+  jsvSetGarbageCollectBudget((budget>0) ? (unsigned int)budget : 0);
+}
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "defrag",
+  "generate" : "jswrap_espruino_defrag",
+  "return" : ["int","The number of variables that were moved"]
+}
+After a lot of allocations and frees, free memory can end up in lots of
+small pieces between the variables that are in use (see `E.dumpFragmentation()`).
+Big flat strings (eg. for `ArrayBuffer`s) need memory that is all in one
+piece, so may not be able to be allocated even if there's enough free memory.
+
+This moves variables towards the start of memory so that free memory is all
+together. Variables that are currently in use by native code can't be moved,
+and nothing will be moved while a `Waveform` is running.
+
+This is also done automatically if a flat string can't be allocated even
+though there is enough free memory.
+ */
+int jswrap_espruino_defrag() {
+  return (int)jsvDefragment();
+}
+
 /*JSON{
   "type" : "staticmethod",
   "ifndef" : "SAVE_ON_FLASH",
@@ -1194,6 +1250,109 @@ JsVar *jswrap_espruino_getSizeOf(JsVar *v, int depth) {
   return jsvNewFromInteger((JsVarInt)jsvCountJsVarsUsed(v));
 }
 
+/*JSON{
+  "type" : "staticmethod",
+  "ifdef" : "LINUX",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "getInlineCacheStats",
+  "generate" : "jswrap_espruino_getInlineCacheStats",
+  "return" : ["JsVar","An object containing `hits` and `misses`"]
+}
+Member accesses in code (like `a.b`) remember where they found the field
+the last time they ran, so that they don't have to search for it again.
+This returns how many member accesses have been able to use what they
+remembered (`hits`) and how many had to search (`misses`) since Espruino
+started, which can help when trying to make code faster.
+
+**Note:** This is only available on Linux builds of Espruino
+ */
+#ifdef JSP_INLINE_CACHE_SIZE
+JsVar *jswrap_espruino_getInlineCacheStats() {
+  JsVar *obj = jsvNewObject();
+  if (!obj) return 0;
+  jsvObjectSetChildAndUnLock(obj, "hits", jsvNewFromInteger((JsVarInt)jspInlineCacheHits));
+  jsvObjectSetChildAndUnLock(obj, "misses", jsvNewFromInteger((JsVarInt)jspInlineCacheMisses));
+  return obj;
+}
+#endif
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "profileStart",
+  "generate" : "jswrap_espruino_profileStart",
+  "params" : [
+    ["interval","float","The time in milliseconds between samples (default 1)"]
+  ]
+}
+Start the sampling profiler. Every `interval` milliseconds, Espruino will
+make a note of which function and line of code it is executing, and which
+functions called it. Call `E.profileStop()` to stop and get the results.
+
+Samples are taken at the start of the next statement to be executed, and on
+Linux `interval` is measured in CPU time, so time spent idle isn't counted.
+ */
+#if defined(LINUX) && !defined(__MINGW32__)
+static void jswrap_espruino_profileSignal(int sig) {
+  NOT_USED(sig);
+  jspProfileSampleDue = true;
+}
+#else
+static void jswrap_espruino_profileTimer(JsSysTime time, void *userdata) {
+  NOT_USED(time);
+  NOT_USED(userdata);
+  jspProfileSampleDue = true;
+}
+#endif
+
+void jswrap_espruino_profileStart(JsVarFloat interval) {
+  if (!(interval>0)) interval = 1; // also catches NaN (undefined)
+  jspProfileStart();
+#if defined(LINUX) && !defined(__MINGW32__)
+  signal(SIGPROF, jswrap_espruino_profileSignal);
+  struct itimerval timer;
+  timer.it_interval.tv_sec = (time_t)(interval/1000);
+  timer.it_interval.tv_usec = (suseconds_t)(fmod(interval,1000)*1000);
+  if (!timer.it_interval.tv_sec && !timer.it_interval.tv_usec)
+    timer.it_interval.tv_usec = 1;
+  timer.it_value = timer.it_interval;
+  setitimer(ITIMER_PROF, &timer, 0);
+#else
+  JsSysTime period = jshGetTimeFromMilliseconds(interval);
+  jstStopExecuteFn(jswrap_espruino_profileTimer, 0);
+  jstExecuteFn(jswrap_espruino_profileTimer, 0, jshGetSystemTime()+period, (uint32_t)period);
+#endif
+}
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "profileStop",
+  "generate" : "jswrap_espruino_profileStop",
+  "return" : ["JsVar","An object containing the profiling results (or undefined if the profiler wasn't running)"]
+}
+Stop the sampling profiler started with `E.profileStart()` and return what it
+found, as an object containing:
+
+* `samples` - the total number of samples taken
+* `functions` - an object of function names and how many samples were in each one. Code that's not in a function is called `(root)`
+* `lines` - an object of `function:line` and how many samples were on each line
+* `stacks` - an object of call stacks (function names, outermost first, separated by `;`) and how many samples were in each one
+* `folded` - `stacks` as a string with one stack and count per line, which can be given to flame graph tools
+ */
+JsVar *jswrap_espruino_profileStop() {
+#if defined(LINUX) && !defined(__MINGW32__)
+  struct itimerval timer;
+  memset(&timer, 0, sizeof(timer));
+  setitimer(ITIMER_PROF, &timer, 0);
+#else
+  jstStopExecuteFn(jswrap_espruino_profileTimer, 0);
+#endif
+  return jspProfileStop();
+}
 
 /*JSON{
   "type" : "staticmethod",
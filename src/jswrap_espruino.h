@@ -44,7 +44,12 @@ void jswrap_espruino_dumpTimers();
 void jswrap_espruino_dumpLockedVars();
 void jswrap_espruino_dumpFreeList();
 void jswrap_e_dumpFragmentation();
+void jswrap_espruino_setGCBudget(int budget);
+int jswrap_espruino_defrag();
 JsVar *jswrap_espruino_getSizeOf(JsVar *v, int depth);
+JsVar *jswrap_espruino_getInlineCacheStats();
+void jswrap_espruino_profileStart(JsVarFloat interval);
+JsVar *jswrap_espruino_profileStop();
 JsVarInt jswrap_espruino_getAddressOf(JsVar *v, bool flatAddress);
 void jswrap_espruino_mapInPlace(JsVar *from, JsVar *to, JsVar *map, JsVarInt bits);
 JsVar *jswrap_espruino_lookupNoCase(JsVar *haystack, JsVar *needle, bool returnKey);
@@ -76,49 +76,230 @@ JsVar *jswrap_json_stringify(JsVar *v, JsVar *replacer, JsVar *space) {
 }
 
 
-JsVar *jswrap_json_parse_internal() {
-  switch (lex->tk) {
-  case LEX_R_TRUE:  jslGetNextToken(lex); return jsvNewFromBool(true);
-  case LEX_R_FALSE: jslGetNextToken(lex); return jsvNewFromBool(false);
-  case LEX_R_NULL:  jslGetNextToken(lex); return jsvNewWithFlags(JSV_NULL);
-  case '-': {
-    jslGetNextToken(lex);
-    if (lex->tk!=LEX_INT && lex->tk!=LEX_FLOAT) return 0;
-    JsVar *v = jswrap_json_parse_internal(lex);
-    JsVar *zero = jsvNewFromInteger(0);
-    JsVar *r = jsvMathsOp(zero, v, '-');
-    jsvUnLock2(v, zero);
-    return r;
+/// State for parsing JSON straight out of a String, without using the JS lexer
+typedef struct {
+  JsvStringIterator it;
+  int ch; ///< The current character, or -1 at the end
+  bool error;
+} JsonParser;
+
+static ALWAYS_INLINE void jsonNextCh(JsonParser *p) {
+  jsvStringIteratorNextInline(&p->it);
+  p->ch = jsvStringIteratorHasChar(&p->it) ? (unsigned char)jsvStringIteratorGetChar(&p->it) : -1;
+}
+
+static void jsonSkipWhitespace(JsonParser *p) {
+  while (p->ch==' ' || p->ch=='\n' || p->ch=='\r' || p->ch=='\t')
+    jsonNextCh(p);
+}
+
+static void jsonError(JsonParser *p, const char *expecting) {
+  if (p->error) return;
+  p->error = true;
+  if (p->ch<0) {
+    jsExceptionHere(JSET_SYNTAXERROR, "Expecting %s in JSON, got end of input", expecting);
+  } else {
+    char got[4] = "'?'";
+    got[1] = (char)p->ch;
+    jsExceptionHere(JSET_SYNTAXERROR, "Expecting %s in JSON at position %d, got %s", expecting, (int)jsvStringIteratorGetIndex(&p->it), got);
+  }
+}
+
+/// If the current character is 'ch', skip it and any whitespace after and return true
+static bool jsonMatch(JsonParser *p, char ch) {
+  if (p->ch!=(unsigned char)ch) return false;
+  jsonNextCh(p);
+  jsonSkipWhitespace(p);
+  return true;
+}
+
+/// Skip the given word (we've already checked the first character)
+static bool jsonMatchWord(JsonParser *p, const char *word) {
+  while (*word) {
+    if (p->ch!=(unsigned char)*word) {
+      jsonError(p, "a valid value");
+      return false;
+    }
+    jsonNextCh(p);
+    word++;
+  }
+  jsonSkipWhitespace(p);
+  return true;
+}
+
+static int jsonHexDigit(JsonParser *p) {
+  int d = (p->ch>=0) ? chtod((char)p->ch) : -1;
+  if (d<0 || d>15) {
+    jsonError(p, "a hex digit");
+    return 0;
+  }
+  jsonNextCh(p);
+  return d;
+}
+
+/// Add the characters in buf to the string we're building (creating it if needed)
+static JsVar *jsonFlushString(JsVar *str, JsvStringIterator *dst, const char *buf, size_t len) {
+  if (!str) {
+    // most strings are short, so we can create them all in one go
+    str = len ? jsvNewStringOfLength((unsigned int)len, buf) : jsvNewFromEmptyString();
+    if (!str) return 0;
+    jsvStringIteratorNew(dst, str, 0);
+    jsvStringIteratorGotoEnd(dst);
+  } else
+    jsvStringIteratorAppendBuf(dst, buf, len);
+  return str;
+}
+
+/// Parse a string - we're on the opening quote
+static JsVar *jsonParseString(JsonParser *p) {
+  int delim = p->ch; // we allow ' as well as ", as the JS lexer we used to use did
+  jsonNextCh(p);
+  JsVar *str = 0;
+  JsvStringIterator dst;
+  char buf[JSLEX_MAX_TOKEN_LENGTH];
+  size_t len = 0;
+  while (p->ch!=delim) {
+    if (p->ch<0) {
+      jsonError(p, "end of string");
+      break;
+    }
+    char ch = (char)p->ch;
+    jsonNextCh(p);
+    if (ch=='\\') {
+      ch = (char)p->ch;
+      jsonNextCh(p);
+      switch (ch) {
+        case 'n': ch = 0x0A; break;
+        case 'b': ch = 0x08; break;
+        case 'f': ch = 0x0C; break;
+        case 'r': ch = 0x0D; break;
+        case 't': ch = 0x09; break;
+        case 'v': ch = 0x0B; break;
+        case 'u':
+          // We don't support unicode, so we just take the bottom 8 bits of the character (like the JS lexer)
+          jsonHexDigit(p);
+          jsonHexDigit(p);
+          // fall through
+        case 'x': { // JSON.stringify writes \xHH for control characters
+          int hi = jsonHexDigit(p);
+          ch = (char)((hi<<4) | jsonHexDigit(p));
+        } break;
+        default:
+          if (ch>='0' && ch<='7') {
+            // up to 3 octal digits - JSON.stringify writes \0 to \7
+            int n = ch-'0', digits = 1;
+            while (digits<3 && p->ch>='0' && p->ch<='7') {
+              n = n*8 + (p->ch-'0');
+              jsonNextCh(p);
+              digits++;
+            }
+            ch = (char)n;
+          }
+          break; // '"', '\\', '/', etc
+      }
+    }
+    if (len==sizeof(buf)) {
+      str = jsonFlushString(str, &dst, buf, len);
+      if (!str) return 0;
+      len = 0;
+    }
+    buf[len++] = ch;
+  }
+  if (!p->error) str = jsonFlushString(str, &dst, buf, len);
+  if (str) jsvStringIteratorFree(&dst);
+  if (p->error) {
+    jsvUnLock(str);
+    return 0;
+  }
+  jsonNextCh(p); // closing quote
+  jsonSkipWhitespace(p);
+  return str;
+}
+
+/// Parse a number - integers are built up as we go, and anything else is passed to stringToFloat
+static JsVar *jsonParseNumber(JsonParser *p) {
+  char buf[JSLEX_MAX_TOKEN_LENGTH];
+  size_t len = 0;
+  bool isFloat = false;
+  long long v = 0;
+  int digits = 0;
+  bool negate = p->ch=='-';
+  if (negate) {
+    buf[len++] = '-';
+    jsonNextCh(p);
+  }
+  while (p->ch>='0' && p->ch<='9') {
+    v = v*10 + (p->ch-'0');
+    digits++;
+    if (len<sizeof(buf)-1) buf[len++] = (char)p->ch;
+    jsonNextCh(p);
+  }
+  if (!digits && p->ch!='.') { // '.5' is allowed, as the JS lexer we used to use allowed it
+    jsonError(p, "a valid value");
+    return 0;
   }
-  case LEX_INT: {
-    long long v = stringToInt(jslGetTokenValueAsString(lex));
-    jslGetNextToken(lex);
+  if (digits==1 && v==0 && (p->ch=='x' || p->ch=='X' || p->ch=='b' || p->ch=='B' || p->ch=='o' || p->ch=='O')) {
+    // 0x, 0b and 0o integers - the JS lexer we used to use allowed them
+    buf[len++] = (char)p->ch;
+    jsonNextCh(p);
+    size_t prefixLen = len;
+    while (isAlpha((char)p->ch) || isNumeric((char)p->ch)) {
+      if (len<sizeof(buf)-1) buf[len++] = (char)p->ch;
+      jsonNextCh(p);
+    }
+    buf[len] = 0;
+    bool hasError;
+    const char *end;
+    v = stringToIntWithRadix(buf, 0, &hasError, &end);
+    if (hasError || *end || len==prefixLen) {
+      jsonError(p, "a valid value");
+      return 0;
+    }
+    jsonSkipWhitespace(p);
     return jsvNewFromLongInteger(v);
   }
-  case LEX_FLOAT: {
-    JsVarFloat v = stringToFloat(jslGetTokenValueAsString(lex));
-    jslGetNextToken(lex);
-    return jsvNewFromFloat(v);
+  if (p->ch=='.' || p->ch=='e' || p->ch=='E') {
+    isFloat = true;
+    while ((p->ch>='0' && p->ch<='9') || p->ch=='.' || p->ch=='e' || p->ch=='E' || p->ch=='+' || p->ch=='-') {
+      if (p->ch>='0' && p->ch<='9') digits++;
+      if (len<sizeof(buf)-1) buf[len++] = (char)p->ch;
+      jsonNextCh(p);
+    }
+    if (!digits) {
+      jsonError(p, "a valid value");
+      return 0;
+    }
   }
-  case LEX_STR: {
-    JsVar *a = jslGetTokenValueAsVar(lex);
-    jslGetNextToken(lex);
-    return a;
+  buf[len] = 0;
+  jsonSkipWhitespace(p);
+  // 18 digits always fit in a long long
+  if (isFloat || digits>18)
+    return jsvNewFromFloat(stringToFloat(buf));
+  return jsvNewFromLongInteger(negate ? -v : v);
+}
+
+static JsVar *jsonParseValue(JsonParser *p) {
+  if (!jspCheckStackPosition()) {
+    p->error = true;
+    return 0;
   }
+  switch (p->ch) {
+  case 't': return jsonMatchWord(p, "true") ? jsvNewFromBool(true) : 0;
+  case 'f': return jsonMatchWord(p, "false") ? jsvNewFromBool(false) : 0;
+  case 'n': return jsonMatchWord(p, "null") ? jsvNewWithFlags(JSV_NULL) : 0;
+  case '"': case '\'': return jsonParseString(p);
   case '[': {
     JsVar *arr = jsvNewEmptyArray(); if (!arr) return 0;
-    jslGetNextToken(lex); // [
-    while (lex->tk != ']' && !jspHasError()) {
-      JsVar *value = jswrap_json_parse_internal(lex);
-      if (!value ||
-          (lex->tk!=']' && !jslMatch(','))) {
-        jsvUnLock2(value, arr);
-        return 0;
-      }
-      jsvArrayPush(arr, value);
-      jsvUnLock(value);
-    }
-    if (!jslMatch(']')) {
+    jsonMatch(p, '[');
+    if (jsonMatch(p, ']')) return arr;
+    do {
+      if (p->ch==']') break; // trailing comma - the JS lexer we used to use allowed it
+      JsVar *value = jsonParseValue(p);
+      if (!value) break;
+      jsvArrayPushAndUnLock(arr, value);
+    } while (jsonMatch(p, ','));
+    if (!p->error && !jsonMatch(p, ']')) jsonError(p, "',' or ']'");
+    if (p->error) {
       jsvUnLock(arr);
       return 0;
     }
@@ -126,33 +307,40 @@ JsVar *jswrap_json_parse_internal() {
   }
   case '{': {
     JsVar *obj = jsvNewObject(); if (!obj) return 0;
-    jslGetNextToken(lex); // {
-    while (lex->tk == LEX_STR && !jspHasError()) {
-      JsVar *key = jsvAsArrayIndexAndUnLock(jslGetTokenValueAsVar(lex));
-      jslGetNextToken(lex);
+    jsonMatch(p, '{');
+    if (jsonMatch(p, '}')) return obj;
+    do {
+      if (p->ch=='}') break; // trailing comma
+      if (p->ch!='"' && p->ch!='\'') {
+        jsonError(p, "a string key");
+        break;
+      }
+      JsVar *key = jsonParseString(p);
+      if (!key) break;
+      key = jsvAsArrayIndexAndUnLock(key);
       JsVar *value = 0;
-      if (!jslMatch(':') ||
-          !(value=jswrap_json_parse_internal(lex)) ||
-          (lex->tk!='}' && !jslMatch(','))) {
-        jsvUnLock3(key, value, obj);
-        return 0;
+      if (!jsonMatch(p, ':')) jsonError(p, "':'");
+      else value = jsonParseValue(p);
+      if (!value) {
+        jsvUnLock(key);
+        break;
       }
       jsvAddName(obj, jsvMakeIntoVariableName(key, value));
       jsvUnLock2(value, key);
-    }
-    if (!jslMatch('}')) {
+    } while (jsonMatch(p, ','));
+    if (!p->error && !jsonMatch(p, '}')) jsonError(p, "',' or '}'");
+    if (p->error) {
       jsvUnLock(obj);
       return 0;
     }
     return obj;
   }
-  default: {
-    char buf[32];
-    jslTokenAsString(lex->tk, buf, 32);
-    jsExceptionHere(JSET_SYNTAXERROR, "Expecting a valid value, got %s", buf);
+  default:
+    if (p->ch=='-' || p->ch=='.' || (p->ch>='0' && p->ch<='9'))
+      return jsonParseNumber(p);
+    jsonError(p, "a valid value");
     return 0; // undefined = error
   }
-  }
 }
 
 /*JSON{
@@ -167,20 +355,484 @@ JsVar *jswrap_json_parse_internal() {
 }
 Parse the given JSON string into a JavaScript object
 
-NOTE: This implementation uses eval() internally, and as such it is unsafe as it can allow arbitrary JS commands to be executed.
+The string is scanned directly, so no JavaScript code in it is ever executed.
  */
 JsVar *jswrap_json_parse(JsVar *v) {
-  JsLex lex;
   JsVar *str = jsvAsString(v);
-  JsLex *oldLex = jslSetLex(&lex);
-  jslInit(str);
+  if (!str) return 0;
+  JsonParser p;
+  p.error = false;
+  jsvStringIteratorNew(&p.it, str, 0);
+  p.ch = jsvStringIteratorHasChar(&p.it) ? (unsigned char)jsvStringIteratorGetChar(&p.it) : -1;
+  jsonSkipWhitespace(&p);
+  JsVar *res = jsonParseValue(&p);
+  jsvStringIteratorFree(&p.it);
   jsvUnLock(str);
-  JsVar *res = jswrap_json_parse_internal();
-  jslKill();
-  jslSetLex(oldLex);
   return res;
 }
 
+/*JSON{
+  "type" : "class",
+  "class" : "JSONParser",
+  "ifndef" : "SAVE_ON_FLASH"
+}
+A parser for JSON that is given its data a bit at a time (for instance from
+`Serial.on('data', ...)`, a socket, or `pipe`), so the whole document never
+has to be in memory at once.
+
+Values are reported with the `value` event as soon as they have been parsed.
+By default only simple values (strings, numbers, booleans and `null`) are
+reported, along with the 'path' of keys and array indices needed to get to
+them from the top of the document:
+
+```
+var p = new JSONParser();
+p.on('value', function(value, path) { print(path.join("."), "=", value); });
+p.write('{"fw":{"version":"2v01","files":[{"name":"a"');
+p.write(',"size":200}]}}');
+p.end();
+// fw.version = 2v01
+// fw.files.0.name = a
+// fw.files.0.size = 200
+```
+
+If you supply a `select` function, it is called with the path whenever an
+object or array starts. If it returns true, the object or array is built
+in memory and reported whole with a single `value` event:
+
+```
+var p = new JSONParser({ select : function(path) { return path[1]=="files" && path.length==3; } });
+p.on('value', function(value, path) { ... }); // called with {"name":"a","size":200}, ["fw","files",0]
+```
+
+More than one document can be written one after the other (eg. one
+document per line). Only the current path, the current string or number,
+and objects or arrays that were selected are stored, so documents far
+larger than the available memory can be processed.
+*/
+/*JSON{
+  "type" : "event",
+  "class" : "JSONParser",
+  "name" : "value",
+  "params" : [
+    ["value","JsVar","The value that was parsed"],
+    ["path","JsVar","An array of the keys and array indices needed to get to the value from the top of the document"]
+  ],
+  "ifndef" : "SAVE_ON_FLASH"
+}
+Called with each simple value, or object or array that was selected, as soon as it has been parsed
+*/
+/*JSON{
+  "type" : "event",
+  "class" : "JSONParser",
+  "name" : "end",
+  "ifndef" : "SAVE_ON_FLASH"
+}
+Called when `end()` is called, after any remaining value has been reported
+*/
+
+#define JSON_PARSER_STATE_NAME JS_HIDDEN_CHAR_STR"st" // what we're expecting next - see JsonParserState
+#define JSON_PARSER_PATH_NAME JS_HIDDEN_CHAR_STR"pth" // keys/indices from the top of the document to where we are
+#define JSON_PARSER_TOKEN_NAME JS_HIDDEN_CHAR_STR"tok" // the string, number or word we're part way through
+#define JSON_PARSER_BUILD_NAME JS_HIDDEN_CHAR_STR"bld" // the selected objects/arrays that we're building
+#define JSON_PARSER_SELECT_NAME JS_HIDDEN_CHAR_STR"sel" // the 'select' function
+
+typedef enum {
+  JSONP_VALUE,  ///< Expecting a value
+  JSONP_KEY,    ///< Expecting a key
+  JSONP_COLON,  ///< Expecting ':' after a key
+  JSONP_AFTER,  ///< Expecting ',' or the end of an object or array
+  JSONP_STRING,
+  JSONP_NUMBER,
+  JSONP_WORD,   ///< true, false or null
+  JSONP_ERROR,  ///< There was an error - ignore everything until end()
+  JSONP_STATE_MASK = 15,
+  JSONP_EMPTY_OK = 16, ///< We've just started an object or array (or had a ','), so it can end straight away
+  JSONP_IS_KEY = 32,   ///< The string we're reading is a key
+  JSONP_ESCAPE = 64,   ///< The last character of the string was a '\'
+  JSONP_HEX_SHIFT = 7, ///< Bits 7-9 are the number of digits left to read for '\u', '\x' or an octal escape, and bits 10-17 the character so far
+  JSONP_HEX_MASK = 7 << JSONP_HEX_SHIFT,
+  JSONP_HEX_CHAR_SHIFT = 10,
+  JSONP_OCTAL = 1 << 18, ///< The digits we're reading are octal (these may end early)
+} JsonParserState;
+
+/// What we need while parsing the data from one call to write()
+typedef struct {
+  JsVar *parser;
+  int state;
+  JsVar *path;
+  JsVar *token;
+  JsVar *build;
+  char buf[32]; ///< Characters waiting to be appended to token
+  size_t bufLen;
+} JsonStreamParser;
+
+/*JSON{
+  "type" : "constructor",
+  "class" : "JSONParser",
+  "name" : "JSONParser",
+  "generate" : "jswrap_jsonparser_constructor",
+  "params" : [
+    ["options","JsVar","(optional) An object containing `{ select : function(path) { return true to build this object/array whole } }`"]
+  ],
+  "return" : ["JsVar","A JSONParser object"],
+  "return_object" : "JSONParser",
+  "ifndef" : "SAVE_ON_FLASH"
+}
+Create a parser for JSON that is written to it a bit at a time
+*/
+JsVar *jswrap_jsonparser_constructor(JsVar *options) {
+  JsVar *parser = jspNewObject(0, "JSONParser");
+  if (!parser) return 0;
+  if (jsvIsObject(options)) {
+    JsVar *select = jsvObjectGetChild(options, "select", 0);
+    if (jsvIsFunction(select))
+      jsvObjectSetChild(parser, JSON_PARSER_SELECT_NAME, select);
+    else if (select)
+      jsExceptionHere(JSET_TYPEERROR, "Expecting options.select to be a function, got %t", select);
+    jsvUnLock(select);
+  }
+  return parser;
+}
+
+static void jsonpError(JsonStreamParser *p, const char *expecting, int ch) {
+  char got[4] = "'?'";
+  got[1] = (char)ch;
+  jsExceptionHere(JSET_SYNTAXERROR, "Expecting %s in JSON, got %s", expecting, got);
+  p->state = JSONP_ERROR;
+}
+
+static void jsonpTokenStart(JsonStreamParser *p, int state, char ch) {
+  jsvUnLock(p->token);
+  p->token = jsvNewFromEmptyString();
+  p->bufLen = 0;
+  if (ch) p->buf[p->bufLen++] = ch;
+  p->state = state;
+}
+
+static void jsonpTokenFlush(JsonStreamParser *p) {
+  if (p->token && p->bufLen)
+    jsvAppendStringBuf(p->token, p->buf, p->bufLen);
+  p->bufLen = 0;
+}
+
+static void jsonpTokenAppend(JsonStreamParser *p, char ch) {
+  if (p->bufLen == sizeof(p->buf))
+    jsonpTokenFlush(p);
+  p->buf[p->bufLen++] = ch;
+}
+
+/// Return the token (and forget about it)
+static JsVar *jsonpTokenGet(JsonStreamParser *p) {
+  jsonpTokenFlush(p);
+  JsVar *token = p->token;
+  p->token = 0;
+  return token;
+}
+
+/// Call the 'value' event with the value and a copy of the path
+static void jsonpEmit(JsonStreamParser *p, JsVar *value) {
+  JsVar *args[2];
+  args[0] = value;
+  args[1] = jsvCopy(p->path, true);
+  jsiExecuteObjectCallbacks(p->parser, JS_EVENT_PREFIX"value", args, 2);
+  jsvUnLock(args[1]);
+  if (jspHasError()) p->state = JSONP_ERROR;
+}
+
+/// Put a value in the object/array we're building that contains it
+static void jsonpAddToParent(JsonStreamParser *p, JsVar *parent, JsVar *value) {
+  if (jsvIsArray(parent)) {
+    jsvArrayPush(parent, value);
+  } else {
+    JsVar *key = jsvGetArrayItem(p->path, jsvGetArrayLength(p->path)-1);
+    JsVar *index = jsvAsArrayIndexAndUnLock(key);
+    jsvObjectSetChildVar(parent, index, value);
+    jsvUnLock(index);
+  }
+}
+
+/// Returns the object/array at the top of the build stack (or 0 if we're not building anything)
+static JsVar *jsonpBuildTop(JsonStreamParser *p) {
+  JsVarInt depth = jsvGetArrayLength(p->build);
+  return depth ? jsvGetArrayItem(p->build, depth-1) : 0;
+}
+
+/// We've got a whole value - either add it to what we're building, or report it. Unlocks value
+static void jsonpValue(JsonStreamParser *p, JsVar *value) {
+  p->state = JSONP_AFTER;
+  JsVar *parent = jsonpBuildTop(p);
+  if (parent) jsonpAddToParent(p, parent, value);
+  else jsonpEmit(p, value);
+  jsvUnLock2(parent, value);
+}
+
+/// An object or array is starting
+static void jsonpOpen(JsonStreamParser *p, bool isArray) {
+  JsVar *parent = jsonpBuildTop(p);
+  JsVar *container = 0;
+  if (parent) {
+    container = isArray ? jsvNewEmptyArray() : jsvNewObject();
+    jsonpAddToParent(p, parent, container);
+  } else {
+    JsVar *select = jsvObjectGetChild(p->parser, JSON_PARSER_SELECT_NAME, 0);
+    if (select) {
+      JsVar *path = jsvCopy(p->path, true);
+      if (jsvGetBoolAndUnLock(jspExecuteFunction(select, p->parser, 1, &path)))
+        container = isArray ? jsvNewEmptyArray() : jsvNewObject();
+      jsvUnLock2(path, select);
+      if (jspHasError()) {
+        jsvUnLock2(parent, container);
+        p->state = JSONP_ERROR;
+        return;
+      }
+    }
+  }
+  if (container) jsvArrayPush(p->build, container);
+  jsvUnLock2(parent, container);
+  // arrays start at index 0, and objects get their key later
+  jsvArrayPushAndUnLock(p->path, isArray ? jsvNewFromInteger(0) : jsvNewFromEmptyString());
+  p->state = (isArray ? JSONP_VALUE : JSONP_KEY) | JSONP_EMPTY_OK;
+}
+
+/// An object or array has finished
+static void jsonpClose(JsonStreamParser *p) {
+  jsvUnLock(jsvArrayPop(p->path));
+  JsVarInt depth = jsvGetArrayLength(p->build);
+  p->state = JSONP_AFTER;
+  // if we were building it, and it's not inside something else we're building, report it
+  if (depth) {
+    JsVar *container = jsvSkipNameAndUnLock(jsvArrayPop(p->build));
+    if (depth==1) jsonpEmit(p, container);
+    jsvUnLock(container);
+  }
+}
+
+/// A number or word has finished - turn it into a value
+static void jsonpFinishToken(JsonStreamParser *p) {
+  JsVar *token = jsonpTokenGet(p);
+  char buf[JSLEX_MAX_TOKEN_LENGTH];
+  size_t len = jsvGetString(token, buf, sizeof(buf));
+  jsvUnLock(token);
+  JsVar *value = 0;
+  if ((p->state & JSONP_STATE_MASK) == JSONP_WORD) {
+    if (!strcmp(buf, "true")) value = jsvNewFromBool(true);
+    else if (!strcmp(buf, "false")) value = jsvNewFromBool(false);
+    else if (!strcmp(buf, "null")) value = jsvNewWithFlags(JSV_NULL);
+  } else {
+    bool isFloat = len>18; // 18 digits always fit in a long long
+    size_t i, digits = 0;
+    for (i=0;i<len;i++) {
+      if (isNumeric(buf[i])) digits++;
+      else if (buf[i]!='-' || i) isFloat = true;
+    }
+    if (digits) {
+      if (isFloat) {
+        JsVarFloat f = stringToFloat(buf);
+        if (!isnan(f)) value = jsvNewFromFloat(f);
+      } else
+        value = jsvNewFromLongInteger(stringToIntWithRadix(buf, 10, 0, 0));
+    }
+  }
+  if (!value) {
+    jsExceptionHere(JSET_SYNTAXERROR, "Expecting a valid value in JSON, got '%s'", buf);
+    p->state = JSONP_ERROR;
+    return;
+  }
+  jsonpValue(p, value);
+}
+
+/// Handle one character of JSON
+static void jsonpChar(int ch, void *data) {
+  JsonStreamParser *p = (JsonStreamParser*)data;
+  ch &= 255;
+  bool again = true;
+  while (again) {
+    again = false;
+    int state = p->state & JSONP_STATE_MASK;
+    if (state==JSONP_ERROR) return;
+    if (isWhitespace((char)ch) && state<JSONP_STRING)
+      return; // whitespace between values
+    switch (state) {
+      case JSONP_VALUE:
+        if (ch=='{' || ch=='[') jsonpOpen(p, ch=='[');
+        else if (ch=='"') jsonpTokenStart(p, JSONP_STRING, 0);
+        else if (ch=='-' || ch=='.' || isNumeric((char)ch)) jsonpTokenStart(p, JSONP_NUMBER, (char)ch);
+        else if (ch=='t' || ch=='f' || ch=='n') jsonpTokenStart(p, JSONP_WORD, (char)ch);
+        else if (ch==']' && (p->state & JSONP_EMPTY_OK)) jsonpClose(p);
+        else jsonpError(p, "a valid value", ch);
+        break;
+      case JSONP_KEY:
+        if (ch=='"') jsonpTokenStart(p, JSONP_STRING|JSONP_IS_KEY, 0);
+        else if (ch=='}' && (p->state & JSONP_EMPTY_OK)) jsonpClose(p);
+        else jsonpError(p, "a string key", ch);
+        break;
+      case JSONP_COLON:
+        if (ch==':') p->state = JSONP_VALUE;
+        else jsonpError(p, "':'", ch);
+        break;
+      case JSONP_AFTER: {
+        JsVarInt depth = jsvGetArrayLength(p->path);
+        if (!depth) { // the last document has finished, so this is the start of another
+          p->state = JSONP_VALUE;
+          again = true;
+          break;
+        }
+        JsVar *last = jsvGetArrayItem(p->path, depth-1);
+        bool inArray = jsvIsInt(last);
+        if (ch==',') {
+          if (inArray) {
+            JsVar *index = jsvNewFromInteger(jsvGetInteger(last)+1);
+            jsvSetArrayItem(p->path, depth-1, index);
+            jsvUnLock(index);
+          }
+          p->state = (inArray ? JSONP_VALUE : JSONP_KEY) | JSONP_EMPTY_OK; // JSON.parse allows a trailing comma
+        } else if (ch==(inArray ? ']' : '}')) {
+          jsonpClose(p);
+        } else
+          jsonpError(p, inArray ? "',' or ']'" : "',' or '}'", ch);
+        jsvUnLock(last);
+      } break;
+      case JSONP_STRING:
+        if (p->state & JSONP_OCTAL) {
+          int left = (p->state & JSONP_HEX_MASK) >> JSONP_HEX_SHIFT;
+          int oct = (p->state >> JSONP_HEX_CHAR_SHIFT) & 255;
+          if (ch>='0' && ch<='7') {
+            oct = ((oct << 3) | (ch-'0')) & 255;
+            left--;
+          } else {
+            left = 0;
+            again = true; // this character isn't part of the escape
+          }
+          if (left) {
+            p->state = (p->state & (JSONP_STATE_MASK|JSONP_IS_KEY|JSONP_OCTAL)) | (left << JSONP_HEX_SHIFT) | (oct << JSONP_HEX_CHAR_SHIFT);
+          } else {
+            jsonpTokenAppend(p, (char)oct);
+            p->state &= JSONP_STATE_MASK|JSONP_IS_KEY;
+          }
+        } else if (p->state & JSONP_HEX_MASK) {
+          // We don't support unicode, so we just keep the bottom 8 bits of the character (like JSON.parse)
+          int d = chtod((char)ch);
+          if (d<0 || d>15) {
+            jsonpError(p, "a hex digit", ch);
+            break;
+          }
+          int left = ((p->state & JSONP_HEX_MASK) >> JSONP_HEX_SHIFT) - 1;
+          int hex = (((p->state >> JSONP_HEX_CHAR_SHIFT) << 4) | d) & 255;
+          p->state = (p->state & (JSONP_STATE_MASK|JSONP_IS_KEY)) | (left << JSONP_HEX_SHIFT) | (hex << JSONP_HEX_CHAR_SHIFT);
+          if (!left) {
+            jsonpTokenAppend(p, (char)hex);
+            p->state &= JSONP_STATE_MASK|JSONP_IS_KEY;
+          }
+        } else if (p->state & JSONP_ESCAPE) {
+          p->state &= ~JSONP_ESCAPE;
+          switch (ch) {
+            case 'n': ch = 0x0A; break;
+            case 'b': ch = 0x08; break;
+            case 'f': ch = 0x0C; break;
+            case 'r': ch = 0x0D; break;
+            case 't': ch = 0x09; break;
+            case 'v': ch = 0x0B; break;
+            case 'u': p->state |= 4 << JSONP_HEX_SHIFT; return;
+            case 'x': p->state |= 2 << JSONP_HEX_SHIFT; return;
+            default:
+              if (ch>='0' && ch<='7') { // up to 3 octal digits, like JSON.parse
+                p->state |= JSONP_OCTAL | (2 << JSONP_HEX_SHIFT) | ((ch-'0') << JSONP_HEX_CHAR_SHIFT);
+                return;
+              }
+              break; // '"', '\\', '/', etc
+          }
+          jsonpTokenAppend(p, (char)ch);
+        } else if (ch=='\\') {
+          p->state |= JSONP_ESCAPE;
+        } else if (ch=='"') {
+          JsVar *str = jsonpTokenGet(p);
+          if (p->state & JSONP_IS_KEY) {
+            JsVarInt depth = jsvGetArrayLength(p->path);
+            jsvSetArrayItem(p->path, depth-1, str);
+            jsvUnLock(str);
+            p->state = JSONP_COLON;
+          } else
+            jsonpValue(p, str);
+        } else
+          jsonpTokenAppend(p, (char)ch);
+        break;
+      case JSONP_NUMBER:
+      case JSONP_WORD:
+        if (isAlpha((char)ch) || isNumeric((char)ch) || ch=='.' || ch=='+' || ch=='-') {
+          if (jsvGetStringLength(p->token) + p->bufLen < JSLEX_MAX_TOKEN_LENGTH-1) jsonpTokenAppend(p, (char)ch);
+          else jsonpError(p, "a valid value", ch);
+        } else {
+          jsonpFinishToken(p);
+          again = true; // now handle the character after it
+        }
+        break;
+    }
+  }
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "JSONParser",
+  "name" : "write",
+  "generate" : "jswrap_jsonparser_write",
+  "params" : [
+    ["data","JsVar","The next part of the JSON - a String, or an array or `Uint8Array` of characters"]
+  ],
+  "ifndef" : "SAVE_ON_FLASH"
+}
+Parse some more JSON, calling the `value` event for every value that is
+finished. If the JSON is invalid, a `SyntaxError` is thrown and everything
+else is ignored until `end()` is called.
+*/
+void jswrap_jsonparser_write(JsVar *parent, JsVar *data) {
+  JsonStreamParser p;
+  p.parser = parent;
+  p.state = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(parent, JSON_PARSER_STATE_NAME, 0));
+  p.path = jsvObjectGetChild(parent, JSON_PARSER_PATH_NAME, JSV_ARRAY);
+  p.build = jsvObjectGetChild(parent, JSON_PARSER_BUILD_NAME, JSV_ARRAY);
+  p.token = jsvObjectGetChild(parent, JSON_PARSER_TOKEN_NAME, 0);
+  p.bufLen = 0;
+  if (p.path && p.build)
+    jsvIterateCallback(data, jsonpChar, &p);
+  jsonpTokenFlush(&p);
+  jsvObjectSetChildAndUnLock(parent, JSON_PARSER_STATE_NAME, jsvNewFromInteger(p.state));
+  if (p.token) jsvObjectSetChild(parent, JSON_PARSER_TOKEN_NAME, p.token);
+  else jsvObjectRemoveChild(parent, JSON_PARSER_TOKEN_NAME);
+  jsvUnLock3(p.path, p.build, p.token);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "JSONParser",
+  "name" : "end",
+  "generate" : "jswrap_jsonparser_end",
+  "ifndef" : "SAVE_ON_FLASH"
+}
+Finish parsing - reporting any number that was at the very end of the data,
+and throwing a `SyntaxError` if the JSON wasn't complete. The parser is then
+ready to be used again, and the `end` event is called.
+*/
+void jswrap_jsonparser_end(JsVar *parent) {
+  // a space will finish any number or word at the end
+  JsVar *space = jsvNewFromString(" ");
+  jswrap_jsonparser_write(parent, space);
+  jsvUnLock(space);
+  int state = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(parent, JSON_PARSER_STATE_NAME, 0));
+  JsVar *path = jsvObjectGetChild(parent, JSON_PARSER_PATH_NAME, 0);
+  bool finished = !jsvGetArrayLength(path) &&
+                  ((state & JSONP_STATE_MASK)==JSONP_VALUE || (state & JSONP_STATE_MASK)==JSONP_AFTER);
+  jsvUnLock(path);
+  if (!finished && (state & JSONP_STATE_MASK)!=JSONP_ERROR)
+    jsExceptionHere(JSET_SYNTAXERROR, "Unexpected end of JSON");
+  // get ready to start again
+  jsvObjectRemoveChild(parent, JSON_PARSER_STATE_NAME);
+  jsvObjectRemoveChild(parent, JSON_PARSER_PATH_NAME);
+  jsvObjectRemoveChild(parent, JSON_PARSER_TOKEN_NAME);
+  jsvObjectRemoveChild(parent, JSON_PARSER_BUILD_NAME);
+  if (finished) jsiExecuteObjectCallbacks(parent, JS_EVENT_PREFIX"end", 0, 0);
+}
+
 /* This is like jsfGetJSONWithCallback, but handles ONLY functions (and does not print the initial 'function' text) */
 void jsfGetJSONForFunctionWithCallback(JsVar *var, JSONFlags flags, vcbprintf_callback user_callback, void *user_data) {
   assert(jsvIsFunction(var));
@@ -16,6 +16,10 @@
 JsVar *jswrap_json_stringify(JsVar *v, JsVar *replacer, JsVar *space);
 JsVar *jswrap_json_parse(JsVar *v);
 
+JsVar *jswrap_jsonparser_constructor(JsVar *options);
+void jswrap_jsonparser_write(JsVar *parent, JsVar *data);
+void jswrap_jsonparser_end(JsVar *parent);
+
 typedef enum {
   JSON_NONE,
   JSON_SOME_NEWLINES     = 1, //< insert newlines in non-simple arrays and objects
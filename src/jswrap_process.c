@@ -121,6 +121,8 @@ Run a Garbage Collection pass, and return an object containing information on me
 * `history` : Memory used for command history - that is freed if memory is low. Note that this is INCLUDED in the figure for 'free'
 * `gc`      : Memory freed during the GC pass
 * `gctime`  : Time taken for GC pass (in milliseconds)
+* `gcmarktime` : Time taken finding what is in use during the GC pass (in milliseconds)
+* `gcdepth` : The most variables that were waiting to be looked inside at once during the GC pass. If this is as big as the GC's stack, the GC had to look through memory again to find the ones it missed
 * `stackEndAddress` : (on ARM) the address (that can be used with peek/poke/etc) of the END of the stack. The stack grows down, so unless you do a lot of recursion the bytes above this can be used.
 * `flash_start`      : (on ARM) the address of the start of flash memory (usually `0x8000000`)
 * `flash_binary_end` : (on ARM) the address in flash memory of the end of Espruino's firmware.
@@ -151,6 +153,10 @@ JsVar *jswrap_process_memory() {
     jsvObjectSetChildAndUnLock(obj, "history", jsvNewFromInteger((JsVarInt)history));
     jsvObjectSetChildAndUnLock(obj, "gc", jsvNewFromInteger((JsVarInt)gc));
     jsvObjectSetChildAndUnLock(obj, "gctime", jsvNewFromFloat(jshGetMillisecondsFromTime(time2-time1)));
+#ifdef JSV_GC_GREY_STACK_SIZE
+    jsvObjectSetChildAndUnLock(obj, "gcmarktime", jsvNewFromFloat(jshGetMillisecondsFromTime(jsvGetGarbageCollectMarkTime())));
+    jsvObjectSetChildAndUnLock(obj, "gcdepth", jsvNewFromInteger((JsVarInt)jsvGetGarbageCollectMaxDepth()));
+#endif
 
 #ifdef ARM
     extern uint32_t LINKER_END_VAR; // end of ram used (variables) - should be 'void', but 'int' avoids warnings
@@ -19,241 +19,762 @@
 #include "jslex.h"
 #include "jsinteractive.h"
 
-/* TODO:
+/* Regular expressions are compiled (when the RegExp is created) into a
+ * program for a simple virtual machine, which is stored on the RegExp. To
+ * match, we step through the string one character at a time, keeping a list
+ * of every place in the program we could be (a 'Pike VM'). Each place is only
+ * in the list once, so matching takes time proportional to the length of the
+ * string times the length of the program, and can never get stuck
+ * backtracking. The list is kept in priority order so we find the same match
+ * a backtracking matcher would. Repeats follow the spec's RepeatMatcher: each
+ * iteration starts with the captures inside it reset, and iterations beyond
+ * the minimum may not match an empty string.
  *
- * Handling of 'global' flag especially
- * lastIndex support?
+ * This means backreferences and lookahead aren't supported.
  */
 
-#define MAX_GROUPS 9
-#define NO_RANGE  256
+/// Instructions in a compiled RegEx. Offsets are 16 bit, relative to the start of the instruction
+typedef enum {
+  RE_MATCH,      ///< We've found a match
+  RE_CHAR,       ///< Match one character: [ch]
+  RE_ANY,        ///< Match any character
+  RE_CLASS,      ///< Match a character set: [size lo][size hi][inverted][size bytes of RE_CLASS_xxx]
+  RE_SPLIT,      ///< Carry on at both: [x lo][x hi][y lo][y hi], preferring x
+  RE_JMP,        ///< Carry on at: [x lo][x hi]
+  RE_SAVE,       ///< Save the current index in capture slot: [slot]
+  RE_BOL,        ///< Only carry on if we're at the start of the string
+  RE_EOL,        ///< Only carry on if we're at the end of the string
+  RE_WORD_BOUNDARY,     ///< Only carry on if we're at a word boundary
+  RE_NOT_WORD_BOUNDARY, ///< Only carry on if we're not at a word boundary
+  RE_CLEAR,      ///< Set capture slots back to unmatched: [first slot][count]
+  RE_NOT_EMPTY,  ///< Only carry on if we've moved on from the index in capture slot: [slot]
+} RegExOp;
+
+/// Items in a RE_CLASS character set
+typedef enum {
+  RE_CLASS_RANGE, ///< [first][last]
+  RE_CLASS_DIGIT,
+  RE_CLASS_NOT_DIGIT,
+  RE_CLASS_SPACE,
+  RE_CLASS_NOT_SPACE,
+  RE_CLASS_WORD,
+  RE_CLASS_NOT_WORD,
+} RegExClassItem;
+
+/* Compiled programs start with: [group slots][capture slots][threads lo][threads hi][stack lo][stack hi]
+ * where group slots are the capture slots for the groups in the result (the
+ * rest are used by RE_NOT_EMPTY), threads is the most places in the program we
+ * can be at once, and stack is the most we need to remember while following
+ * instructions that don't use up a character */
+#define RE_HEADER_SIZE 6
+#define RE_MAX_PROGRAM_SIZE 32767 ///< So offsets fit in 16 bits
+#define RE_MAX_CAPTURE_SLOTS 254 ///< So the number of slots fits in a byte
 
 typedef struct {
-  JsVar *sourceStr;
-  size_t startIndex;
-  bool ignoreCase;
-  bool rangeMatch;
-  short rangeFirstChar;
-  int groups;
-  size_t groupStart[MAX_GROUPS];
-  size_t groupEnd[MAX_GROUPS];
-} matchInfo;
-
-static JsVar *matchhere(char *regexp, JsvStringIterator *txtIt, matchInfo info);
-
-static JsVar *matchfound(JsvStringIterator *txtIt, matchInfo info) {
-  JsVar *rmatch = jsvNewEmptyArray();
-  size_t endIndex = jsvStringIteratorGetIndex(txtIt);
-  JsVar *matchStr = jsvNewFromStringVar(info.sourceStr, info.startIndex, endIndex-info.startIndex);
-  jsvSetArrayItem(rmatch, 0, matchStr);
-  jsvUnLock(matchStr);
-  int i;
-  for (i=0;i<info.groups;i++) {
-    matchStr = jsvNewFromStringVar(info.sourceStr, info.groupStart[i], info.groupEnd[i]-info.groupStart[i]);
-    jsvSetArrayItem(rmatch, i+1, matchStr);
-    jsvUnLock(matchStr);
+  const char *src; ///< Where we are in the RegEx's source
+  const char *srcEnd;
+  unsigned char *prog; ///< The program - or 0 if we're just working out how big it is
+  int len; ///< Length of the program so far
+  int maxLen; ///< The most space the program has needed (it can shrink, eg. for 'a{0}')
+  int groups; ///< Capturing groups so far
+  int groupSlots; ///< Capture slots used by groups (from the first pass) - RE_NOT_EMPTY's slots come after
+  int emptyChecks; ///< RE_NOT_EMPTY slots so far
+  int threads; ///< Instructions that use up a character (or match)
+  int others; ///< Instructions that don't
+  bool error;
+} RegExCompiler;
+
+static void regexError(RegExCompiler *c, const char *message) {
+  if (!c->error) jsExceptionHere(JSET_SYNTAXERROR, "%s in RegEx", message);
+  c->error = true;
+}
+
+static void regexEmit(RegExCompiler *c, int byte) {
+  if (c->prog) c->prog[c->len] = (unsigned char)byte;
+  c->len++;
+  if (c->len > c->maxLen) c->maxLen = c->len;
+}
+
+static void regexSetOffset(RegExCompiler *c, int at, int offset) {
+  if (!c->prog) return;
+  c->prog[at] = (unsigned char)(offset & 255);
+  c->prog[at+1] = (unsigned char)((offset >> 8) & 255);
+}
+
+static int regexGetOffset(const unsigned char *p) {
+  return (short)(p[0] | (p[1]<<8));
+}
+
+/// Make room for 'count' bytes at 'at' (offsets are relative, so moving code doesn't break it)
+static void regexInsert(RegExCompiler *c, int at, int count) {
+  if (c->prog) memmove(&c->prog[at+count], &c->prog[at], (size_t)(c->len-at));
+  c->len += count;
+  if (c->len > c->maxLen) c->maxLen = c->len;
+}
+
+/// Put a RE_SPLIT at 'at' (which must have room for it)
+static void regexSetSplit(RegExCompiler *c, int at, int x, int y) {
+  if (c->prog) c->prog[at] = RE_SPLIT;
+  regexSetOffset(c, at+1, x-at);
+  regexSetOffset(c, at+3, y-at);
+}
+
+static void regexEmitJmp(RegExCompiler *c, int to) {
+  int at = c->len;
+  regexEmit(c, RE_JMP);
+  regexEmit(c, 0);
+  regexEmit(c, 0);
+  regexSetOffset(c, at+1, to-at);
+  c->others++;
+}
+
+static int regexHexDigit(RegExCompiler *c) {
+  if (c->src<c->srcEnd && isHexadecimal(*c->src))
+    return chtod(*(c->src++));
+  regexError(c, "Invalid escape");
+  return 0;
+}
+
+/** Parse the character after a '\'. Returns the character, or -(RE_CLASS_xxx)
+ * if it's a character set like \d. '\b' is handled by the caller */
+static int regexParseEscape(RegExCompiler *c) {
+  if (c->src>=c->srcEnd) {
+    regexError(c, "Unfinished escape");
+    return 0;
+  }
+  char ch = *(c->src++);
+  switch (ch) {
+    case 'd': return -RE_CLASS_DIGIT;
+    case 'D': return -RE_CLASS_NOT_DIGIT;
+    case 's': return -RE_CLASS_SPACE;
+    case 'S': return -RE_CLASS_NOT_SPACE;
+    case 'w': return -RE_CLASS_WORD;
+    case 'W': return -RE_CLASS_NOT_WORD;
+    case 'f': return 0x0C;
+    case 'n': return 0x0A;
+    case 'r': return 0x0D;
+    case 't': return 0x09;
+    case 'v': return 0x0B;
+    case '0': return 0x00;
+    case 'x': {
+      int hi = regexHexDigit(c);
+      return (hi<<4) | regexHexDigit(c);
+    }
+    default:
+      if (ch>='1' && ch<='9') regexError(c, "Backreferences not supported");
+      return (unsigned char)ch; // quoted character, eg. '\/'
   }
-  jsvObjectSetChildAndUnLock(rmatch, "index", jsvNewFromInteger((JsVarInt)info.startIndex));
-  jsvObjectSetChild(rmatch, "input", info.sourceStr);
+}
 
-  return rmatch;
+/// Parse a character set - we're just after the '['
+static void regexParseClass(RegExCompiler *c) {
+  int at = c->len;
+  regexEmit(c, RE_CLASS);
+  regexEmit(c, 0);
+  regexEmit(c, 0);
+  bool inverted = c->src<c->srcEnd && *c->src=='^';
+  if (inverted) c->src++;
+  regexEmit(c, inverted);
+  c->threads++;
+  while (c->src<c->srcEnd && *c->src!=']') {
+    int ch = (unsigned char)*(c->src++);
+    if (ch=='\\') {
+      if (c->src<c->srcEnd && *c->src=='b') { // backspace, inside a character set
+        c->src++;
+        ch = 0x08;
+      } else
+        ch = regexParseEscape(c);
+    }
+    if (ch<0) { // \d, etc
+      regexEmit(c, -ch);
+      continue;
+    }
+    int last = ch;
+    if (c->src+1<c->srcEnd && c->src[0]=='-' && c->src[1]!=']') { // range
+      c->src++;
+      last = (unsigned char)*(c->src++);
+      if (last=='\\') last = regexParseEscape(c);
+      if (last<0 || last<ch) regexError(c, "Invalid character set range");
+    }
+    regexEmit(c, RE_CLASS_RANGE);
+    regexEmit(c, ch);
+    regexEmit(c, last);
+  }
+  if (c->src>=c->srcEnd) {
+    regexError(c, "Unfinished character set");
+    return;
+  }
+  c->src++; // ']'
+  regexSetOffset(c, at+1, c->len-(at+4));
 }
 
-// No match found, so search to end of regex to see if there's an '|'
-static JsVar *nomatchfound(char *regexp, matchInfo info) {
-  if (!jspCheckStackPosition()) return 0;
-  // TODO: | inside a group?
-  while (*regexp && *regexp!='|') {
-    if (*regexp=='\\') {
-      regexp++; // end of regex after escape char!
-      if (!*regexp) return 0;
+static void regexParseAlternatives(RegExCompiler *c);
+
+/// Parse something that can be followed by '*', etc. Returns false if it's not there (eg. we're at '|')
+static bool regexParseAtom(RegExCompiler *c) {
+  char ch = *c->src;
+  switch (ch) {
+    case '|': case ')': return false;
+    case '*': case '+': case '?':
+      regexError(c, "Nothing to repeat");
+      return false;
+    case '(': {
+      c->src++;
+      int group = -1;
+      if (c->src<c->srcEnd && *c->src=='?') {
+        if (c->src+1<c->srcEnd && c->src[1]==':') c->src += 2; // non-capturing
+        else {
+          regexError(c, "Lookahead/named groups not supported");
+          return false;
+        }
+      } else {
+        group = ++c->groups;
+        if ((group+1)*2 > RE_MAX_CAPTURE_SLOTS) {
+          regexError(c, "Too many groups");
+          return false;
+        }
+        regexEmit(c, RE_SAVE);
+        regexEmit(c, group*2);
+        c->others++;
+      }
+      regexParseAlternatives(c);
+      if (c->src>=c->srcEnd || *c->src!=')') {
+        regexError(c, "Unfinished group");
+        return false;
+      }
+      c->src++;
+      if (group>=0) {
+        regexEmit(c, RE_SAVE);
+        regexEmit(c, group*2+1);
+        c->others++;
+      }
+      return true;
+    }
+    case '[': c->src++; regexParseClass(c); return true;
+    case '.': c->src++; regexEmit(c, RE_ANY); c->threads++; return true;
+    case '^': c->src++; regexEmit(c, RE_BOL); c->others++; return true;
+    case '$': c->src++; regexEmit(c, RE_EOL); c->others++; return true;
+    case '\\': {
+      c->src++;
+      if (c->src<c->srcEnd && (*c->src=='b' || *c->src=='B')) {
+        regexEmit(c, (*(c->src++)=='b') ? RE_WORD_BOUNDARY : RE_NOT_WORD_BOUNDARY);
+        c->others++;
+        return true;
+      }
+      int e = regexParseEscape(c);
+      if (e<0) { // \d, etc - a character set with one item
+        regexEmit(c, RE_CLASS);
+        regexEmit(c, 1);
+        regexEmit(c, 0);
+        regexEmit(c, 0);
+        regexEmit(c, -e);
+        c->threads++;
+      } else {
+        regexEmit(c, RE_CHAR);
+        regexEmit(c, e);
+        c->threads++;
+      }
+      return true;
     }
-    regexp++;
+    default:
+      c->src++;
+      regexEmit(c, RE_CHAR);
+      regexEmit(c, ch);
+      c->threads++;
+      return true;
   }
-  if (*regexp != '|') return 0;
-  regexp++;
+}
 
-  JsvStringIterator txtIt;
-  jsvStringIteratorNew(&txtIt,  info.sourceStr, info.startIndex);
-  JsVar *rmatch = matchhere(regexp, &txtIt, info);
-  jsvStringIteratorFree(&txtIt);
-  return rmatch;
+/// Make the atom at 'at' (which ends at the end of the program) optional
+static void regexMakeOptional(RegExCompiler *c, int at, bool lazy) {
+  //   at: SPLIT at+5, end
+  //       atom
+  // end:
+  regexInsert(c, at, 5);
+  if (lazy) regexSetSplit(c, at, c->len, at+5);
+  else regexSetSplit(c, at, at+5, c->len);
+  c->others++;
+}
+
+/// Allow the atom at 'at' (which ends at the end of the program) to repeat any number of times
+static void regexMakeRepeat(RegExCompiler *c, int at, bool lazy) {
+  //   at: SPLIT at+5, end
+  //       atom
+  //       JMP at
+  // end:
+  regexInsert(c, at, 5);
+  regexEmitJmp(c, at);
+  if (lazy) regexSetSplit(c, at, c->len, at+5);
+  else regexSetSplit(c, at, at+5, c->len);
+  c->others++;
 }
 
-/* match: search for regexp anywhere in text */
-static JsVar *match(char *regexp, JsVar *str, size_t startIndex, bool ignoreCase) {
-  matchInfo info;
-  info.sourceStr = str;
-  info.startIndex = startIndex;
-  info.ignoreCase = ignoreCase;
-  info.rangeMatch = false;
-  info.rangeFirstChar = NO_RANGE;
-  info.groups = 0;
-
-  JsVar *rmatch;
-  JsvStringIterator txtIt, txtIt2;
-  jsvStringIteratorNew(&txtIt, str, startIndex);
-  /* must look even if string is empty */
-  txtIt2 = jsvStringIteratorClone(&txtIt);
-  rmatch = matchhere(regexp, &txtIt2, info);
-  jsvStringIteratorFree(&txtIt2);
-  jsvStringIteratorNext(&txtIt);
-  while (!rmatch && jsvStringIteratorHasChar(&txtIt)) {
-    info.startIndex++;
-    txtIt2 = jsvStringIteratorClone(&txtIt);
-    rmatch = matchhere(regexp, &txtIt2, info);
-    jsvStringIteratorFree(&txtIt2);
-    jsvStringIteratorNext(&txtIt);
+/** Make the copy of an atom at 'at' (which ends at the end of the program) into
+ * one iteration of a repeat, as the spec's RepeatMatcher does: captures in groups
+ * from 'atomGroups' onwards are reset first, and if 'notEmpty' the iteration
+ * may not match an empty string */
+static void regexMakeIteration(RegExCompiler *c, int at, int atomGroups, bool notEmpty) {
+  int firstSlot = (atomGroups+1)*2;
+  int slotCount = (c->groups-atomGroups)*2;
+  int slot = 0;
+  if (notEmpty) {
+    slot = c->groupSlots + c->emptyChecks++;
+    if (c->groupSlots && slot >= RE_MAX_CAPTURE_SLOTS) {
+      regexError(c, "Too many groups");
+      return;
+    }
   }
-  jsvStringIteratorFree(&txtIt);
-  return rmatch;
+  //   at: CLEAR firstSlot, slotCount   (if there are groups)
+  //       SAVE slot                    (if notEmpty)
+  //       atom
+  //       NOT_EMPTY slot               (if notEmpty)
+  int size = (slotCount ? 3 : 0) + (notEmpty ? 2 : 0);
+  regexInsert(c, at, size);
+  if (c->prog && slotCount) {
+    c->prog[at++] = RE_CLEAR;
+    c->prog[at++] = (unsigned char)firstSlot;
+    c->prog[at++] = (unsigned char)slotCount;
+  }
+  if (slotCount) c->others += slotCount+1;
+  if (notEmpty) {
+    if (c->prog) {
+      c->prog[at] = RE_SAVE;
+      c->prog[at+1] = (unsigned char)slot;
+    }
+    regexEmit(c, RE_NOT_EMPTY);
+    regexEmit(c, slot);
+    c->others += 2;
+  }
+}
+
+/// Parse another copy of the atom at 'atomSrc', with the same group numbers
+static void regexParseAtomCopy(RegExCompiler *c, const char *atomSrc, int atomGroups) {
+  c->src = atomSrc;
+  c->groups = atomGroups;
+  regexParseAtom(c);
+}
+
+/// Parse a number for {n,m} - returns -1 if there isn't one
+static int regexParseCount(RegExCompiler *c) {
+  if (c->src>=c->srcEnd || !isNumeric(*c->src)) return -1;
+  int n = 0;
+  while (c->src<c->srcEnd && isNumeric(*c->src)) {
+    n = n*10 + (*(c->src++)-'0');
+    if (n>RE_MAX_PROGRAM_SIZE) n = RE_MAX_PROGRAM_SIZE;
+  }
+  return n;
 }
 
-/* Match one character. Doesn't modify txtIt, returns length of regexp char in *length  */
-bool matchcharacter(char *regexp, JsvStringIterator *txtIt, int *length, matchInfo *info) {
-  *length = 1;
-  char ch = jsvStringIteratorGetChar(txtIt);
-  if (regexp[0]=='.') return true;
-  if (regexp[0]=='[') { // Character set (any char inside '[]')
-    info->rangeMatch = true;
-    bool inverted = regexp[1]=='^';
-    if (inverted) (*length)++;
-    bool matchAny = false;
-    while (regexp[*length] && regexp[*length]!=']') {
-      int matchLen;
-      matchAny |= matchcharacter(&regexp[*length], txtIt, &matchLen, info);
-      (*length) += matchLen;
+/// Parse an atom and anything after it that says how many times to repeat it
+static bool regexParseTerm(RegExCompiler *c) {
+  int at = c->len;
+  const char *atomSrc = c->src;
+  int atomGroups = c->groups;
+  int atomThreads = c->threads, atomOthers = c->others;
+  if (!regexParseAtom(c)) return false;
+  if (c->src>=c->srcEnd) return true;
+  int min, max; // max<0 means no limit
+  char op = *c->src;
+  if (op=='*') { min=0; max=-1; }
+  else if (op=='+') { min=1; max=-1; }
+  else if (op=='?') { min=0; max=1; }
+  else if (op=='{') {
+    // {n}, {n,} or {n,m} - otherwise it's just a '{' character
+    const char *brace = c->src;
+    c->src++;
+    min = regexParseCount(c);
+    max = min;
+    if (min>=0 && c->src<c->srcEnd && *c->src==',') {
+      c->src++;
+      max = regexParseCount(c);
+    }
+    if (min<0 || c->src>=c->srcEnd || *c->src!='}') {
+      c->src = brace;
+      return true;
     }
-    if (regexp[*length]==']') {
-      (*length)++;
-    } else {
-      jsExceptionHere(JSET_ERROR, "Unfinished character set in RegEx");
+    if (max>=0 && max<min) {
+      regexError(c, "Numbers out of order in {} quantifier");
       return false;
     }
-    info->rangeMatch = false;
-    return matchAny != inverted;
-  }
-  char cH = regexp[0];
-  if (cH=='\\') { // escape character
-    *length = 2;
-    // fallback to the quoted character (e.g. /,-,? etc.)
-    cH = regexp[1];
-    // missing quite a few here
-    // https://developer.mozilla.org/en-US/docs/Web/JavaScript/Guide/Regular_Expressions
-    if (cH=='d') return isNumeric(ch);
-    if (cH=='D') return !isNumeric(ch);
-    if (cH=='f') { cH=0x0C; goto haveCode; }
-    if (cH=='n') { cH=0x0A; goto haveCode; }
-    if (cH=='r') { cH=0x0D; goto haveCode; }
-    if (cH=='s') return isWhitespace(ch);
-    if (cH=='S') return !isWhitespace(ch);
-    if (cH=='t') { cH=0x09; goto haveCode; }
-    if (cH=='v') { cH=0x0B; goto haveCode; }
-    if (cH=='w') return isNumeric(ch) || isAlpha(ch) || ch=='_';
-    if (cH=='W') return !(isNumeric(ch) || isAlpha(ch) || ch=='_');
-    if (cH=='0') { cH=0x00; goto haveCode; }
-    if (cH=='x' && regexp[2] && regexp[3]) {
-      *length = 4;
-      cH = (char)((chtod(regexp[2])<<4) | chtod(regexp[3]));
-      goto haveCode;
+  } else return true;
+  c->src++;
+  bool lazy = c->src<c->srcEnd && *c->src=='?';
+  if (lazy) c->src++;
+  const char *afterSrc = c->src;
+  /* We have one copy of the atom's code at 'at'. Any more copies are made
+   * by parsing the atom again (with the same group numbers). The first 'min'
+   * copies are required, and after that they're optional or repeat. */
+  int optionalCopies = 0;
+  // If it's a group or an assertion, an iteration could match an empty string
+  bool mayBeEmpty = c->others>atomOthers || c->threads==atomThreads;
+  if (max==0) {
+    c->len = at; // the atom can't appear at all!
+  } else {
+    regexMakeIteration(c, at, atomGroups, min==0 && mayBeEmpty);
+    int copy;
+    for (copy=1; copy<min && c->len<=RE_MAX_PROGRAM_SIZE; copy++) {
+      at = c->len;
+      regexParseAtomCopy(c, atomSrc, atomGroups);
+      regexMakeIteration(c, at, atomGroups, false);
     }
+    if (max<0) { // the last copy can repeat
+      if (min>0) {
+        at = c->len;
+        regexParseAtomCopy(c, atomSrc, atomGroups);
+        regexMakeIteration(c, at, atomGroups, mayBeEmpty);
+      }
+      regexMakeRepeat(c, at, lazy);
+    } else if (min==0) { // the copy we have is optional
+      regexMakeOptional(c, at, lazy);
+      optionalCopies = max-1;
+    } else
+      optionalCopies = max-min;
   }
-haveCode:
-  if (info->rangeMatch && regexp[*length] == '-') { // Character set range start
-    info->rangeFirstChar = cH;
-    (*length)++;
-    int matchLen;
-    bool match = matchcharacter(&regexp[*length], txtIt, &matchLen, info);
-    (*length)+=matchLen;
-    return match;
+  while (optionalCopies-- > 0 && c->len<=RE_MAX_PROGRAM_SIZE) {
+    at = c->len;
+    regexParseAtomCopy(c, atomSrc, atomGroups);
+    regexMakeIteration(c, at, atomGroups, mayBeEmpty);
+    regexMakeOptional(c, at, lazy);
   }
-  if (info->ignoreCase) {
-    ch = jsvStringCharToLower(ch);
-    cH = jsvStringCharToLower(cH);
+  c->src = afterSrc;
+  if (c->src<c->srcEnd && (*c->src=='*' || *c->src=='+' || *c->src=='?')) {
+    regexError(c, "Nothing to repeat");
+    return false;
   }
-  if (info->rangeFirstChar != NO_RANGE) { // Character set range
-    char cL = (char)info->rangeFirstChar;
-    if (info->ignoreCase) {
-      cL = jsvStringCharToLower(cL);
+  return true;
+}
+
+/// Parse 'a|b|c' - stopping at the end, or a ')'
+static void regexParseAlternatives(RegExCompiler *c) {
+  int lastJmp = -1;
+  while (true) {
+    int start = c->len;
+    while (!c->error && c->src<c->srcEnd && regexParseTerm(c));
+    if (c->error || c->src>=c->srcEnd || *c->src!='|') break;
+    c->src++;
+    /* start: SPLIT start+5, next
+     *        this alternative
+     *        JMP end
+     *  next: the next alternative */
+    regexInsert(c, start, 5);
+    c->others++;
+    // chain the JMPs to the end together (a JMP to itself ends the chain), and fix them up when we know where the end is
+    int jmp = c->len;
+    regexEmitJmp(c, lastJmp<0 ? jmp : lastJmp);
+    lastJmp = jmp;
+    regexSetSplit(c, start, start+5, c->len);
+  }
+  while (lastJmp>=0 && c->prog) {
+    int offset = regexGetOffset(&c->prog[lastJmp+1]);
+    regexSetOffset(c, lastJmp+1, c->len-lastJmp);
+    lastJmp = offset ? lastJmp+offset : -1;
+  }
+}
+
+/// Compile the source of a RegEx into a flat string containing its program (or return 0 and throw an exception)
+static JsVar *regexCompile(JsVar *source) {
+  size_t srcLen = jsvGetStringLength(source);
+  char *src = (char *)alloca(srcLen+1);
+  if (!src) return 0;
+  jsvGetString(source, src, srcLen+1);
+  // First work out how big the program will be, then actually write it
+  RegExCompiler c;
+  c.prog = 0;
+  c.groupSlots = 0;
+  JsVar *program = 0;
+  int pass;
+  for (pass=0;pass<2;pass++) {
+    c.src = src;
+    c.srcEnd = &src[srcLen];
+    c.len = RE_HEADER_SIZE;
+    c.maxLen = c.len;
+    c.groups = 0;
+    c.emptyChecks = 0;
+    c.threads = 0;
+    c.others = 0;
+    c.error = false;
+    regexEmit(&c, RE_SAVE);
+    regexEmit(&c, 0);
+    regexParseAlternatives(&c);
+    if (!c.error && c.src<c.srcEnd) regexError(&c, "Unmatched ')'");
+    regexEmit(&c, RE_SAVE);
+    regexEmit(&c, 1);
+    regexEmit(&c, RE_MATCH);
+    c.others += 2;
+    c.threads++;
+    if (c.error) {
+      jsvUnLock(program);
+      return 0;
+    }
+    if (c.maxLen > RE_MAX_PROGRAM_SIZE) {
+      jsExceptionHere(JSET_ERROR, "RegEx too large");
+      jsvUnLock(program);
+      return 0;
+    }
+    if (!pass) {
+      program = jsvNewFlatStringOfLength((unsigned int)c.maxLen);
+      if (!program) {
+        jsExceptionHere(JSET_ERROR, "Not enough memory to compile RegEx");
+        return 0;
+      }
+      c.prog = (unsigned char*)jsvGetFlatStringPointer(program);
+      c.groupSlots = (c.groups+1)*2;
     }
-    info->rangeFirstChar = NO_RANGE;
-    return (ch >= cL && ch <= cH && cL < cH);
   }
-  return cH==ch;
-}
-
-/* matchhere: search for regexp at beginning of text. Only handles up to '|' character. Modifies txtIt */
-static JsVar *matchhere(char *regexp, JsvStringIterator *txtIt, matchInfo info) {
-  if (jspIsInterrupted()) return 0;
-  if (regexp[0] == '\0' || // end of regex
-      regexp[0] == '|') // end of this 'or' section of regex
-    return matchfound(txtIt, info);
-  if (regexp[0] == '^') { // must be beginning of String
-    if (jsvStringIteratorGetIndex(txtIt)!=0)
-      return 0; // no match
-    if (!jspCheckStackPosition()) return 0;
-    return matchhere(regexp+1, txtIt, info);
+  int stack = c.others*2 + 1;
+  c.prog[0] = (unsigned char)c.groupSlots;
+  c.prog[1] = (unsigned char)(c.groupSlots + c.emptyChecks);
+  c.prog[2] = (unsigned char)(c.threads & 255);
+  c.prog[3] = (unsigned char)(c.threads >> 8);
+  c.prog[4] = (unsigned char)(stack & 255);
+  c.prog[5] = (unsigned char)(stack >> 8);
+  return program;
+}
+
+static bool regexIsWordChar(int ch) {
+  return ch>=0 && (isAlpha((char)ch) || isNumeric((char)ch));
+}
+
+static bool regexClassItemMatches(RegExClassItem item, int ch) {
+  switch (item) {
+    case RE_CLASS_DIGIT: return isNumeric((char)ch);
+    case RE_CLASS_NOT_DIGIT: return !isNumeric((char)ch);
+    case RE_CLASS_SPACE: return isWhitespace((char)ch);
+    case RE_CLASS_NOT_SPACE: return !isWhitespace((char)ch);
+    case RE_CLASS_WORD: return regexIsWordChar(ch);
+    case RE_CLASS_NOT_WORD: return !regexIsWordChar(ch);
+    default: return false;
   }
-  // Marker for end of String
-  if (regexp[0] == '$') {
-    if (!jsvStringIteratorHasChar(txtIt))
-      return matchhere(regexp+1, txtIt, info);
-    else
-      return nomatchfound(regexp+1, info); // not the end, it's a fail
+}
+
+/// Does the instruction at 'p' match character 'ch'? Returns the instruction's length if so, or 0
+static int regexConsumes(const unsigned char *p, int ch, bool ignoreCase) {
+  if (ch<0) return 0; // end of string
+  switch (*p) {
+    case RE_CHAR:
+      if (ignoreCase)
+        return (jsvStringCharToLower((char)p[1]) == jsvStringCharToLower((char)ch)) ? 2 : 0;
+      return (p[1]==ch) ? 2 : 0;
+    case RE_ANY:
+      return 1;
+    case RE_CLASS: {
+      int size = p[1] | (p[2]<<8);
+      bool found = false;
+      const unsigned char *item = &p[4], *end = &p[4+size];
+      while (!found && item<end) {
+        if (*item==RE_CLASS_RANGE) {
+          found = ch>=item[1] && ch<=item[2];
+          if (!found && ignoreCase) {
+            int lower = (unsigned char)jsvStringCharToLower((char)ch);
+            int upper = (unsigned char)jsvStringCharToUpper((char)ch);
+            found = (lower>=item[1] && lower<=item[2]) || (upper>=item[1] && upper<=item[2]);
+          }
+          item += 3;
+        } else
+          found = regexClassItemMatches(*(item++), ch);
+      }
+      return (found != (p[3]!=0)) ? 4+size : 0;
+    }
+    default:
+      return 0;
   }
-  if (regexp[0] == '(') {
-    info.groupStart[info.groups] = jsvStringIteratorGetIndex(txtIt);
-    info.groupEnd[info.groups] = info.groupStart[info.groups];
-    if (info.groups<MAX_GROUPS) info.groups++;
-    if (!jspCheckStackPosition()) return 0;
-    return matchhere(regexp+1, txtIt, info);
+}
+
+/// State for running a compiled RegEx
+typedef struct {
+  const unsigned char *prog;
+  int ncaps; ///< capture slots (groups, then ones used by RE_NOT_EMPTY)
+  int threadSize; ///< ints per thread: pc, then capture slots
+  int *list; ///< threads waiting for the current character
+  int listLen;
+  int *pending; ///< threads that will be followed once we're on the next character
+  int pendingLen;
+  int *stack; ///< pairs of pc and capture value (if pc<0, restore slot -pc-1 to the value)
+  int *caps; ///< capture slots for the thread we're following
+  unsigned short *marks; ///< instructions we've already visited for this character (== generation)
+  unsigned short generation;
+  int progLen;
+  int index; ///< Index in the string
+  int ch, prevCh; ///< Character at 'index' (or -1 for the end), and the one before it
+} RegExVM;
+
+/** Follow all instructions that don't use a character from 'pc', in
+ * priority order, adding instructions that do to vm->list */
+static void regexFollow(RegExVM *vm, int pc) {
+  int sp = 0;
+  vm->stack[sp++] = pc;
+  vm->stack[sp++] = 0;
+  while (sp) {
+    int value = vm->stack[--sp];
+    pc = vm->stack[--sp];
+    if (pc<0) {
+      vm->caps[-pc-1] = value;
+      continue;
+    }
+    if (vm->marks[pc]==vm->generation) continue; // already been here
+    vm->marks[pc] = vm->generation;
+    const unsigned char *p = &vm->prog[pc];
+    int next = -1;
+    switch (*p) {
+      case RE_JMP:
+        next = pc + regexGetOffset(&p[1]);
+        break;
+      case RE_SPLIT:
+        vm->stack[sp++] = pc + regexGetOffset(&p[3]);
+        vm->stack[sp++] = 0;
+        next = pc + regexGetOffset(&p[1]);
+        break;
+      case RE_SAVE:
+        vm->stack[sp++] = -1-p[1];
+        vm->stack[sp++] = vm->caps[p[1]];
+        vm->caps[p[1]] = vm->index;
+        next = pc+2;
+        break;
+      case RE_CLEAR: {
+        int slot;
+        for (slot=p[1]; slot<p[1]+p[2]; slot++) {
+          vm->stack[sp++] = -1-slot;
+          vm->stack[sp++] = vm->caps[slot];
+          vm->caps[slot] = -1;
+        }
+        next = pc+3;
+      } break;
+      case RE_NOT_EMPTY:
+        if (vm->caps[p[1]] != vm->index) next = pc+2;
+        break;
+      case RE_BOL:
+        if (vm->index==0) next = pc+1;
+        break;
+      case RE_EOL:
+        if (vm->ch<0) next = pc+1;
+        break;
+      case RE_WORD_BOUNDARY:
+      case RE_NOT_WORD_BOUNDARY:
+        if ((regexIsWordChar(vm->prevCh) != regexIsWordChar(vm->ch)) == (*p==RE_WORD_BOUNDARY))
+          next = pc+1;
+        break;
+      default: { // RE_MATCH or something that uses a character
+        int *t = &vm->list[vm->threadSize * vm->listLen++];
+        t[0] = pc;
+        memcpy(&t[1], vm->caps, sizeof(int)*(size_t)vm->ncaps);
+      }
+    }
+    if (next>=0) {
+      vm->stack[sp++] = next;
+      vm->stack[sp++] = 0;
+    }
   }
-  if (regexp[0] == ')') {
-    if (info.groups>0)
-      info.groupEnd[info.groups-1] = jsvStringIteratorGetIndex(txtIt);
-    if (!jspCheckStackPosition()) return 0;
-    return matchhere(regexp+1, txtIt, info);
+}
+
+/// Match a compiled RegEx against 'str' from 'startIndex'. Returns a result array, or 0
+static JsVar *regexMatch(JsVar *program, JsVar *str, size_t startIndex, bool ignoreCase) {
+  size_t strLen = jsvGetStringLength(str);
+  if (startIndex > strLen) return 0;
+  RegExVM vm;
+  vm.progLen = (int)jsvGetCharactersInVar(program);
+  unsigned char *prog = (unsigned char *)jsvGetFlatStringPointer(program);
+  vm.prog = prog;
+  int groupSlots = prog[0];
+  vm.ncaps = prog[1];
+  vm.threadSize = 1+vm.ncaps;
+  int threads = prog[2] | (prog[3]<<8);
+  int stack = prog[4] | (prog[5]<<8);
+  // all our working memory comes from one flat string
+  size_t ints = (size_t)(2*threads*vm.threadSize + 2*stack + 2*vm.ncaps);
+  size_t workSize = ints*sizeof(int) + (size_t)vm.progLen*sizeof(unsigned short);
+  JsVar *work = jsvNewFlatStringOfLength((unsigned int)workSize);
+  if (!work) {
+    jsExceptionHere(JSET_ERROR, "Not enough memory to run RegEx");
+    return 0;
   }
-  int charLength;
-  bool charMatched = matchcharacter(regexp, txtIt, &charLength, &info);
-  if (regexp[charLength] == '*' || regexp[charLength] == '+') {
-    char op = regexp[charLength];
-    if (!charMatched && op=='+') {
-      // with '+' operator it has to match at least once
-      return nomatchfound(&regexp[charLength+1], info);
+  int *mem = (int*)jsvGetFlatStringPointer(work);
+  vm.list = mem;
+  vm.pending = &vm.list[threads*vm.threadSize];
+  vm.stack = &vm.pending[threads*vm.threadSize];
+  vm.caps = &vm.stack[2*stack];
+  int *best = &vm.caps[vm.ncaps];
+  vm.marks = (unsigned short*)&best[vm.ncaps];
+  memset(vm.marks, 0, sizeof(unsigned short)*(size_t)vm.progLen);
+  vm.generation = 0;
+  vm.pendingLen = 0;
+  vm.index = (int)startIndex;
+  vm.prevCh = startIndex ? (unsigned char)jsvGetCharInString(str, startIndex-1) : -1;
+  bool matched = false;
+  // If we have to start with a certain character, we can skip straight to it
+  int firstChar = -1;
+  if (prog[RE_HEADER_SIZE+2]==RE_CHAR && !ignoreCase)
+    firstChar = prog[RE_HEADER_SIZE+3];
+  bool anchored = prog[RE_HEADER_SIZE+2]==RE_BOL;
+
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, str, startIndex);
+  while (true) {
+    if (!vm.pendingLen && !matched) {
+      if (anchored && vm.index>0) break;
+      if (firstChar>=0 && jsvStringIteratorGetChar(&it)!=(char)firstChar) {
+        if (!jsvStringIteratorFindChar(&it, (char)firstChar)) break;
+        vm.index = (int)jsvStringIteratorGetIndex(&it);
+        vm.prevCh = (unsigned char)jsvGetCharInString(str, (size_t)vm.index-1);
+      }
+    }
+    vm.ch = jsvStringIteratorHasChar(&it) ? (unsigned char)jsvStringIteratorGetChar(&it) : -1;
+    if (++vm.generation == 0) { // wrapped - all the marks are from an old generation
+      memset(vm.marks, 0, sizeof(unsigned short)*(size_t)vm.progLen);
+      vm.generation = 1;
     }
-    char *regexpAfterStar = regexp+charLength+1;
-    JsvStringIterator txtIt2;
-    // Try and match everything after right now
-    txtIt2 = jsvStringIteratorClone(txtIt);
-    JsVar *lastrmatch = matchhere(regexpAfterStar, &txtIt2, info);
-    jsvStringIteratorFree(&txtIt2);
-    // Otherwise try and match more than one
-    while (jsvStringIteratorHasChar(txtIt) && charMatched) {
-      // We had this character matched, so move on and see if we can match with the new one
-      jsvStringIteratorNext(txtIt);
-      charMatched = matchcharacter(regexp, txtIt, &charLength, &info);
-      // See if we can match after the character...
-      txtIt2 = jsvStringIteratorClone(txtIt);
-      JsVar *rmatch = matchhere(regexpAfterStar, &txtIt2, info);
-      jsvStringIteratorFree(&txtIt2);
-      // can't match with this - use the last one
-      if (rmatch) {
-        jsvUnLock(lastrmatch);
-        lastrmatch = rmatch;
+    // follow the threads that matched the last character, in order, then (if we haven't matched yet) start a new one here
+    vm.listLen = 0;
+    int i;
+    for (i=0;i<vm.pendingLen;i++) {
+      int *t = &vm.pending[i*vm.threadSize];
+      memcpy(vm.caps, &t[1], sizeof(int)*(size_t)vm.ncaps);
+      regexFollow(&vm, t[0]);
+    }
+    if (!matched) {
+      for (i=0;i<vm.ncaps;i++) vm.caps[i] = -1;
+      regexFollow(&vm, RE_HEADER_SIZE);
+    }
+    // now see which threads match this character
+    vm.pendingLen = 0;
+    for (i=0;i<vm.listLen;i++) {
+      int *t = &vm.list[i*vm.threadSize];
+      if (prog[t[0]]==RE_MATCH) {
+        // threads after this are lower priority, so we can forget them
+        memcpy(best, &t[1], sizeof(int)*(size_t)vm.ncaps);
+        matched = true;
+        break;
+      }
+      int len = regexConsumes(&prog[t[0]], vm.ch, ignoreCase);
+      if (len) {
+        int *n = &vm.pending[vm.threadSize * vm.pendingLen++];
+        memcpy(n, t, sizeof(int)*(size_t)vm.threadSize);
+        n[0] += len;
       }
     }
-    return lastrmatch;
+    if (vm.ch<0 || (matched && !vm.pendingLen) || jspIsInterrupted()) break;
+    vm.prevCh = vm.ch;
+    vm.index++;
+    jsvStringIteratorNext(&it);
   }
+  jsvStringIteratorFree(&it);
 
-  // This character is matched
-  if (jsvStringIteratorHasChar(txtIt) && charMatched) {
-    jsvStringIteratorNext(txtIt);
-    if (!jspCheckStackPosition()) return 0;
-    return matchhere(regexp+charLength, txtIt, info);
+  JsVar *rmatch = 0;
+  if (matched) {
+    rmatch = jsvNewEmptyArray();
+    int i;
+    for (i=0;i<groupSlots/2;i++) {
+      int start = best[i*2], end = best[i*2+1];
+      JsVar *matchStr = 0;
+      if (start>=0 && end>=start)
+        matchStr = jsvNewFromStringVar(str, (size_t)start, (size_t)(end-start));
+      jsvSetArrayItem(rmatch, i, matchStr); // unmatched groups are undefined
+      jsvUnLock(matchStr);
+    }
+    jsvObjectSetChildAndUnLock(rmatch, "index", jsvNewFromInteger(best[0]));
+    jsvObjectSetChild(rmatch, "input", str);
   }
-  // No match
-  return nomatchfound(&regexp[charLength], info);
+  jsvUnLock(work);
+  return rmatch;
 }
 
 /*JSON{
@@ -265,6 +786,9 @@ The built-in class for handling Regular Expressions
 
 **Note:** Espruino's regular expression parser does not contain all the features
 present in a full ES6 JS engine. However it does contain support for the all the basics.
+Regular expressions are matched in time proportional to the length of the string,
+so there are no patterns that take exponential time - but this means that
+backreferences (`\1`) and lookahead (`(?=`) are not supported.
 */
 
 /*JSON{
@@ -296,6 +820,12 @@ JsVar *jswrap_regexp_constructor(JsVar *str, JsVar *flags) {
       jsvObjectSetChild(r, "flags", flags);
   }
   jsvObjectSetChildAndUnLock(r, "lastIndex", jsvNewFromInteger(0));
+  JsVar *program = regexCompile(str);
+  if (!program) {
+    jsvUnLock(r);
+    return 0;
+  }
+  jsvObjectSetChildAndUnLock(r, REGEXP_PROGRAM_NAME, program);
   return r;
 }
 
@@ -337,20 +867,21 @@ Or with groups `/W(o)rld/.exec("Hello World")` returns:
 JsVar *jswrap_regexp_exec(JsVar *parent, JsVar *arg) {
   JsVar *str = jsvAsString(arg);
   JsVarInt lastIndex = jsvGetIntegerAndUnLock(jsvObjectGetChild(parent, "lastIndex", 0));
-  JsVar *regex = jsvObjectGetChild(parent, "source", 0);
-  if (!jsvIsString(regex)) {
-    jsvUnLock2(str,regex);
-    return 0;
-  }
-  size_t regexLen = jsvGetStringLength(regex);
-  char *regexPtr = (char *)alloca(regexLen+1);
-  if (!regexPtr) {
-    jsvUnLock2(str,regex);
-    return 0;
+  JsVar *program = jsvObjectGetChild(parent, REGEXP_PROGRAM_NAME, 0);
+  if (!jsvIsFlatString(program)) {
+    // not compiled yet (eg. the RegExp was created some other way)
+    jsvUnLock(program);
+    JsVar *regex = jsvObjectGetChild(parent, "source", 0);
+    program = jsvIsString(regex) ? regexCompile(regex) : 0;
+    jsvUnLock(regex);
+    if (!program) {
+      jsvUnLock(str);
+      return 0;
+    }
+    jsvObjectSetChild(parent, REGEXP_PROGRAM_NAME, program);
   }
-  jsvGetString(regex, regexPtr, regexLen+1);
-  jsvUnLock(regex);
-  JsVar *rmatch = match(regexPtr, str, (size_t)lastIndex, jswrap_regexp_hasFlag(parent,'i'));
+  JsVar *rmatch = regexMatch(program, str, (size_t)lastIndex, jswrap_regexp_hasFlag(parent,'i'));
+  jsvUnLock(program);
   jsvUnLock(str);
   if (!rmatch) {
     rmatch = jsvNewWithFlags(JSV_NULL);
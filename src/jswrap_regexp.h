@@ -13,6 +13,8 @@
  */
 #include "jsvar.h"
 
+#define REGEXP_PROGRAM_NAME JS_HIDDEN_CHAR_STR"prg" // the compiled program for this RegExp
+
 JsVar *jswrap_regexp_constructor(JsVar *str, JsVar *flags);
 JsVar *jswrap_regexp_exec(JsVar *parent, JsVar *str);
 bool jswrap_regexp_test(JsVar *parent, JsVar *str);
@@ -162,7 +162,6 @@ Return the last index of substring in this string, or -1 if not found
  */
 int jswrap_string_indexOf(JsVar *parent, JsVar *substring, JsVar *fromIndex, bool lastIndexOf) {
   if (!jsvIsString(parent)) return 0;
-  // slow, but simple!
   substring = jsvAsString(substring);
   if (!substring) return 0; // out of memory
   int parentLength = (int)jsvGetStringLength(parent);
@@ -172,19 +171,15 @@ int jswrap_string_indexOf(JsVar *parent, JsVar *substring, JsVar *fromIndex, boo
     return -1;
   }
   int lastPossibleSearch = parentLength - subStringLength;
-  int idx, dir, end;
+  int idx;
   if (!lastIndexOf) { // normal indexOf
-    dir = 1;
-    end = lastPossibleSearch+1;
     idx = 0;
     if (jsvIsNumeric(fromIndex)) {
       idx = (int)jsvGetInteger(fromIndex);
       if (idx<0) idx=0;
-      if (idx>end) idx=end;
+      if (idx>lastPossibleSearch+1) idx=lastPossibleSearch+1;
     }
   } else {
-    dir = -1;
-    end = -1;
     idx = lastPossibleSearch;
     if (jsvIsNumeric(fromIndex)) {
       idx = (int)jsvGetInteger(fromIndex);
@@ -193,14 +188,25 @@ int jswrap_string_indexOf(JsVar *parent, JsVar *substring, JsVar *fromIndex, boo
     }
   }
 
-  for (;idx!=end;idx+=dir) {
-    if (jsvCompareString(parent, substring, (size_t)idx, 0, true)==0) {
-      jsvUnLock(substring);
-      return idx;
-    }
+  if (!subStringLength) {
+    jsvUnLock(substring);
+    return (idx>parentLength) ? parentLength : idx;
+  }
+  /* Search forwards with a single iterator. For lastIndexOf we just
+   * remember the last match before idx */
+  int found = -1;
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, parent, (size_t)(lastIndexOf ? 0 : idx));
+  while (jsvStringIteratorFind(&it, substring)) {
+    int matchIdx = (int)jsvStringIteratorGetIndex(&it);
+    if (lastIndexOf && matchIdx>idx) break;
+    found = matchIdx;
+    if (!lastIndexOf) break;
+    jsvStringIteratorNext(&it);
   }
+  jsvStringIteratorFree(&it);
   jsvUnLock(substring);
-  return -1;
+  return found;
 }
 
 /*JSON{
@@ -238,6 +244,7 @@ JsVar *jswrap_string_match(JsVar *parent, JsVar *subStr) {
       JsVarInt idx = jsvGetIntegerAndUnLock(jsvObjectGetChild(match,"index",0));
       JsVarInt len = (JsVarInt)jsvGetStringLength(matchStr);
       int last = idx+len;
+      if (!len) last++; // don't keep matching the same empty string
       jsvArrayPushAndUnLock(array, matchStr);
       // search again
       jsvUnLock(match);
@@ -327,11 +334,10 @@ JsVar *jswrap_string_replace(JsVar *parent, JsVar *subStr, JsVar *newSubStr) {
           if (ch=='$') {
             jsvStringIteratorNext(&src);
             ch = jsvStringIteratorGetChar(&src);
-            JsVar *group = 0;
-            if (ch>'0' && ch<='9')
-              group = jsvGetArrayItem(match, ch-'0');
-            if (group) {
-              jsvStringIteratorAppendString(&dst, group, 0);
+            if (ch>'0' && ch<='9' && ch-'0' < jsvGetArrayLength(match)) {
+              // groups that didn't match are undefined, and are replaced with nothing
+              JsVar *group = jsvGetArrayItem(match, ch-'0');
+              if (group) jsvStringIteratorAppendString(&dst, group, 0);
               jsvUnLock(group);
             } else {
               jsvStringIteratorAppend(&dst, '$');
@@ -344,7 +350,11 @@ JsVar *jswrap_string_replace(JsVar *parent, JsVar *subStr, JsVar *newSubStr) {
         }
         jsvStringIteratorFree(&src);
       }
-      JsVarInt lastIndex = 1+(JsVarInt)jsvStringIteratorGetIndex(&dst);
+      jsvStringIteratorFree(&dst);
+      // carry on after the replacement - or one character later if we matched an empty string
+      JsVarInt lastIndex = (JsVarInt)jsvGetStringLength(newStr) + (len ? 0 : 1);
+      jsvStringIteratorNew(&dst, newStr, 0);
+      jsvStringIteratorGotoEnd(&dst);
       jsvStringIteratorAppendString(&dst, str, (size_t)(idx+len));
       jsvStringIteratorFree(&dst);
       jsvUnLock2(str,matchStr);
@@ -489,6 +499,7 @@ JsVar *jswrap_string_split(JsVar *parent, JsVar *split) {
   // Use RegExp if one is passed in
   if (jsvIsInstanceOf(split, "RegExp")) {
     unsigned int last = 0;
+    size_t strLen = jsvGetStringLength(parent);
     JsVar *match;
     jsvObjectSetChildAndUnLock(split, "lastIndex", jsvNewFromInteger(0));
     match = jswrap_regexp_exec(split, parent);
@@ -498,12 +509,18 @@ JsVar *jswrap_string_split(JsVar *parent, JsVar *split) {
       JsVarInt idx = jsvGetIntegerAndUnLock(jsvObjectGetChild(match,"index",0));
       JsVarInt len = (JsVarInt)jsvGetStringLength(matchStr);
       jsvUnLock(matchStr);
-      // do the replacement
-      jsvArrayPushAndUnLock(array, jsvNewFromStringVar(parent, (size_t)last, (size_t)(idx-last)));
-      last = idx+len;
-      // search again
       jsvUnLock(match);
-      jsvObjectSetChildAndUnLock(split, "lastIndex", jsvNewFromInteger(last));
+      match = 0;
+      if (idx >= (JsVarInt)strLen) break; // an empty match at the end doesn't split anything
+      if (idx+len == (JsVarInt)last) {
+        // an empty match where the last one finished - look again one character on
+        jsvObjectSetChildAndUnLock(split, "lastIndex", jsvNewFromInteger(idx+1));
+      } else {
+        jsvArrayPushAndUnLock(array, jsvNewFromStringVar(parent, (size_t)last, (size_t)(idx-last)));
+        last = (unsigned int)(idx+len);
+        jsvObjectSetChildAndUnLock(split, "lastIndex", jsvNewFromInteger(last));
+      }
+      // search again
       match = jswrap_regexp_exec(split, parent);
     }
     jsvUnLock(match);
@@ -519,23 +536,34 @@ JsVar *jswrap_string_split(JsVar *parent, JsVar *split) {
 
   int idx, last = 0;
   int splitlen = jsvIsUndefined(split) ? 0 : (int)jsvGetStringLength(split);
-  int l = (int)jsvGetStringLength(parent) + 1 - splitlen;
-
-  for (idx=0;idx<=l;idx++) {
-    if (splitlen==0 && idx==0) continue; // special case for where split string is ""
-    if (idx==l || splitlen==0 || jsvCompareString(parent, split, (size_t)idx, 0, true)==0) {
-      if (idx==l) {
-        idx=l+splitlen; // if the last element, do to the end of the string
-        if (splitlen==0) break;
-      }
-
-      JsVar *part = jsvNewFromStringVar(parent, (size_t)last, (size_t)(idx-last));
+  if (splitlen==0) {
+    // split string is "" - so we split into characters
+    int l = (int)jsvGetStringLength(parent);
+    for (idx=0;idx<l;idx++) {
+      JsVar *part = jsvNewFromStringVar(parent, (size_t)idx, 1);
       if (!part) break; // out of memory
-      jsvArrayPush(array, part);
-      jsvUnLock(part);
-      last = idx+splitlen;
+      jsvArrayPushAndUnLock(array, part);
     }
+    jsvUnLock(split);
+    return array;
   }
+
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, parent, 0);
+  while (jsvStringIteratorFind(&it, split)) {
+    idx = (int)jsvStringIteratorGetIndex(&it);
+    JsVar *part = jsvNewFromStringVar(parent, (size_t)last, (size_t)(idx-last));
+    if (!part) break; // out of memory
+    jsvArrayPushAndUnLock(array, part);
+    last = idx+splitlen;
+    // skip over the separator
+    for (idx=0;idx<splitlen;idx++)
+      jsvStringIteratorNext(&it);
+  }
+  jsvStringIteratorFree(&it);
+  // add what's after the last separator
+  JsVar *part = jsvNewFromStringVar(parent, (size_t)last, JSVAPPENDSTRINGVAR_MAXLENGTH);
+  if (part) jsvArrayPushAndUnLock(array, part);
   jsvUnLock(split);
   return array;
 }
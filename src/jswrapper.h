@@ -124,4 +124,10 @@ const char *jswGetBuiltInJSLibrary(const char *name);
 /** Return a comma-separated list of built-in libraries */
 const char *jswGetBuiltInLibraryNames();
 
+#if defined(LINUX) && !defined(SAVE_ON_FLASH)
+/** Time looking up every built-in symbol and built-in object name, print the
+ * results, and return false if any lookup didn't find what it should have */
+bool jswBenchmarkSymbolLookups();
+#endif
+
 #endif // JSWRAPPER_H
@@ -221,6 +221,9 @@ void show_help() {
     printf("   --test-mem-all          Run all Exhaustive Memory crash tests\n");
     printf("   --test-mem test.js      Run the supplied Exhaustive Memory crash test\n");
     printf("   --test-mem-n test.js #  Run the supplied Exhaustive Memory crash test with # vars\n");
+#ifndef SAVE_ON_FLASH
+    printf("   --bench-builtins        Time (and check) lookups of every built-in function and object\n");
+#endif
 }
 
 void die(const char *txt) {
@@ -300,6 +303,17 @@ int main(int argc, char **argv) {
         if (i+2>=argc) die("Expecting an extra 2 arguments\n");
         bool ok = run_memory_test(argv[i+1], atoi(argv[i+2]));
         exit(ok ? 0 : 1);
+#ifndef SAVE_ON_FLASH
+      } else if (!strcmp(a,"--bench-builtins")) {
+        jshInit();
+        jsvInit(0);
+        jsiInit(false);
+        bool ok = jswBenchmarkSymbolLookups();
+        jsiKill();
+        jsvKill();
+        jshKill();
+        exit(ok ? 0 : 1);
+#endif
       } else {
         printf("Unknown Argument %s\n", a);
         show_help();
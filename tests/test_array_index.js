@@ -0,0 +1,38 @@
+// Long dense arrays get a table of their elements - check it keeps up with changes to the array
+var r = [];
+function make(n) { var a = []; for (var i=0;i<n;i++) a.push(i); return a; }
+function sum(a) { var s = 0; for (var i=0;i<a.length;i++) s += a[i]; return s; }
+
+var a = make(40);
+r.push(a[0], a[39], a[40], a[-1], sum(a));
+a.push(40); a[41] = 41;
+r.push(a[40], a[41], a.length);
+a.pop(); a.pop();
+r.push(a[39], a[40], a.length);
+a.shift();
+r.push(a[0], a[38], a[39], a.length);
+a.unshift(100);
+r.push(a[0], a[1], a[39]);
+a.splice(10, 2);
+r.push(a[10], a[37], a.length);
+a.splice(5, 0, "x", "y");
+r.push(a[5], a[6], a[7], a[39]);
+a.reverse();
+r.push(a[0], a[39], a[20]);
+a = make(30);
+a.sort(function(x,y) { return y-x; });
+r.push(a[0], a[29], a[15], sum(a));
+a = make(20);
+a[25] = 25; // sparse
+r.push(a[19], a[20], a[25], a.length);
+a = make(20);
+delete a[10];
+r.push(a[9], a[10], a[11]);
+a = make(20);
+a.foo = "bar";
+r.push(a[19], a.foo);
+a = make(20);
+var b = a.slice(); b[3] = "b";
+r.push(a[3], b[3], b[19]);
+
+result = r.join(",")=="0,39,,,780,40,41,42,39,,40,1,39,,39,100,1,39,12,39,38,x,y,5,39,39,100,19,29,0,14,435,19,,25,26,9,,11,19,bar,3,b,19";
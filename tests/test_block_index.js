@@ -0,0 +1,45 @@
+// Tokenised functions skip blocks that aren't executed using an index of where blocks end
+E.setFlags({pretokenise:0, tokeniseOnCall:1});
+
+function f(x) {
+  var r = "";
+  if (x>1) {
+    r += "{";
+    if (x>2) { r += "}"; } else { r += /[{]}/.source; }
+    var o = { a : { b : `${x}}` } };
+    r += o.a.b;
+  } else {
+    r += "small";
+  }
+  for (var i=0;i<3;i++) {
+    if (i==1) { r += "b"; break; r += "never"; }
+    r += i;
+  }
+  switch (x) {
+    case 1: { r += "one"; break; }
+    default: r += "other";
+  }
+  while (true) {
+    if (x) { return r+"!"; }
+    r += "never";
+  }
+}
+
+function g() {
+  var o = { catch : function(e) { return e+"{"; } }; // reserved word as a field name
+  try { throw "e"; r = "never"; } catch (e) { return o.catch(e); }
+}
+
+// a parameter called 'blk' mustn't be mistaken for the block index
+var blk = 1;
+function h(x,blk) { if (x) { return x+(blk||0); } return 0; }
+function k(a,blk) { blk=5; return blk; }
+
+var r = [];
+for (var i=0;i<2;i++) r.push(f(1), f(2), f(3), g());
+var hasIndex = f[E.toString([255])+"blk"]!==undefined;
+var rb = [h(1), h(3), h(3,1), k(1)];
+E.setFlags({tokeniseOnCall:0});
+
+result = r.join("|") == "small0bone!|{[{]}2}0bother!|{}3}0bother!|e{|small0bone!|{[{]}2}0bother!|{}3}0bother!|e{" && hasIndex &&
+         rb.join(",")=="1,3,4,5" && blk==1;
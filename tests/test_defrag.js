@@ -0,0 +1,43 @@
+// Check that moving variables around with E.defrag doesn't change anything
+var r = [];
+
+// leave lots of small gaps in memory
+var junk = [];
+for (var i=0;i<400;i++) junk.push("Some string "+i+" that needs a StringExt or two");
+var keep = [];
+for (i=0;i<junk.length;i+=2) keep.push(junk[i]);
+junk = undefined;
+
+var obj = {};
+for (i=0;i<100;i++) obj["key"+i] = {n:i, s:"value "+i};
+var arr = [];
+for (i=0;i<100;i++) arr.push(i*3);
+var nested = { a : { b : { c : [1,2,{d:"deep"}] } } };
+function counter() { var c = 0; return function() { return ++c; }; }
+var count = counter();
+count();
+var timerFired = false;
+setTimeout(function() { timerFired = true; }, 1);
+var sw = function(x) { switch (x) { case 1: return "one"; case 2: return "two"; default: return "other"; } };
+sw(1);
+
+var moved = E.defrag();
+
+r.push(moved>0);
+r.push(keep.length==200 && keep[10]=="Some string 20 that needs a StringExt or two");
+r.push(obj.key0.n==0 && obj.key99.s=="value 99" && Object.keys(obj).length==100);
+r.push(arr[0]==0 && arr[99]==297 && arr.length==100);
+arr.push(300);
+r.push(arr[100]==300);
+r.push(nested.a.b.c[2].d=="deep");
+r.push(count()==2);
+r.push(sw(1)=="one" && sw(2)=="two" && sw(3)=="other");
+delete obj.key50;
+r.push(obj.key50===undefined && obj.key51.n==51 && Object.keys(obj).length==99);
+obj.key50 = 50;
+r.push(obj.key50==50);
+
+setTimeout(function() {
+  r.push(timerFired);
+  result = r.every(function(x) { return x; });
+}, 10);
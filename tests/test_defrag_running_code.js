@@ -0,0 +1,37 @@
+// E.defrag() called from code that is running mustn't move the code out from under the lexer
+var r = [];
+
+// leave lots of small gaps in memory
+var junk = [];
+for (var i=0;i<300;i++) junk.push("Some string "+i+" that needs a StringExt or two");
+var keep = [];
+for (i=0;i<junk.length;i+=2) keep.push(junk[i]);
+junk = undefined;
+
+// code in a string made from lots of StringExts
+var code = "var m = E.defrag(); var total = 0;";
+for (i=0;i<10;i++) code += " total = total + "+i+";";
+code += " [m, total]";
+var res = eval(code);
+r.push(res[0]>0 && res[1]==45);
+
+// inside a function, and inside loops in a function
+function f() {
+  var s = 0;
+  for (var i=0;i<5;i++) {
+    s += i;
+    if (i==2) keep.push(E.defrag());
+    s += 1;
+  }
+  var j = 0;
+  while (j<4) { if (j==1) E.defrag(); s = s + j; j++; }
+  E.defrag();
+  return s + 100; // some code after the defrag
+}
+junk = [];
+for (i=0;i<100;i++) junk.push("More strings "+i+" to leave gaps when freed");
+junk = junk.filter(function(x,i) { return i&1; });
+r.push(f()==121 && f()==121);
+r.push(keep.length==152 && keep[10]=="Some string 20 that needs a StringExt or two");
+
+result = r.every(function(x) { return x; });
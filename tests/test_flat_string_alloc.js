@@ -0,0 +1,12 @@
+// Flat strings should still be allocated in one piece when the free list has been scrambled by lots of frees
+var r = [];
+var keep = [];
+for (var i=0;i<2000;i++) keep.push({i:i});
+for (i=0;i<50;i++) {
+  for (var j=0;j<20;j++) keep[(i*97+j*331)%2000] = {};
+  var b = new Uint8Array(256+(i%4)*128);
+  for (j=0;j<b.length;j++) b[j] = j+i;
+  r.push(E.getAddressOf(b.buffer,true)!=0 && b[0]==(i&255) && b[b.length-1]==((b.length-1+i)&255));
+}
+r.push(keep[1999].i===undefined || keep[1999].i==1999);
+result = r.every(function(x) { return x; });
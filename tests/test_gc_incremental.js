@@ -0,0 +1,29 @@
+// Incremental garbage collection (E.setGCBudget) - check garbage gets freed a bit at a time, and nothing in use does
+E.setGCBudget(100);
+var keep = { list:[], obj:{} };
+function makeGarbage() {
+  for (var i=0;i<200;i++) {
+    var a = { n:i }, b = { a:a, s:"Hello World "+i };
+    a.b = b; // circular, so only the garbage collector can free it
+    if (i%10==0) keep.list.push(b); // ...but keep some
+    keep.obj["k"+i] = i;
+  }
+}
+makeGarbage();
+var loops = 0;
+process.memory(); // full collection
+makeGarbage();
+var interval = setInterval(function() {
+  // keep allocating while the collection is happening
+  keep.list.push({ x:loops, s:"more "+loops });
+  if (++loops < 200) return;
+  clearInterval(interval);
+  E.setGCBudget(0);
+  // the garbage should have been freed already, so there's nothing left for a full collection
+  var ok = process.memory().gc < 100;
+  ok = ok && keep.list.length==40+200;
+  for (var i=0;i<40;i++) ok = ok && keep.list[i].a.b===keep.list[i] && keep.list[i].s=="Hello World "+((i%20)*10);
+  for (var i=0;i<200;i++) ok = ok && keep.list[40+i].x==i && keep.list[40+i].s=="more "+i;
+  for (var i=0;i<200;i++) ok = ok && keep.obj["k"+i]==i;
+  result = ok;
+}, 1);
@@ -0,0 +1,22 @@
+// The garbage collector marks with its own stack - check deep structures, including ones that overflow it
+function make(depth) {
+  var root = {}, o = root;
+  for (var i=0;i<depth;i++) {
+    o.child = { n:i }; // 'n' is left on the stack for each level
+    o.other = [i, "x"+i];
+    o = o.child;
+  }
+  return root;
+}
+function check(root, depth) {
+  var o = root;
+  for (var i=0;i<depth;i++) {
+    o = o.child;
+    if (!o || o.n!=i || root===o) return false;
+  }
+  return true;
+}
+var shallow = make(10), deep = make(500);
+var garbage = make(200); garbage.child.child.loop = garbage; garbage = undefined; // circular
+var m = process.memory();
+result = check(shallow, 10) && check(deep, 500) && m.gc>0 && m.gcdepth>0 && m.gcmarktime>=0;
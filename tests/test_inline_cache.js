@@ -0,0 +1,36 @@
+// Member accesses remember where they found things - check they notice when objects change
+function Foo(v) { this.v = v; }
+Foo.prototype.get = function() { return "proto"+this.v; };
+var other = { get : function() { return "other"; } };
+
+var r = [];
+var f = new Foo(1);
+for (var i=0;i<6;i++) {
+  r.push(f.get());
+  if (i==1) f.get = function() { return "own"; }; // now shadows the prototype
+  if (i==2) delete f.get;
+  if (i==3) f.__proto__ = other;
+  if (i==4) f = new Foo(2);
+}
+
+// Objects made the same way have their fields in the same place
+var s = 0;
+for (i=0;i<5;i++) {
+  var o = {a:i, b:i*2, c:i*3};
+  if (i==3) o = {c:100}; // different shape
+  s += o.c;
+}
+
+// Declaring local variables doesn't make member accesses forget what they found
+function decode(m) { var a = m.x; var b = m.y; return a+b+m.z; }
+var before = E.getInlineCacheStats();
+var d = 0;
+for (i=0;i<100;i++) d += decode({x:1, y:2, z:i});
+var after = E.getInlineCacheStats();
+var localHits = after.hits-before.hits, localMisses = after.misses-before.misses;
+
+var stats = E.getInlineCacheStats();
+result = r.join(",")=="proto1,proto1,own,proto1,other,proto2" &&
+         s==121 &&
+         d==5250 && localHits>=290 && localMisses<10 &&
+         stats.hits>0 && stats.misses>0;
@@ -0,0 +1,33 @@
+// JSON.parse uses its own scanner rather than the JS lexer
+var r = [];
+var o = JSON.parse(' {"a":1, "b" : [1,-2.5e3,{"c":null}], "d":"x\\ny\\u0041\\"\\/", "e":true, "f":false, "5":"five"} ');
+r.push(o.a===1 && o.b[1]===-2500 && o.b[2].c===null && o.e===true && o.f===false);
+r.push(o.d=="x\nyA\"/" && o[5]=="five" && Object.keys(o).length==6);
+r.push(JSON.stringify(JSON.parse("[-1,0.125,1E2,-0,2147483648,[],{}]"))=="[-1,0.125,100,0,2147483648,[],{}]");
+r.push(JSON.parse('"\\t"')=="\t" && JSON.parse(" 42 ")===42 && JSON.parse("[[[[1]]]]")[0][0][0][0]===1);
+var long = "";
+for (var i=0;i<300;i++) long += String.fromCharCode(32+(i%90))+(i%7 ? "" : "\n\"");
+r.push(JSON.parse(JSON.stringify(long))==long && JSON.parse(JSON.stringify([long,long]))[1]==long);
+// round trip
+var big = {list:[], name:"test"};
+for (var i=0;i<50;i++) big.list.push({id:i, v:i/4, s:"item "+i});
+r.push(JSON.stringify(JSON.parse(JSON.stringify(big)))==JSON.stringify(big));
+// escapes that JSON.stringify writes for control characters
+var ctrl = "";
+for (i=0;i<32;i++) ctrl += String.fromCharCode(i)+"a";
+ctrl += String.fromCharCode(127,1,65,0);
+r.push(JSON.parse(JSON.stringify(ctrl))==ctrl && JSON.parse(JSON.stringify(String.fromCharCode(1,65,0)))=="\x01A\0");
+r.push(JSON.parse('"\\x41\\101\\7\\v\\0"')=="AA\x07\x0B\0" && JSON.stringify(JSON.parse(JSON.stringify({"\x02":"\x1F"})))=='{"\\2":"\\x1F"}');
+// trailing commas are allowed (as they always have been)
+r.push(JSON.stringify(JSON.parse("[1,2,]"))=="[1,2]" && JSON.stringify(JSON.parse('{"a":1, }'))=='{"a":1}');
+// 0x, 0b and 0o integers are allowed (as they always have been)
+r.push(JSON.parse("0x1F")===31 && JSON.stringify(JSON.parse("[0x10,-0x10,0b101,0o17]"))=="[16,-16,5,15]");
+// as are numbers starting with '.'
+r.push(JSON.parse(".5")===0.5 && JSON.stringify(JSON.parse("[-.5,.25e1]"))=="[-0.5,2.5]");
+// invalid JSON is a SyntaxError, and never gets executed
+var errors = 0;
+["[,1]", '{,}', "{a:1}", "[1 2]", "tru", "", '"abc', '{"a" 1}', "-", "[", "print('x')", "(1)", "0x", "[0x]", "0b2", ".", "[-.]"].forEach(function(s) {
+  try { JSON.parse(s); } catch (e) { if (e instanceof SyntaxError) errors++; }
+});
+r.push(errors==17);
+result = r.every(function(x) { return x; });
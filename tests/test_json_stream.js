@@ -0,0 +1,74 @@
+// JSONParser is given JSON a bit at a time, and reports values as soon as they're parsed
+var r = [];
+var doc = '{"fw":{"version":"2v01","files":[{"name":"a\\n\\u0041","size":200},{"name":"b","size":-1.5e2,"ok":true,"x":null}]},"list":[1,[2,3],[],{}],"n":42}';
+var expected = 'fw.version="2v01"|fw.files.0.name="a\\nA"|fw.files.0.size=200|fw.files.1.name="b"|fw.files.1.size=-150|'+
+               'fw.files.1.ok=true|fw.files.1.x=null|list.0=1|list.1.0=2|list.1.1=3|n=42|end';
+// split the document up in every possible way
+var ok = true;
+for (var chunk=1;chunk<8;chunk++) {
+  var out = [];
+  var p = new JSONParser();
+  p.on('value', function(v, path) { out.push(path.join(".")+"="+JSON.stringify(v)); });
+  p.on('end', function() { out.push("end"); });
+  for (var i=0;i<doc.length;i+=chunk) p.write(doc.substr(i,chunk));
+  p.end();
+  if (out.join("|")!=expected) ok = false;
+}
+r.push(ok);
+// selected objects are built whole, and several documents can follow each other
+out = [];
+p = new JSONParser({select : function(path) { return path[1]=="files" && path.length==3; }});
+p.on('value', function(v, path) { out.push(JSON.stringify(path)+JSON.stringify(v)); });
+p.write(doc.substr(0,60));
+p.write(doc.substr(60));
+p.write(' 12 [1,2]\n"x"');
+p.end();
+r.push(out[1]=='["fw","files",0]{"name":"a\\nA","size":200}' && out[2]=='["fw","files",1]{"name":"b","size":-150,"ok":true,"x":null}');
+r.push(out.slice(-4).join()=='[]12,[0]1,[1]2,[]"x"');
+// select the whole document, like JSON.parse
+out = [];
+p = new JSONParser({select : function(path) { return true; }});
+p.on('value', function(v) { out.push(v); });
+p.write(doc);
+p.end();
+r.push(out.length==1 && JSON.stringify(out[0])==JSON.stringify(JSON.parse(doc)));
+// the same escapes and trailing commas as JSON.parse, however the data is split up
+var ctrl = "";
+for (i=0;i<32;i++) ctrl += String.fromCharCode(i)+"a";
+ctrl += String.fromCharCode(127,1,65,0);
+var esc = '{"s":'+JSON.stringify(ctrl)+',"t":"\\x41\\101\\7\\v\\0","l":[1,2,],"o":{"a":1,},}';
+ok = true;
+for (chunk=1;chunk<8;chunk++) {
+  out = [];
+  p = new JSONParser({select : function(path) { return true; }});
+  p.on('value', function(v) { out.push(v); });
+  for (i=0;i<esc.length;i+=chunk) p.write(esc.substr(i,chunk));
+  p.end();
+  if (out.length!=1 || JSON.stringify(out[0])!=JSON.stringify(JSON.parse(esc))) ok = false;
+}
+r.push(ok && out[0].s==ctrl && out[0].t=="AA\x07\x0B\0");
+// numbers are read like JSON.parse reads them
+out = [];
+p = new JSONParser();
+p.on('value', function(v) { out.push(v); });
+p.write('[.5,-.5,0x10,1e2]');
+p.end();
+r.push(out.join(",")=="0.5,-0.5,16,100");
+// errors
+var errors = 0;
+['[1,}', '{"a" 1}', '[tru]', '{"a":1', '"abc', '[1 2]'].forEach(function(s) {
+  try { p.write(s); p.end(); } catch (e) { if (e instanceof SyntaxError) errors++; p.end(); }
+});
+r.push(errors==6);
+// lots of data doesn't use lots of memory
+var count = 0, sum = 0;
+p = new JSONParser();
+p.on('value', function(v, path) { if (path[2]=="v") { count++; sum += v; } });
+p.write('{"items":[');
+var before = process.memory().usage;
+for (i=0;i<500;i++) p.write((i?',':'')+'{"id":"item'+i+'","v":'+i+'}');
+var after = process.memory().usage;
+p.write(']}');
+p.end();
+r.push(count==500 && sum==124750 && after-before < 20);
+result = r.every(function(x) { return x; });
@@ -0,0 +1,24 @@
+// Loops replay tokens from their first iterations rather than lexing them again
+var r = [];
+for (var i=0;i<5;i++) {
+  var s = "a";
+  s += "b"; // strings get modified in place, so must be new each time
+  for (var j=0;j<3;j++) {
+    if (j==1) continue;
+    r.push(s+i+j);
+  }
+  var k = 0;
+  while (k<10) { if (/k/.test("k"+k) && k>1) break; k++; }
+  r.push(k);
+}
+function f(n) {
+  var t = 0;
+  for (var x in [1,2,3]) t += n*x;
+  do { t++; } while (t%4);
+  return t;
+}
+var fr = [];
+for (i=0;i<4;i++) fr.push(f(i));
+
+result = r.join(",")=="ab00,ab02,2,ab10,ab12,2,ab20,ab22,2,ab30,ab32,2,ab40,ab42,2" &&
+         fr.join(",")=="4,4,8,12";
@@ -0,0 +1,24 @@
+// Results of calculations can be written into temporary numbers - check nothing that's stored gets overwritten
+var r = [];
+var a = 1+2;
+var b = a;
+a = (a*2)+1;
+r.push(a, b);
+
+var c = 5, d = c;
+c += 2*3;
+d++;
+r.push(c, d);
+
+var arr = [1, 2];
+var e = arr[0]+arr[1]*10;
+r.push(e, arr[0], arr[1]);
+
+function f(x) { var y = x*2; return y; }
+var g = f(3) + f(4);
+r.push(g, -f(2), -(1+1));
+
+var h = (1<2) + (3>4);
+r.push(h, (2.5*2)|0, 1/2+0.25, "a"+(1+2));
+
+result = r.join(",")=="7,3,11,6,21,1,2,14,-4,-2,1,5,0.75,a3";
@@ -0,0 +1,17 @@
+// Memory that is allocated in a spike should be given back afterwards (where memory can grow)
+var r = [];
+var before = process.memory().total;
+var big = [];
+for (var i=0;i<10000;i++) big.push({a:i,b:"item "+i});
+var during = process.memory().total;
+var keep = { s : "allocated after the spike", n : big[9999].a };
+big = undefined;
+E.defrag();
+var after = process.memory().total;
+r.push(during==before || after<during);
+r.push(keep.s=="allocated after the spike" && keep.n==9999);
+// memory can still grow again afterwards
+var arr = [];
+for (i=0;i<10000;i++) arr.push("more "+i);
+r.push(arr.length==10000 && arr[1234]=="more 1234");
+result = r.every(function(x) { return x; });
@@ -0,0 +1,25 @@
+// Looking up names of different lengths - short ones fit in the name itself, long ones need StringExts
+var r = [];
+var o = {};
+var keys = ["", "a", "ab", "abc", "abcd", "abcde", "abcdef", "abcdefg", "abcdefgh", "abcdefghi",
+            "abcdefghijklmnop", "abcdefghijklmnopq", "abcdefghijklmnopr", "abcdefgha", "5", "12"];
+keys.forEach(function(k, i) { o[k] = i; });
+r.push(keys.every(function(k, i) { return o[k]===i; }));
+r.push(o["abcdefghijklmno"]===undefined && o["abcdefghx"]===undefined && o["b"]===undefined);
+r.push(o[5]===14 && o[12]===15 && o["12"]===15);
+// dynamically created keys
+var k = "abcdefghijklmnop";
+r.push(o[k.substr(0,9)]===9 && o[k]===10 && o[k+"q"]===11 && o[k.substr(0,8)+"a"]===13);
+r.push(o[String.fromCharCode(97,98,99)]===3);
+// keys that only differ after the first few characters
+var p = {};
+for (var i=0;i<20;i++) p["somelongprefix"+i] = i;
+var ok = true;
+for (i=0;i<20;i++) if (p["somelongprefix"+i]!==i) ok = false;
+r.push(ok && p["somelongprefix"]===undefined && p.somelongprefix19===19);
+// arrays still use integer names
+var a = [1,2,3];
+r.push(a["1"]===2 && a[2]===3 && a["length"]===3);
+delete o["abcdefghi"];
+r.push(o["abcdefghi"]===undefined && o["abcdefgh"]===8 && o["abcdefghijklmnop"]===10);
+result = r.every(function(x) { return x; });
@@ -0,0 +1,25 @@
+// Objects with lots of keys get an index of their children - check adding/removing/finding still works
+var o = {};
+for (var i=0;i<300;i++) o["key"+i] = i;
+var ok = true;
+for (var i=0;i<300;i++) if (o["key"+i]!==i) ok = false;
+// remove every other key
+for (var i=0;i<300;i+=2) delete o["key"+i];
+for (var i=0;i<300;i++) if (o["key"+i]!==((i&1)?i:undefined)) ok = false;
+// add them back
+for (var i=0;i<300;i+=2) o["key"+i] = -i;
+for (var i=0;i<300;i++) if (o["key"+i]!==((i&1)?i:-i)) ok = false;
+// copies
+var c = Object.assign({}, o);
+ok = ok && c.key299==299 && c.key298==-298 && Object.keys(c).length==300;
+// integer keys aren't in the index, but must still work
+o[5] = "five";
+ok = ok && o[5]=="five" && o["5"]=="five" && ("key1" in o) && !("nope" in o);
+// globals (the root object has lots of keys too)
+for (var i=0;i<50;i++) global["g"+i] = i*2;
+ok = ok && g49==98 && g0==0;
+for (var i=0;i<50;i++) delete global["g"+i];
+ok = ok && global.g49===undefined;
+process.memory(); // garbage collect
+
+result = ok && o.key1==1 && o.key2==-2 && Object.keys(o).length==301;
@@ -0,0 +1,30 @@
+// Sampling profiler - check that time spent in a function shows up
+function busy(n) {
+  var s = 0;
+  for (var i=0;i<n;i++) s+=i;
+  return s;
+}
+function caller() {
+  return busy(100);
+}
+
+function profile() {
+  E.profileStart(1);
+  var end = getTime()+0.2;
+  while (getTime()<end) caller();
+  var p = E.profileStop();
+  return p.samples>0 &&
+         p.functions.busy>0 &&
+         // line numbers are in the original code, even if it was tokenised
+         Object.keys(p.lines).some(l => l.startsWith("busy:") && l!="busy:1") &&
+         p.folded.indexOf("(root);profile;caller;busy ")>=0 &&
+         E.profileStop()===undefined;
+}
+
+var r1 = profile();
+// Functions that are tail called and tokenised are still named, with the right lines
+E.setFlags({tailCalls:1, tokeniseOnCall:1});
+var r2 = profile();
+E.setFlags({tailCalls:0, tokeniseOnCall:0});
+
+result = r1 && r2;
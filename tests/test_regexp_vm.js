@@ -0,0 +1,37 @@
+// RegExps are compiled and matched without backtracking - check the features that needed
+var r = [];
+function m(re, s) {
+  var a = re.exec(s);
+  return a ? [].slice.call(a).map(function(x) { return x===undefined ? "U" : x; }).join(",")+"@"+a.index : "null";
+}
+r.push(m(/(a|ab)(c|bcd)(d*)/, "abcd") == "abcd,a,bcd,@0");
+r.push(m(/colou?r/, "the color") == "color@4");
+r.push(m(/a+?b/, "aaab") == "aaab@0" && m(/<.+?>/, "<a><b>") == "<a>@0");
+r.push(m(/a{2,3}/, "aaaa") == "aaa@0" && m(/a{2,}?/, "aaaa") == "aa@0" && m(/x{2}/, "xxx") == "xx@0");
+r.push(m(/a{,3}/, "a{,3}") == "a{,3}@0"); // not a quantifier
+r.push(m(/\bfoo\b/, "afoo foo") == "foo@5" && m(/\Boo/, "oo foo") == "oo@4");
+r.push(m(/(?:ab)+/, "xababab") == "ababab@1");
+r.push(m(/(a)|(b)/, "b") == "b,U,b@0" && m(/(x)?y/, "y") == "y,U@0");
+r.push(m(/(a|b)*c/, "abbac") == "abbac,a@0");
+r.push(m(/^b/, "ab") == "null" && m(/c$/, "abc") == "c@2");
+// captures in a repeated group are reset each time, and repeats beyond the minimum can't be empty
+r.push(m(/(?:(a)|b)+/, "ab") == "ab,U@0" && m(/(?:(a)|b){2}/, "ab") == "ab,U@0");
+r.push(m(/((a+\d+)?|b*)+[^a]{1,3}\s+?/, "ab x ") == "b x ,b,U@1");
+r.push(m(/(a*)?/, "b") == ",U@0" && m(/(a*)+/, "b") == ",@0" && m(/(a|)+x/, "aax") == "aax,a@0");
+// would take exponential time with a backtracking matcher
+var a = "";
+for (var i=0;i<30;i++) a += "a";
+r.push(m(/(a+)+b/, a) == "null" && m(/a*a*a*a*a*a*b/, a+"b") == a+"b@0");
+// empty matches don't loop forever
+r.push("abc".replace(/x*/g, "-") == "-a-b-c-");
+r.push(JSON.stringify("abc".split(/x*/)) == '["a","b","c"]');
+r.push(JSON.stringify("aaa".match(/a*?/g)) == '["","","",""]');
+r.push("aab".replace(/a/g, "") == "b");
+r.push("a-b".replace(/(x)?-/, "[$1]") == "a[]b" && "a-b".replace(/(-)/, "[$2]") == "a[$2]b");
+// bad patterns are SyntaxErrors
+var errors = 0;
+["(", "a)", "*a", "a**", "[a", "[z-a]", "a{3,1}"].forEach(function(p) {
+  try { new RegExp(p); } catch (e) { if (e instanceof SyntaxError) errors++; }
+});
+r.push(errors == 7);
+result = r.every(function(x) { return x; });
@@ -0,0 +1,55 @@
+// Variable lookups are remembered within a function call - check they notice scopes changing
+var x = "global";
+var r = [];
+
+function shadow() {
+  var a = [];
+  for (var i=0;i<3;i++) {
+    a.push(x); // global first time, then the local once it's declared
+    if (i==0) var x = "local";
+  }
+  return a.join(",");
+}
+r.push(shadow());
+
+function del() {
+  var a = [];
+  for (var i=0;i<3;i++) {
+    a.push(typeof y);
+    if (i==0) y = 1;
+    if (i==1) delete y;
+  }
+  return a.join(",");
+}
+r.push(del());
+
+function caught() {
+  var e = "outer", a = [];
+  for (var i=0;i<2;i++) {
+    a.push(e);
+    try { throw "ex"+i; } catch (e) { a.push(e); }
+    a.push(e);
+  }
+  return a.join(",");
+}
+r.push(caught());
+
+function evald() {
+  var a = [];
+  for (var i=0;i<2;i++) {
+    a.push(x);
+    eval("var x = 'eval"+i+"'");
+  }
+  return a.join(",");
+}
+r.push(evald());
+
+function outer() {
+  var n = 0;
+  function inc() { n++; return n; }
+  for (var i=0;i<3;i++) inc();
+  return n;
+}
+r.push(outer());
+
+result = r.join("|")=="global,local,local|undefined,number,undefined|outer,ex0,outer,outer,ex1,outer|global,eval0|3";
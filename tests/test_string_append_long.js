@@ -0,0 +1,21 @@
+// Appending to long strings remembers where the end is - check the results are still right
+var r = [];
+var s = "";
+for (var i=0;i<300;i++) s += "item "+i+",";
+r.push(s.length==2590 && s.substr(0,14)=="item 0,item 1," && s.substr(-9)=="item 299,");
+var t = s; // two references - += has to copy
+t += "END";
+r.push(s.length==2590 && t.length==2593 && t.substr(-3)=="END");
+// names of long strings, and strings that get freed
+var o = {};
+o[s] = 1;
+s += "more";
+r.push(s.length==2594 && Object.keys(o)[0].length==2590);
+var arr = [];
+for (i=0;i<20;i++) { var x = ""; for (var j=0;j<50;j++) x += "ab"; arr.push(x); }
+r.push(arr.every(function(x) { return x.length==100; }));
+var log = "";
+function add(x) { log += x; E.getSizeOf(log); }
+for (i=0;i<100;i++) add(String.fromCharCode(65+(i%26)));
+r.push(log.length==100 && log[99]=="V");
+result = r.every(function(x) { return x; });
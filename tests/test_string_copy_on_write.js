@@ -0,0 +1,36 @@
+// Strings are shared rather than copied, and appended to in place when nothing else can see them - check nothing that's stored changes
+var r = [];
+var part = "0123456789abcdefghijklmnopqrstuvwxyz";
+var big = "";
+for (var i=0;i<20;i++) big += part;
+
+// bound arguments share the string
+function f(a,b) { return a+b; }
+var g = f.bind(null, big).bind(null, "!");
+var h = f.bind(null, big);
+r.push(g()==big+"!" && h("?")==big+"?" && big.length==720);
+var b2 = big;
+b2 += "x";
+r.push(big.length==720 && b2.length==721 && g().length==721);
+
+// adding to strings
+var s = "abc";
+var t = s + "d" + "e";
+r.push(s=="abc" && t=="abcde");
+var o = { s : "hi" };
+var t2 = o.s + "!" + "?";
+r.push(o.s=="hi" && t2=="hi!?");
+function ret() { return o.s; }
+var t3 = ret() + "x";
+r.push(o.s=="hi" && t3=="hix");
+function local() { var l = "loc"; return l; }
+r.push(local()+"al"=="local" && local()=="loc");
+var ts = { v : "keep", toString : function() { return this.v; } };
+r.push(ts+"x"=="keepx" && ts.v=="keep" && 1+"a"=="1a" && (1+2)+"a"=="3a");
+var lits = [];
+for (i=0;i<3;i++) lits.push("a"+i+"b");
+r.push(lits.join()=="a0b,a1b,a2b");
+var long = part+part+part+part+part;
+r.push(long.length==180 && part.length==36 && long.substr(-36)==part);
+
+result = r.every(function(x) { return x; });
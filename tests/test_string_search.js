@@ -0,0 +1,27 @@
+// indexOf/lastIndexOf/includes/split/replace search whole blocks of a string at once - check matches across StringExt boundaries
+var r = [];
+var s = "";
+for (var i=0;i<300;i++) s += i+",";
+function check(s) {
+  var ok = true;
+  var p = s.split(",");
+  ok = ok && p.length==301 && p[0]=="0" && p[299]=="299" && p[300]=="";
+  for (var i=0;i<300;i+=17) {
+    var k = ","+i+",";
+    var expected = -1, j;
+    for (j=0;j<=s.length-k.length;j++) if (s.substr(j,k.length)==k) { expected = j; break; }
+    if (s.indexOf(k)!=expected || s.lastIndexOf(k)!=expected || s.includes(k)!=(expected>=0)) ok = false;
+    if (expected>=0 && (s.indexOf(k,expected+1)!=-1 || s.lastIndexOf(k,expected-1)!=-1)) ok = false;
+  }
+  ok = ok && s.indexOf("299,")==s.length-4 && s.lastIndexOf("0,")==s.indexOf("290,")+2 && s.indexOf("0,",1)==21;
+  ok = ok && s.replace("150,","X").indexOf(",X151,")>0 && s.replace("nothere","X")==s;
+  ok = ok && s.split("99,").length==4 && s.split(",2").length==112;
+  return ok;
+}
+r.push(check(s));
+r.push(check(E.toString(s))); // flat string
+// things that nearly match, and overlaps
+r.push("aaab".indexOf("aab")==1 && "abababc".indexOf("ababc")==2 && "aaa".split("aa").join("|")=="|a");
+r.push("abc".indexOf("",10)==3 && "abc".indexOf("",1)==1 && "abc".lastIndexOf("")==3 && "".indexOf("")==0 && "".indexOf("a")==-1);
+r.push("abc".split("").join("|")=="a|b|c" && "".split("").length==0 && "".split(",").length==1);
+result = r.every(function(x) { return x; });
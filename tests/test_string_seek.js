@@ -0,0 +1,30 @@
+// Seeking into long strings (which remember StringExts along the way) should always find the right character
+var r = [];
+function make(n, k) {
+  var s = "";
+  for (var i=0;i<n;i++) s += String.fromCharCode(48+(i*k)%75);
+  return s;
+}
+function check(s, n, k) {
+  var ok = s.length==n;
+  // forwards, backwards and jumping around
+  for (var i=0;i<n;i+=7) if (s.charCodeAt(i)!=48+(i*k)%75) ok = false;
+  for (i=n-1;i>=0;i-=13) if (s[i]!=String.fromCharCode(48+(i*k)%75)) ok = false;
+  for (i=0;i<200;i++) { var j = (i*7919)%n; if (s.charCodeAt(j)!=48+(j*k)%75) ok = false; }
+  return ok;
+}
+var a = make(5000, 7);
+r.push(check(a, 5000, 7));
+// appending keeps what we remembered valid
+for (var i=5000;i<9000;i++) a += String.fromCharCode(48+(i*7)%75);
+r.push(check(a, 9000, 7));
+r.push(a.substring(8990)==a.substr(-10) && a.substring(4000,4010).length==10 && a.indexOf(a.substr(6000,20),5990)==6000);
+// two strings at once, and one being freed and replaced
+var b = make(3000, 11);
+r.push(check(b, 3000, 11) && check(a, 9000, 7));
+b = undefined;
+var c = make(4000, 13);
+r.push(check(c, 4000, 13));
+E.defrag();
+r.push(check(c, 4000, 13) && check(a, 9000, 7));
+result = r.every(function(x) { return x; });
@@ -0,0 +1,46 @@
+// Switch statements with integer cases jump straight to the right case after the first time they run
+function proto(t) {
+  var r = "";
+  switch (t) {
+    case 1: r += "a"; break;
+    case 2: r += "b"; // fall through
+    case 3: r += "c"; break;
+    case 2: r += "never"; break;
+    case 40: return "ret";
+    default: r += "d";
+  }
+  return r;
+}
+
+function noDefault(t) {
+  var r = "x";
+  switch (t) {
+    case 5: r = "five"; break;
+    case -1: r = "minus"; break; // not a literal, so this can't be jumped to
+  }
+  return r;
+}
+
+function nested(a,b) {
+  switch (a) {
+    case 0:
+      switch (b) {
+        case 0: return "00";
+        case 1: return "01";
+      }
+      return "0?";
+    case 1: return "1";
+  }
+  return "?";
+}
+
+var r = [];
+for (var i=0;i<3;i++) {
+  r.push([0,1,2,3,40,"2",2.5].map(proto).join(","));
+  r.push([5,-1,0].map(noDefault).join(","));
+  r.push(nested(0,0)+nested(0,1)+nested(0,2)+nested(1,0)+nested(2,0));
+}
+
+result = r.join("|") == "d,a,bc,c,ret,d,d|five,minus,x|00010?1?|"+
+                        "d,a,bc,c,ret,d,d|five,minus,x|00010?1?|"+
+                        "d,a,bc,c,ret,d,d|five,minus,x|00010?1?";
@@ -0,0 +1,42 @@
+// Calls in tail position ('return f(...)') are made after the function has returned, so don't use up stack
+E.setFlags({tailCalls:1});
+var r = [];
+
+function count(n, total) {
+  if (n==0) return total;
+  return count(n-1, total+n);
+}
+r.push(count(20000, 0));
+
+// mutual recursion, via a method call
+var o = {
+  even : function(n) { if (n==0) return true; return this.odd(n-1); },
+  odd : function(n) { if (n==0) return false; return this.even(n-1); }
+};
+r.push(o.even(10001));
+// arrow functions returning an expression
+var down = n => step(n+1);
+function step(n) { if (n>0) return n; return down(n); }
+r.push(down(-5000));
+
+// these aren't tail calls, so must still work as normal
+function add1(x) { return x+1; }
+function notTail(x) { return add1(x)*2; }
+function inTry(x) { try { return thrower(x); } catch (e) { return "caught "+e; } }
+function thrower(x) { throw x; }
+function chain(x) { return add1(x).toString()+"!"; }
+function curry(a) { return function(b) { return a+b; }; }
+function callCurry(a) { return curry(a)(2); }
+function lots(a,b,c,d,e,f,g,h,i,j) { return a+b+c+d+e+f+g+h+i+j; }
+function callLots() { return lots(1,2,3,4,5,6,7,8,9,10); }
+r.push(notTail(1), inTry(3), chain(4), callCurry(1), callLots());
+
+// tail calls with code after the 'return' that's parsed but not executed
+var calls = 0;
+function id(x) { calls++; return x; }
+function ifElse(c) { if (c) return id("yes"); else id("no"); }
+function sw(x) { switch (x) { case 1: return id("one"); default: return id("d"); } }
+function swAfter(x) { switch (x) { case 1: return id("f"); default: id("g"); } }
+r.push(ifElse(1), ifElse(0), sw(1), sw(2), swAfter(1), swAfter(2), calls);
+
+result = r.join(",")=="200010000,false,1,4,caught 3,5!,3,55,yes,,one,d,f,,6";
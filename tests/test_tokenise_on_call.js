@@ -0,0 +1,34 @@
+// Functions get a tokenised copy of their code cached when first called
+E.setFlags({pretokenise:0, tokeniseOnCall:1});
+
+function sum(a, b) {
+  var r = /a+b/g;
+  // a comment that shouldn't matter
+  return a + b + `${r.source}` + "  if else ";
+}
+var arrow = (x) => x*2;
+function noTokenise() {
+  var a = 1
+  var b = 2
+  return a
+  +b;
+}
+
+// a parameter called 'tok' mustn't be mistaken for the cached code
+var tok = 1;
+function p(x,tok) { return x+(tok||0); }
+function q(a,tok) { tok=5; return tok; }
+
+var r1 = sum(1,2);
+var r2 = sum(1,2);
+var r3 = arrow(4) + arrow(5);
+var r4 = noTokenise();
+var r5 = noTokenise();
+var r6 = [p(1), p(3), p(1,2), q(1)];
+E.setFlags({tokeniseOnCall:0});
+
+result = r1=="3a+b  if else " && r2==r1 &&
+         r3==18 && r4==3 && r5==3 &&
+         sum.toString().indexOf("a comment")>=0 &&
+         r6.join(",")=="1,3,3,5" && tok==1 &&
+         E.getFlags().tokeniseOnCall==0;
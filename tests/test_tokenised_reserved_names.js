@@ -0,0 +1,15 @@
+// Reserved words used as property names in tokenised functions must keep their own names
+E.setFlags({pretokenise:0, tokeniseOnCall:1});
+
+function f() {
+  var o = {break:1, return:2, if:3, for:4, new:5};
+  o.break += 10;
+  o.continue = 6;
+  return Object.keys(o).join(",")+"|"+o.break+","+o.return+","+o.if+","+o.for+","+o.new+","+o.continue;
+}
+
+var r1 = f();
+var r2 = f();
+E.setFlags({tokeniseOnCall:0});
+
+result = r1=="break,return,if,for,new,continue|11,2,3,4,5,6" && r2==r1;